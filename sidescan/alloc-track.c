@@ -0,0 +1,250 @@
+#include "alloc-track.h"
+
+#include <string.h>
+
+/* Функции распределителя памяти библиотеки C, вызываемые подменёнными
+ * функциями free и realloc. */
+extern void *__libc_realloc (void *mem, size_t size);
+extern void  __libc_free    (void *mem);
+
+/* Место вызова. */
+typedef struct
+{
+  const gchar                 *site;
+  guint64                      n_allocs;
+  guint64                      n_frees;
+  gsize                        size;           /* Объём неосвобождённой памяти. */
+} AllocTrackSite;
+
+/* Выделенный блок. */
+typedef struct
+{
+  AllocTrackSite              *site;
+  gsize                        size;
+} AllocTrackBlock;
+
+static GMutex alloc_track_lock;
+static GHashTable *alloc_track_sites;          /* Место вызова -> AllocTrackSite. */
+static GHashTable *alloc_track_blocks;         /* Адрес блока -> AllocTrackBlock. */
+
+/* Признак работы с таблицами учёта в текущем потоке. Таблицы сами выделяют
+ * и освобождают память, эти вызовы free не учитываются. */
+static __thread gboolean alloc_track_busy;
+
+/* Функция снимает блок с учёта. Вызывается с установленной блокировкой. */
+static void
+alloc_track_remove (gpointer mem)
+{
+  AllocTrackBlock *block;
+
+  block = (alloc_track_blocks != NULL) ? g_hash_table_lookup (alloc_track_blocks, mem) : NULL;
+  if (block == NULL)
+    return;
+
+  block->site->n_frees += 1;
+  block->site->size -= block->size;
+  g_hash_table_remove (alloc_track_blocks, mem);
+}
+
+/* Функция запоминает выделенный блок. */
+static gpointer
+alloc_track_add (gpointer     mem,
+                 gsize        size,
+                 const gchar *site)
+{
+  AllocTrackSite *track_site;
+  AllocTrackBlock *block;
+
+  if (mem == NULL)
+    return NULL;
+
+  g_mutex_lock (&alloc_track_lock);
+  alloc_track_busy = TRUE;
+
+  if (alloc_track_sites == NULL)
+    {
+      alloc_track_sites = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+      alloc_track_blocks = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    }
+
+  track_site = g_hash_table_lookup (alloc_track_sites, site);
+  if (track_site == NULL)
+    {
+      track_site = g_new0 (AllocTrackSite, 1);
+      track_site->site = site;
+      g_hash_table_insert (alloc_track_sites, (gpointer) site, track_site);
+    }
+
+  /* Блок по этому адресу мог быть освобождён в обход учёта. */
+  alloc_track_remove (mem);
+
+  block = g_new (AllocTrackBlock, 1);
+  block->site = track_site;
+  block->size = size;
+  g_hash_table_insert (alloc_track_blocks, mem, block);
+
+  track_site->n_allocs += 1;
+  track_site->size += size;
+
+  alloc_track_busy = FALSE;
+  g_mutex_unlock (&alloc_track_lock);
+
+  return mem;
+}
+
+gpointer
+alloc_track_malloc (gsize        size,
+                    const gchar *site)
+{
+  return alloc_track_add (g_malloc (size), size, site);
+}
+
+gpointer
+alloc_track_malloc0 (gsize        size,
+                     const gchar *site)
+{
+  return alloc_track_add (g_malloc0 (size), size, site);
+}
+
+gchar *
+alloc_track_strdup (const gchar *str,
+                    const gchar *site)
+{
+  gchar *copy = g_strdup (str);
+
+  return alloc_track_add (copy, (copy != NULL) ? strlen (copy) + 1 : 0, site);
+}
+
+gchar *
+alloc_track_strdup_printf (const gchar *site,
+                           const gchar *format,
+                           ...)
+{
+  gchar *str;
+  va_list args;
+
+  va_start (args, format);
+  str = g_strdup_vprintf (format, args);
+  va_end (args);
+
+  return alloc_track_add (str, strlen (str) + 1, site);
+}
+
+/* Подмена функции free библиотеки C. Функция определена в программе,
+ * поэтому её вызывают и g_free, и все библиотеки процесса. */
+void
+free (void *mem)
+{
+  if ((mem != NULL) && !alloc_track_busy)
+    {
+      g_mutex_lock (&alloc_track_lock);
+      alloc_track_busy = TRUE;
+      alloc_track_remove (mem);
+      alloc_track_busy = FALSE;
+      g_mutex_unlock (&alloc_track_lock);
+    }
+
+  __libc_free (mem);
+}
+
+/* Подмена функции realloc библиотеки C. Учтённый блок переносится
+ * на новый адрес с новым размером. */
+void *
+realloc (void   *mem,
+         size_t  size)
+{
+  AllocTrackBlock *block;
+  void *new_mem;
+
+  if ((mem == NULL) || alloc_track_busy)
+    return __libc_realloc (mem, size);
+
+  g_mutex_lock (&alloc_track_lock);
+  alloc_track_busy = TRUE;
+
+  new_mem = __libc_realloc (mem, size);
+  block = (alloc_track_blocks != NULL) ? g_hash_table_lookup (alloc_track_blocks, mem) : NULL;
+
+  /* При ошибке выделения исходный блок не изменяется. */
+  if ((block != NULL) && ((new_mem != NULL) || (size == 0)))
+    {
+      g_hash_table_steal (alloc_track_blocks, mem);
+      block->site->size -= block->size;
+
+      if (new_mem != NULL)
+        {
+          block->size = size;
+          block->site->size += size;
+          g_hash_table_insert (alloc_track_blocks, new_mem, block);
+        }
+      else
+        {
+          block->site->n_frees += 1;
+          g_free (block);
+        }
+    }
+
+  alloc_track_busy = FALSE;
+  g_mutex_unlock (&alloc_track_lock);
+
+  return new_mem;
+}
+
+static gint
+alloc_track_compare_size (gconstpointer a,
+                          gconstpointer b)
+{
+  const AllocTrackSite *site_a = *(AllocTrackSite * const *) a;
+  const AllocTrackSite *site_b = *(AllocTrackSite * const *) b;
+
+  return (site_a->size < site_b->size) - (site_a->size > site_b->size);
+}
+
+void
+alloc_track_report (guint n_sites)
+{
+  GHashTableIter iter;
+  GPtrArray *sites;
+  gpointer value;
+  guint i;
+
+  g_mutex_lock (&alloc_track_lock);
+
+  if (alloc_track_sites == NULL)
+    {
+      g_mutex_unlock (&alloc_track_lock);
+      return;
+    }
+
+  alloc_track_busy = TRUE;
+
+  /* Копия счётчиков, чтобы не держать блокировку во время записи в журнал. */
+  sites = g_ptr_array_new_with_free_func (g_free);
+  g_hash_table_iter_init (&iter, alloc_track_sites);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      AllocTrackSite *site = g_new (AllocTrackSite, 1);
+
+      *site = *(AllocTrackSite *) value;
+      g_ptr_array_add (sites, site);
+    }
+
+  alloc_track_busy = FALSE;
+  g_mutex_unlock (&alloc_track_lock);
+
+  g_ptr_array_sort (sites, alloc_track_compare_size);
+
+  g_message ("allocations: %u call sites", sites->len);
+  for (i = 0; i < MIN (n_sites, sites->len); i++)
+    {
+      AllocTrackSite *site = g_ptr_array_index (sites, i);
+
+      if (site->size == 0)
+        break;
+
+      g_message ("  %s: %" G_GSIZE_FORMAT " bytes in %" G_GUINT64_FORMAT " blocks, %" G_GUINT64_FORMAT " allocated",
+                 site->site, site->size, site->n_allocs - site->n_frees, site->n_allocs);
+    }
+
+  g_ptr_array_unref (sites);
+}
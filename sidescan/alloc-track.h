@@ -0,0 +1,51 @@
+#ifndef __ALLOC_TRACK_H__
+#define __ALLOC_TRACK_H__
+
+#include <glib.h>
+
+/* Учёт выделений памяти по местам вызова. Включается при сборке
+ * с -DSIDESCAN_TRACK_ALLOC=ON: этот файл подключается ко всем исходным
+ * файлам программы, и функции g_malloc, g_malloc0, g_new, g_new0,
+ * g_strdup и g_strdup_printf заменяются функциями, которые запоминают
+ * место вызова каждого выделенного блока. Освобождение учитывается на
+ * уровне распределителя памяти: функции free и realloc библиотеки C
+ * подменяются в программе, поэтому учитываются и блоки, освобождаемые
+ * библиотеками, например функциями освобождения значений GHashTable
+ * или g_clear_pointer. Для каждого места вызова считается число
+ * выделенных и освобождённых блоков и объём неосвобождённой памяти. */
+
+gpointer       alloc_track_malloc      (gsize                          size,
+                                        const gchar                   *site);
+
+gpointer       alloc_track_malloc0     (gsize                          size,
+                                        const gchar                   *site);
+
+gchar         *alloc_track_strdup      (const gchar                   *str,
+                                        const gchar                   *site);
+
+gchar         *alloc_track_strdup_printf (const gchar                 *site,
+                                        const gchar                   *format,
+                                        ...) G_GNUC_PRINTF (2, 3);
+
+/* Функция записывает в журнал n_sites мест вызова с наибольшим объёмом
+ * неосвобождённой памяти. */
+void           alloc_track_report      (guint                          n_sites);
+
+#if defined (SIDESCAN_TRACK_ALLOC) && !defined (ALLOC_TRACK_IMPLEMENTATION)
+
+#undef g_malloc
+#undef g_malloc0
+#undef g_new
+#undef g_new0
+#undef g_strdup
+
+#define g_malloc(size)                 alloc_track_malloc ((size), G_STRLOC)
+#define g_malloc0(size)                alloc_track_malloc0 ((size), G_STRLOC)
+#define g_new(type, n)                 ((type *) alloc_track_malloc (sizeof (type) * (n), G_STRLOC))
+#define g_new0(type, n)                ((type *) alloc_track_malloc0 (sizeof (type) * (n), G_STRLOC))
+#define g_strdup(str)                  alloc_track_strdup ((str), G_STRLOC)
+#define g_strdup_printf(...)           alloc_track_strdup_printf (G_STRLOC, __VA_ARGS__)
+
+#endif
+
+#endif /* __ALLOC_TRACK_H__ */
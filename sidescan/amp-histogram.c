@@ -0,0 +1,203 @@
+#include "amp-histogram.h"
+
+#include <string.h>
+
+struct _AmpHistogram
+{
+  guint64                     *bins;
+  guint                        n_bins;
+  gdouble                      max;
+  gfloat                       scale;          /* Число интервалов на единицу амплитуды. */
+  guint64                      total;
+};
+
+/* Функция изменяет счётчики интервалов для амплитуд values на delta. */
+static void
+amp_histogram_update (AmpHistogram *histogram,
+                      const gfloat *values,
+                      guint         n_values,
+                      gint          delta)
+{
+  guint64 *bins = histogram->bins;
+  gfloat scale = histogram->scale;
+  gfloat last = histogram->n_bins - 1;
+  guint i;
+
+  for (i = 0; i < n_values; i++)
+    {
+      gfloat position = values[i] * scale;
+
+      /* Сравнение записано так, чтобы NAN попадал в нулевой интервал. */
+      position = (position > 0.0f) ? position : 0.0f;
+      position = (position < last) ? position : last;
+      bins[(guint) position] += delta;
+    }
+
+  histogram->total += (gint64) delta * n_values;
+}
+
+AmpHistogram *
+amp_histogram_new (guint   n_bins,
+                   gdouble max)
+{
+  AmpHistogram *histogram;
+
+  histogram = g_new0 (AmpHistogram, 1);
+  histogram->n_bins = MAX (n_bins, 2);
+  histogram->max = (max > 0.0) ? max : 1.0;
+  histogram->scale = histogram->n_bins / histogram->max;
+  histogram->bins = g_new0 (guint64, histogram->n_bins);
+
+  return histogram;
+}
+
+void
+amp_histogram_add (AmpHistogram *histogram,
+                   const gfloat *values,
+                   guint         n_values)
+{
+  amp_histogram_update (histogram, values, n_values, 1);
+}
+
+void
+amp_histogram_remove (AmpHistogram *histogram,
+                      const gfloat *values,
+                      guint         n_values)
+{
+  amp_histogram_update (histogram, values, n_values, -1);
+}
+
+void
+amp_histogram_clear (AmpHistogram *histogram)
+{
+  memset (histogram->bins, 0, histogram->n_bins * sizeof (guint64));
+  histogram->total = 0;
+}
+
+guint64
+amp_histogram_get_total (AmpHistogram *histogram)
+{
+  return histogram->total;
+}
+
+const guint64 *
+amp_histogram_get_bins (AmpHistogram *histogram,
+                        guint        *n_bins)
+{
+  if (n_bins != NULL)
+    *n_bins = histogram->n_bins;
+
+  return histogram->bins;
+}
+
+gboolean
+amp_histogram_set_bins (AmpHistogram  *histogram,
+                        const guint64 *bins,
+                        guint          n_bins)
+{
+  guint i;
+
+  if (n_bins != histogram->n_bins)
+    return FALSE;
+
+  memcpy (histogram->bins, bins, n_bins * sizeof (guint64));
+  histogram->total = 0;
+  for (i = 0; i < n_bins; i++)
+    histogram->total += bins[i];
+
+  return TRUE;
+}
+
+gdouble
+amp_histogram_quantile (AmpHistogram *histogram,
+                        gdouble       q)
+{
+  guint64 target, sum = 0;
+  guint i;
+
+  if (histogram->total == 0)
+    return 0.0;
+
+  target = CLAMP (q, 0.0, 1.0) * histogram->total;
+  for (i = 0; i < histogram->n_bins; i++)
+    {
+      sum += histogram->bins[i];
+      if (sum > target)
+        break;
+    }
+
+  return (MIN (i, histogram->n_bins - 1) + 1) / (gdouble) histogram->scale;
+}
+
+void
+amp_histogram_equalize (AmpHistogram *histogram,
+                        gdouble       white,
+                        gdouble       clip,
+                        gdouble      *curve,
+                        guint         n_points)
+{
+  gdouble *counts;
+  gdouble total = 0.0;
+  gdouble excess = 0.0;
+  gdouble limit, sum;
+  guint i;
+
+  if (n_points < 2)
+    return;
+
+  /* Счётчики интервалов на отрезке [0, white]. Амплитуды выше white
+   * отображаются одним цветом и в выравнивании не участвуют. */
+  counts = g_new0 (gdouble, n_points);
+  for (i = 0; i < histogram->n_bins; i++)
+    {
+      gdouble amplitude = (i + 0.5) / histogram->scale;
+      guint point;
+
+      if ((white <= 0.0) || (amplitude >= white))
+        break;
+
+      point = amplitude / white * n_points;
+      counts[MIN (point, n_points - 1)] += histogram->bins[i];
+      total += histogram->bins[i];
+    }
+
+  if (total == 0.0)
+    {
+      for (i = 0; i < n_points; i++)
+        curve[i] = (gdouble) i / (n_points - 1);
+
+      g_free (counts);
+      return;
+    }
+
+  /* Ограничение контраста. */
+  limit = MAX (clip, 1.0) * total / n_points;
+  for (i = 0; i < n_points; i++)
+    {
+      if (counts[i] > limit)
+        {
+          excess += counts[i] - limit;
+          counts[i] = limit;
+        }
+    }
+
+  /* Интегральная функция распределения, нормированная к [0, 1]. */
+  sum = 0.0;
+  for (i = 0; i < n_points; i++)
+    {
+      curve[i] = sum;
+      sum += counts[i] + excess / n_points;
+    }
+
+  for (i = 1; i < n_points; i++)
+    curve[i] = (curve[n_points - 1] > 0.0) ? curve[i] / curve[n_points - 1] : (gdouble) i / (n_points - 1);
+
+  g_free (counts);
+}
+
+void
+amp_histogram_free (AmpHistogram *histogram)
+{
+  g_free (histogram->bins);
+  g_free (histogram);
+}
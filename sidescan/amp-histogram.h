@@ -0,0 +1,59 @@
+#ifndef __AMP_HISTOGRAM_H__
+#define __AMP_HISTOGRAM_H__
+
+#include <glib.h>
+
+/* Гистограмма амплитуд. Интервал амплитуд от 0 до max разбивается на
+ * n_bins равных интервалов, амплитуды вне интервала относятся к крайним.
+ * Строки данных можно добавлять и удалять, что позволяет вести
+ * гистограмму скользящего окна без повторного просмотра данных. */
+typedef struct _AmpHistogram AmpHistogram;
+
+/* Функция создаёт гистограмму. */
+AmpHistogram  *amp_histogram_new       (guint                          n_bins,
+                                        gdouble                        max);
+
+/* Функция добавляет амплитуды в гистограмму. */
+void           amp_histogram_add       (AmpHistogram                  *histogram,
+                                        const gfloat                  *values,
+                                        guint                          n_values);
+
+/* Функция удаляет из гистограммы ранее добавленные амплитуды. */
+void           amp_histogram_remove    (AmpHistogram                  *histogram,
+                                        const gfloat                  *values,
+                                        guint                          n_values);
+
+/* Функция очищает гистограмму. */
+void           amp_histogram_clear     (AmpHistogram                  *histogram);
+
+/* Функция возвращает число амплитуд в гистограмме. */
+guint64        amp_histogram_get_total (AmpHistogram                  *histogram);
+
+/* Функция возвращает массив счётчиков интервалов и их число. */
+const guint64 *amp_histogram_get_bins  (AmpHistogram                  *histogram,
+                                        guint                         *n_bins);
+
+/* Функция заменяет счётчики интервалов, например сохранённые ранее. */
+gboolean       amp_histogram_set_bins  (AmpHistogram                  *histogram,
+                                        const guint64                 *bins,
+                                        guint                          n_bins);
+
+/* Функция возвращает амплитуду, ниже которой находится доля q амплитуд. */
+gdouble        amp_histogram_quantile  (AmpHistogram                  *histogram,
+                                        gdouble                        q);
+
+/* Функция вычисляет кривую выравнивания гистограммы с ограничением
+ * контраста на интервале амплитуд от 0 до white. Счётчики, превышающие
+ * среднее значение более чем в clip раз, ограничиваются, а избыток
+ * равномерно распределяется по всем интервалам. Значение curve[i]
+ * от 0 до 1 соответствует амплитуде white * i / (n_points - 1). */
+void           amp_histogram_equalize  (AmpHistogram                  *histogram,
+                                        gdouble                        white,
+                                        gdouble                        clip,
+                                        gdouble                       *curve,
+                                        guint                          n_points);
+
+/* Функция освобождает гистограмму. */
+void           amp_histogram_free      (AmpHistogram                  *histogram);
+
+#endif /* __AMP_HISTOGRAM_H__ */
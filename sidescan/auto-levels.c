@@ -0,0 +1,260 @@
+#include "auto-levels.h"
+#include "amp-histogram.h"
+
+#include <hyscan-acoustic-data.h>
+#include <math.h>
+
+#define AUTO_LEVELS_N_BINS             4096            /* Число интервалов гистограммы амплитуд. */
+#define AUTO_LEVELS_N_LINES            128             /* Число строк выборки борта в области просмотра. */
+#define AUTO_LEVELS_MAX_READS          32              /* Число строк, считываемых за одно обновление. */
+#define AUTO_LEVELS_MIN_VALUES         4096            /* Минимальное число амплитуд для определения уровней. */
+#define AUTO_LEVELS_BLACK              0.01            /* Доля амплитуд ниже уровня чёрного. */
+#define AUTO_LEVELS_WHITE              0.995           /* Доля амплитуд ниже уровня белого. */
+#define AUTO_LEVELS_MEDIAN             0.4             /* Яркость медианы амплитуд. */
+#define AUTO_LEVELS_MIN_GAMMA          0.25
+#define AUTO_LEVELS_MAX_GAMMA          4.0
+#define AUTO_LEVELS_SMOOTH             0.3             /* Коэффициент сглаживания уровней между обновлениями. */
+#define AUTO_LEVELS_PRECISION          1e-4            /* Изменение уровня, требующее обновления изображения. */
+
+static const HyScanSourceType auto_levels_sources[] = { HYSCAN_SOURCE_SIDE_SCAN_STARBOARD, HYSCAN_SOURCE_SIDE_SCAN_PORT };
+
+/* Строки борта в гистограмме. Учитываются строки с индексами k * step
+ * для k от first до last включительно, при last < first строк нет. */
+typedef struct
+{
+  HyScanAcousticData          *data;
+  gint64                       first;
+  gint64                       last;
+} AutoLevelsBoard;
+
+struct _AutoLevels
+{
+  AutoLevelsBoard              boards[G_N_ELEMENTS (auto_levels_sources)];
+  guint32                      step;           /* Шаг выборки строк. */
+
+  AmpHistogram                *histogram;
+  gboolean                     valid;          /* Признак определённых уровней. */
+  gdouble                      black;
+  gdouble                      gamma;
+  gdouble                      white;
+};
+
+/* Функция добавляет или удаляет из гистограммы строку с индексом index. */
+static void
+auto_levels_line (AutoLevels      *levels,
+                  AutoLevelsBoard *board,
+                  guint32          index,
+                  gboolean         add)
+{
+  const gfloat *values;
+  guint32 n_values;
+  gint64 time;
+
+  values = hyscan_acoustic_data_get_values (board->data, index, &n_values, &time);
+  if (values == NULL)
+    return;
+
+  if (add)
+    amp_histogram_add (levels->histogram, values, n_values);
+  else
+    amp_histogram_remove (levels->histogram, values, n_values);
+}
+
+/* Функция приводит строки борта к строкам выборки с номерами от first
+ * до last, считывая не более budget строк. Возвращает число считанных строк. */
+static guint
+auto_levels_board_update (AutoLevels      *levels,
+                          AutoLevelsBoard *board,
+                          gint64           first,
+                          gint64           last,
+                          guint            budget)
+{
+  guint n_reads = 0;
+
+  /* Удаляем строки, вышедшие из области просмотра. */
+  for (; (board->first <= board->last) && (board->first < first) && (n_reads < budget); n_reads++)
+    auto_levels_line (levels, board, board->first++ * levels->step, FALSE);
+  for (; (board->first <= board->last) && (board->last > last) && (n_reads < budget); n_reads++)
+    auto_levels_line (levels, board, board->last-- * levels->step, FALSE);
+
+  if (board->first > board->last)
+    {
+      board->first = first;
+      board->last = first - 1;
+    }
+
+  /* Добавляем строки, вошедшие в область просмотра. */
+  for (; (board->last < last) && (n_reads < budget); n_reads++)
+    auto_levels_line (levels, board, ++board->last * levels->step, TRUE);
+  for (; (board->first > first) && (n_reads < budget); n_reads++)
+    auto_levels_line (levels, board, --board->first * levels->step, TRUE);
+
+  return n_reads;
+}
+
+/* Функция определяет уровни по гистограмме. */
+static gboolean
+auto_levels_compute (AutoLevels *levels,
+                     gdouble    *black,
+                     gdouble    *gamma,
+                     gdouble    *white)
+{
+  gdouble median;
+
+  if (amp_histogram_get_total (levels->histogram) < AUTO_LEVELS_MIN_VALUES)
+    return FALSE;
+
+  *black = amp_histogram_quantile (levels->histogram, AUTO_LEVELS_BLACK);
+  *white = amp_histogram_quantile (levels->histogram, AUTO_LEVELS_WHITE);
+  if (*white <= *black)
+    return FALSE;
+
+  /* Гамма, при которой медиана амплитуд отображается яркостью AUTO_LEVELS_MEDIAN. */
+  median = (amp_histogram_quantile (levels->histogram, 0.5) - *black) / (*white - *black);
+  if ((median > 0.0) && (median < 1.0))
+    *gamma = CLAMP (log (AUTO_LEVELS_MEDIAN) / log (median), AUTO_LEVELS_MIN_GAMMA, AUTO_LEVELS_MAX_GAMMA);
+  else
+    *gamma = 1.0;
+
+  return TRUE;
+}
+
+AutoLevels *
+auto_levels_new (HyScanDB    *db,
+                 const gchar *project_name,
+                 const gchar *track_name,
+                 gboolean     raw)
+{
+  AutoLevels *levels;
+  guint i;
+
+  levels = g_new0 (AutoLevels, 1);
+  for (i = 0; i < G_N_ELEMENTS (auto_levels_sources); i++)
+    {
+      levels->boards[i].data = hyscan_acoustic_data_new (db, project_name, track_name, auto_levels_sources[i], raw);
+      levels->boards[i].last = -1;
+    }
+
+  levels->histogram = amp_histogram_new (AUTO_LEVELS_N_BINS, 1.0);
+
+  return levels;
+}
+
+gboolean
+auto_levels_update (AutoLevels *levels,
+                    gdouble     from,
+                    gdouble     to)
+{
+  gint64 first[G_N_ELEMENTS (auto_levels_sources)];
+  gint64 last[G_N_ELEMENTS (auto_levels_sources)];
+  guint32 step = 1;
+  guint n_reads = 0;
+  gdouble black, gamma, white;
+  gdouble prev_black, prev_gamma, prev_white;
+  guint i;
+
+  from = CLAMP (from, 0.0, 1.0);
+  to = CLAMP (to, from, 1.0);
+
+  /* Строки области просмотра каждого борта. */
+  for (i = 0; i < G_N_ELEMENTS (auto_levels_sources); i++)
+    {
+      guint32 first_index, last_index;
+      gdouble from_index, to_index;
+
+      first[i] = 0;
+      last[i] = -1;
+
+      if ((levels->boards[i].data == NULL) ||
+          !hyscan_acoustic_data_get_range (levels->boards[i].data, &first_index, &last_index))
+        continue;
+
+      from_index = first_index + from * (last_index - first_index);
+      to_index = first_index + to * (last_index - first_index);
+
+      /* Шаг выборки - степень двойки, поэтому небольшое изменение масштаба
+       * не приводит к повторному построению гистограммы. */
+      while ((to_index - from_index) / step > AUTO_LEVELS_N_LINES)
+        step *= 2;
+
+      first[i] = from_index;
+      last[i] = to_index;
+    }
+
+  if (step != levels->step)
+    {
+      for (i = 0; i < G_N_ELEMENTS (auto_levels_sources); i++)
+        {
+          levels->boards[i].first = 0;
+          levels->boards[i].last = -1;
+        }
+
+      amp_histogram_clear (levels->histogram);
+      levels->step = step;
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (auto_levels_sources); i++)
+    {
+      if (last[i] < first[i])
+        continue;
+
+      n_reads += auto_levels_board_update (levels, &levels->boards[i],
+                                           (first[i] + step - 1) / step, last[i] / step,
+                                           AUTO_LEVELS_MAX_READS - n_reads);
+    }
+
+  if (!auto_levels_compute (levels, &black, &gamma, &white))
+    return FALSE;
+
+  prev_black = levels->black;
+  prev_gamma = levels->gamma;
+  prev_white = levels->white;
+
+  /* Сглаживание исключает мерцание изображения при прокрутке. */
+  if (levels->valid)
+    {
+      levels->black += AUTO_LEVELS_SMOOTH * (black - levels->black);
+      levels->gamma += AUTO_LEVELS_SMOOTH * (gamma - levels->gamma);
+      levels->white += AUTO_LEVELS_SMOOTH * (white - levels->white);
+    }
+  else
+    {
+      levels->black = black;
+      levels->gamma = gamma;
+      levels->white = white;
+      levels->valid = TRUE;
+    }
+
+  return (n_reads > 0) ||
+         (fabs (levels->black - prev_black) > AUTO_LEVELS_PRECISION) ||
+         (fabs (levels->gamma - prev_gamma) > AUTO_LEVELS_PRECISION) ||
+         (fabs (levels->white - prev_white) > AUTO_LEVELS_PRECISION);
+}
+
+gboolean
+auto_levels_get (AutoLevels *levels,
+                 gdouble    *black,
+                 gdouble    *gamma,
+                 gdouble    *white)
+{
+  if (!levels->valid)
+    return FALSE;
+
+  *black = levels->black;
+  *gamma = levels->gamma;
+  *white = levels->white;
+
+  return TRUE;
+}
+
+void
+auto_levels_free (AutoLevels *levels)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (auto_levels_sources); i++)
+    g_clear_object (&levels->boards[i].data);
+
+  amp_histogram_free (levels->histogram);
+  g_free (levels);
+}
@@ -0,0 +1,37 @@
+#ifndef __AUTO_LEVELS_H__
+#define __AUTO_LEVELS_H__
+
+#include <hyscan-db.h>
+
+/* Автоматическая яркость и контрастность. Ведётся гистограмма амплитуд
+ * строк бортов, попадающих в область просмотра. При перемещении области
+ * в гистограмму добавляются только вошедшие в неё строки и удаляются
+ * вышедшие, число считываемых за одно обновление строк ограничено.
+ * По квантилям гистограммы определяются уровни чёрного и белого и гамма,
+ * при которой медиана амплитуд имеет заданную яркость. */
+typedef struct _AutoLevels AutoLevels;
+
+/* Функция создаёт объект автоматической яркости для галса. */
+AutoLevels    *auto_levels_new         (HyScanDB                      *db,
+                                        const gchar                   *project_name,
+                                        const gchar                   *track_name,
+                                        gboolean                       raw);
+
+/* Функция обновляет гистограмму для области просмотра галса. Границы from
+ * и to задаются долями длины галса от 0 до 1. Возвращает TRUE, если
+ * уровни изменились. */
+gboolean       auto_levels_update      (AutoLevels                    *levels,
+                                        gdouble                        from,
+                                        gdouble                        to);
+
+/* Функция возвращает уровни для hyscan_gtk_waterfall_set_levels.
+ * Возвращает FALSE, если данных для их определения недостаточно. */
+gboolean       auto_levels_get         (AutoLevels                    *levels,
+                                        gdouble                       *black,
+                                        gdouble                       *gamma,
+                                        gdouble                       *white);
+
+/* Функция освобождает объект автоматической яркости. */
+void           auto_levels_free        (AutoLevels                    *levels);
+
+#endif /* __AUTO_LEVELS_H__ */
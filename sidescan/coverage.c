@@ -0,0 +1,349 @@
+#include "coverage.h"
+
+#include <math.h>
+
+#define COVERAGE_CHUNK_SIZE            64              /* Размер стороны блока ячеек. */
+#define COVERAGE_CHUNK_CELLS           (COVERAGE_CHUNK_SIZE * COVERAGE_CHUNK_SIZE)
+#define COVERAGE_MAX_IMAGE             512             /* Максимальный размер изображения карты, точки. */
+#define COVERAGE_GAP_DISTANCE          4               /* Расстояние поиска соседних полос для пропуска, точки. */
+#define COVERAGE_MAX_JUMP              10              /* Максимальный разрыв между отметками в ширинах полосы. */
+#define COVERAGE_EARTH_RADIUS          6371000.0       /* Радиус Земли, м. */
+
+/* Блок ячеек карты покрытия. */
+typedef struct
+{
+  guint16                      count[COVERAGE_CHUNK_CELLS];    /* Число проходов. */
+  guint16                      pass[COVERAGE_CHUNK_CELLS];     /* Номер последнего прохода. */
+} CoverageChunk;
+
+struct _Coverage
+{
+  gdouble                      cell_size;
+
+  gboolean                     has_origin;
+  gdouble                      lat0;
+  gdouble                      lon0;
+  gdouble                      meters_per_lat;
+  gdouble                      meters_per_lon;
+
+  GHashTable                  *chunks;         /* Блоки ячеек CoverageChunk. */
+  gint                         min_x;          /* Границы покрытой области в ячейках. */
+  gint                         max_x;
+  gint                         min_y;
+  gint                         max_y;
+  guint64                      n_covered;      /* Число покрытых ячеек. */
+  guint64                      n_overlap;      /* Число ячеек перекрытия. */
+
+  guint16                      pass;           /* Номер текущего прохода. */
+  gboolean                     has_prev;
+  gdouble                      prev_e;         /* Предыдущее местоположение, м. */
+  gdouble                      prev_n;
+};
+
+/* Функция выполняет деление с округлением вниз. */
+static inline gint
+coverage_floor_div (gint a,
+                    gint b)
+{
+  return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+static inline gint64
+coverage_chunk_key (gint x,
+                    gint y)
+{
+  return ((gint64) x << 32) | (guint32) y;
+}
+
+/* Функция отмечает ячейку, захваченную текущим проходом. */
+static void
+coverage_mark (Coverage *coverage,
+               gint      x,
+               gint      y)
+{
+  CoverageChunk *chunk;
+  gint cx = coverage_floor_div (x, COVERAGE_CHUNK_SIZE);
+  gint cy = coverage_floor_div (y, COVERAGE_CHUNK_SIZE);
+  gint64 key = coverage_chunk_key (cx, cy);
+  guint i;
+
+  chunk = g_hash_table_lookup (coverage->chunks, &key);
+  if (chunk == NULL)
+    {
+      gint64 *chunk_key = g_new (gint64, 1);
+
+      *chunk_key = key;
+      chunk = g_new0 (CoverageChunk, 1);
+      g_hash_table_insert (coverage->chunks, chunk_key, chunk);
+    }
+
+  i = (y - cy * COVERAGE_CHUNK_SIZE) * COVERAGE_CHUNK_SIZE + (x - cx * COVERAGE_CHUNK_SIZE);
+  if (chunk->pass[i] == coverage->pass)
+    return;
+
+  chunk->pass[i] = coverage->pass;
+  if (chunk->count[i] < G_MAXUINT16)
+    chunk->count[i] += 1;
+
+  if (chunk->count[i] == 1)
+    {
+      if (coverage->n_covered == 0)
+        {
+          coverage->min_x = coverage->max_x = x;
+          coverage->min_y = coverage->max_y = y;
+        }
+      else
+        {
+          coverage->min_x = MIN (coverage->min_x, x);
+          coverage->max_x = MAX (coverage->max_x, x);
+          coverage->min_y = MIN (coverage->min_y, y);
+          coverage->max_y = MAX (coverage->max_y, y);
+        }
+
+      coverage->n_covered += 1;
+    }
+  else if (chunk->count[i] == 2)
+    {
+      coverage->n_overlap += 1;
+    }
+}
+
+/* Функция отмечает ячейки полосы обзора поперёк курса. */
+static void
+coverage_swath (Coverage *coverage,
+                gdouble   e,
+                gdouble   n,
+                gdouble   heading,
+                gdouble   ground_range,
+                gdouble   nadir)
+{
+  gdouble right_e = cos (heading);
+  gdouble right_n = -sin (heading);
+  gdouble step = coverage->cell_size / 2.0;
+  gdouble t;
+
+  for (t = -ground_range; t <= ground_range; t += step)
+    {
+      if (fabs (t) < nadir)
+        continue;
+
+      coverage_mark (coverage,
+                     floor ((e + right_e * t) / coverage->cell_size),
+                     floor ((n + right_n * t) / coverage->cell_size));
+    }
+}
+
+Coverage *
+coverage_new (gdouble cell_size)
+{
+  Coverage *coverage = g_new0 (Coverage, 1);
+
+  coverage->cell_size = (cell_size > 0.0) ? cell_size : 5.0;
+  coverage->chunks = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, g_free);
+  coverage->pass = 1;
+
+  return coverage;
+}
+
+void
+coverage_begin_pass (Coverage *coverage)
+{
+  coverage->has_prev = FALSE;
+  coverage->pass = (coverage->pass == G_MAXUINT16) ? 1 : coverage->pass + 1;
+}
+
+void
+coverage_add_fix (Coverage       *coverage,
+                  const NavPoint *point,
+                  gdouble         range,
+                  gdouble         altitude)
+{
+  gdouble heading = point->heading * G_PI / 180.0;
+  gdouble ground_range, nadir;
+  gdouble e, n;
+
+  if (!coverage->has_origin)
+    {
+      coverage->has_origin = TRUE;
+      coverage->lat0 = point->lat;
+      coverage->lon0 = point->lon;
+      coverage->meters_per_lat = COVERAGE_EARTH_RADIUS * G_PI / 180.0;
+      coverage->meters_per_lon = coverage->meters_per_lat * cos (point->lat * G_PI / 180.0);
+    }
+
+  /* Полоса обзора на грунте. */
+  altitude = CLAMP (altitude, 0.0, range);
+  ground_range = sqrt (range * range - altitude * altitude);
+  nadir = 0.0;
+
+  e = (point->lon - coverage->lon0) * coverage->meters_per_lon;
+  n = (point->lat - coverage->lat0) * coverage->meters_per_lat;
+
+  /* Полоса между предыдущей и текущей отметками. */
+  if (coverage->has_prev)
+    {
+      gdouble de = e - coverage->prev_e;
+      gdouble dn = n - coverage->prev_n;
+      gdouble distance = sqrt (de * de + dn * dn);
+      guint n_steps = ceil (distance / (coverage->cell_size / 2.0));
+      guint k;
+
+      if ((n_steps > 0) && (distance < COVERAGE_MAX_JUMP * 2.0 * MAX (ground_range, coverage->cell_size)))
+        {
+          for (k = 1; k < n_steps; k++)
+            {
+              gdouble part = (gdouble) k / n_steps;
+
+              coverage_swath (coverage, coverage->prev_e + part * de, coverage->prev_n + part * dn,
+                              heading, ground_range, nadir);
+            }
+        }
+    }
+
+  coverage_swath (coverage, e, n, heading, ground_range, nadir);
+
+  coverage->has_prev = TRUE;
+  coverage->prev_e = e;
+  coverage->prev_n = n;
+}
+
+void
+coverage_get_stats (Coverage *coverage,
+                    gdouble  *area,
+                    gdouble  *overlap)
+{
+  if (area != NULL)
+    *area = coverage->n_covered * coverage->cell_size * coverage->cell_size;
+
+  if (overlap != NULL)
+    *overlap = (coverage->n_covered > 0) ? 100.0 * coverage->n_overlap / coverage->n_covered : 0.0;
+}
+
+/* Функция проверяет, есть ли покрытые точки изображения в направлении (dx, dy). */
+static gboolean
+coverage_has_neighbour (const guint8 *counts,
+                        gint          width,
+                        gint          height,
+                        gint          x,
+                        gint          y,
+                        gint          dx,
+                        gint          dy)
+{
+  gint i;
+
+  for (i = 1; i <= COVERAGE_GAP_DISTANCE; i++)
+    {
+      gint nx = x + i * dx;
+      gint ny = y + i * dy;
+
+      if ((nx < 0) || (ny < 0) || (nx >= width) || (ny >= height))
+        return FALSE;
+
+      if (counts[ny * width + nx] > 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+void
+coverage_draw (Coverage *coverage,
+               cairo_t  *cairo,
+               gint      width,
+               gint      height)
+{
+  cairo_surface_t *surface;
+  GHashTableIter iter;
+  gpointer key, value;
+  guint8 *counts;
+  guchar *data;
+  gint factor, image_width, image_height, stride;
+  gint x, y;
+  gdouble scale;
+
+  cairo_set_source_rgb (cairo, 0.1, 0.1, 0.1);
+  cairo_paint (cairo);
+
+  if (coverage->n_covered == 0)
+    return;
+
+  /* Размер изображения, одна точка может объединять несколько ячеек. */
+  factor = MAX (coverage->max_x - coverage->min_x, coverage->max_y - coverage->min_y) / COVERAGE_MAX_IMAGE + 1;
+  image_width = (coverage->max_x - coverage->min_x) / factor + 1;
+  image_height = (coverage->max_y - coverage->min_y) / factor + 1;
+
+  /* Число проходов в точках изображения, север направлен вверх. */
+  counts = g_malloc0 (image_width * image_height);
+  g_hash_table_iter_init (&iter, coverage->chunks);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      CoverageChunk *chunk = value;
+      gint cx = *(gint64 *) key >> 32;
+      gint cy = (gint32) *(gint64 *) key;
+      guint i;
+
+      for (i = 0; i < COVERAGE_CHUNK_CELLS; i++)
+        {
+          guint8 count;
+          gint offset;
+
+          if (chunk->count[i] == 0)
+            continue;
+
+          x = (cx * COVERAGE_CHUNK_SIZE + i % COVERAGE_CHUNK_SIZE - coverage->min_x) / factor;
+          y = (coverage->max_y - (cy * COVERAGE_CHUNK_SIZE + i / COVERAGE_CHUNK_SIZE)) / factor;
+          offset = y * image_width + x;
+          count = MIN (chunk->count[i], 2);
+          counts[offset] = MAX (counts[offset], count);
+        }
+    }
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, image_width, image_height);
+  cairo_surface_flush (surface);
+  data = cairo_image_surface_get_data (surface);
+  stride = cairo_image_surface_get_stride (surface);
+
+  for (y = 0; y < image_height; y++)
+    {
+      guint32 *row = (guint32 *) (data + y * stride);
+
+      for (x = 0; x < image_width; x++)
+        {
+          guint8 count = counts[y * image_width + x];
+
+          if (count == 1)
+            row[x] = 0xff30a030;
+          else if (count == 2)
+            row[x] = 0xffe0c020;
+          else if ((coverage_has_neighbour (counts, image_width, image_height, x, y, -1, 0) &&
+                    coverage_has_neighbour (counts, image_width, image_height, x, y, 1, 0)) ||
+                   (coverage_has_neighbour (counts, image_width, image_height, x, y, 0, -1) &&
+                    coverage_has_neighbour (counts, image_width, image_height, x, y, 0, 1)))
+            row[x] = 0xffd03030;
+          else
+            row[x] = 0x00000000;
+        }
+    }
+
+  cairo_surface_mark_dirty (surface);
+  g_free (counts);
+
+  /* Изображение вписывается в область рисования с сохранением пропорций. */
+  scale = MIN ((gdouble) width / image_width, (gdouble) height / image_height);
+  cairo_save (cairo);
+  cairo_translate (cairo, (width - scale * image_width) / 2.0, (height - scale * image_height) / 2.0);
+  cairo_scale (cairo, scale, scale);
+  cairo_set_source_surface (cairo, surface, 0.0, 0.0);
+  cairo_pattern_set_filter (cairo_get_source (cairo), CAIRO_FILTER_NEAREST);
+  cairo_paint (cairo);
+  cairo_restore (cairo);
+
+  cairo_surface_destroy (surface);
+}
+
+void
+coverage_free (Coverage *coverage)
+{
+  g_hash_table_unref (coverage->chunks);
+  g_free (coverage);
+}
@@ -0,0 +1,42 @@
+#ifndef __COVERAGE_H__
+#define __COVERAGE_H__
+
+#include <gtk/gtk.h>
+#include "nav-index.h"
+
+/* Карта покрытия. Для каждой ячейки растра хранится число проходов,
+ * полоса обзора которых захватила ячейку. При поступлении навигационной
+ * отметки в растр добавляется только полоса обзора между предыдущей
+ * и новой отметками, ранее записанные галсы повторно не обрабатываются. */
+typedef struct _Coverage Coverage;
+
+/* Функция создаёт карту покрытия с размером ячейки cell_size, м. */
+Coverage      *coverage_new            (gdouble                        cell_size);
+
+/* Функция начинает новый проход (галс). Ячейки, захваченные полосой
+ * обзора нескольких проходов, считаются перекрытием. */
+void           coverage_begin_pass     (Coverage                      *coverage);
+
+/* Функция добавляет полосу обзора до навигационной отметки point.
+ * Наклонная дальность range и высота над дном altitude задаются в метрах. */
+void           coverage_add_fix        (Coverage                      *coverage,
+                                        const NavPoint                *point,
+                                        gdouble                        range,
+                                        gdouble                        altitude);
+
+/* Функция возвращает площадь покрытия, м^2, и долю перекрытия, %. */
+void           coverage_get_stats      (Coverage                      *coverage,
+                                        gdouble                       *area,
+                                        gdouble                       *overlap);
+
+/* Функция рисует карту покрытия. Ячейки, покрытые один раз, выделяются
+ * зелёным цветом, перекрытия - жёлтым, пропуски между полосами - красным. */
+void           coverage_draw           (Coverage                      *coverage,
+                                        cairo_t                       *cairo,
+                                        gint                           width,
+                                        gint                           height);
+
+/* Функция освобождает карту покрытия. */
+void           coverage_free           (Coverage                      *coverage);
+
+#endif /* __COVERAGE_H__ */
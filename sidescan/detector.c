@@ -0,0 +1,372 @@
+#include "detector.h"
+
+#include <hyscan-acoustic-data.h>
+#include <math.h>
+
+#define DETECTOR_GUARD                 4               /* Число защитных отсчётов с каждой стороны. */
+#define DETECTOR_TRAINING              16              /* Число отсчётов оценки фона с каждой стороны. */
+#define DETECTOR_THRESHOLD             5.0             /* Превышение амплитуды над фоном. */
+#define DETECTOR_MIN_BACKGROUND        0.1             /* Минимальный фон относительно средней амплитуды строки. */
+#define DETECTOR_MERGE_GAP             2               /* Разрыв в отсчётах, объединяемый в одно превышение. */
+#define DETECTOR_MIN_LINES             3               /* Минимальная протяжённость цели, строки. */
+#define DETECTOR_MAX_LINES             50              /* Максимальная протяжённость цели, строки. */
+#define DETECTOR_MAX_WIDTH             200             /* Максимальный размер цели по дальности, отсчёты. */
+#define DETECTOR_MAX_CLUSTERS          256             /* Максимальное число формируемых целей борта. */
+#define DETECTOR_MAX_BACKLOG           64              /* Максимальное отставание от последней строки при записи. */
+#define DETECTOR_PASS_TIME             50000           /* Время непрерывной обработки строк, мкс. */
+#define DETECTOR_PAUSE                 100000          /* Пауза между проходами, мкс. */
+
+static const HyScanSourceType detector_sources[] = { HYSCAN_SOURCE_SIDE_SCAN_STARBOARD, HYSCAN_SOURCE_SIDE_SCAN_PORT };
+
+/* Формируемая цель - превышения на соседних строках. */
+typedef struct
+{
+  guint32                      first_index;
+  guint32                      last_index;
+  guint32                      count0;
+  guint32                      count1;
+  gdouble                      peak;           /* Максимальное превышение над фоном. */
+} DetectorCluster;
+
+/* Обработка строк борта. */
+typedef struct
+{
+  HyScanAcousticData          *data;
+  guint32                      next_index;     /* Индекс следующей необработанной строки. */
+  gboolean                     started;
+
+  GArray                      *sums;           /* Накопленные суммы амплитуд строки. */
+  GArray                      *clusters;       /* Формируемые цели DetectorCluster. */
+} DetectorBoard;
+
+struct _Detector
+{
+  HyScanDB                    *db;
+  gchar                       *project_name;
+  gchar                       *track_name;
+  gboolean                     raw;
+  gboolean                     live;
+
+  DetectorBoard                boards[G_N_ELEMENTS (detector_sources)];
+
+  GThread                     *thread;
+  gint                         stop;
+
+  GMutex                       lock;
+  GArray                      *targets;        /* Обнаруженные цели, ещё не переданные. */
+  guint64                      n_lines;
+  guint64                      n_skipped;
+};
+
+/* Функция завершает формирование цели. Цели допустимых размеров
+ * добавляются в список обнаруженных. */
+static void
+detector_cluster_finish (Detector        *detector,
+                         guint            board,
+                         DetectorCluster *cluster)
+{
+  DetectorTarget target;
+  guint32 n_lines = cluster->last_index - cluster->first_index + 1;
+
+  if ((n_lines < DETECTOR_MIN_LINES) || (n_lines > DETECTOR_MAX_LINES))
+    return;
+  if (cluster->count1 - cluster->count0 + 1 > DETECTOR_MAX_WIDTH)
+    return;
+
+  target.source = detector_sources[board];
+  target.index = cluster->first_index + n_lines / 2;
+  target.count = (cluster->count0 + cluster->count1) / 2;
+  target.height = n_lines / 2 + 1;
+  target.width = (cluster->count1 - cluster->count0) / 2 + 1;
+  target.snr = 20.0 * log10 (cluster->peak);
+
+  g_mutex_lock (&detector->lock);
+  g_array_append_val (detector->targets, target);
+  g_mutex_unlock (&detector->lock);
+}
+
+/* Функция добавляет превышение строки index в отсчётах от count0 до count1
+ * к формируемой цели, перекрывающейся с ним на предыдущей строке, или
+ * начинает новую цель. */
+static void
+detector_segment_add (DetectorBoard *board,
+                      guint32        index,
+                      guint32        count0,
+                      guint32        count1,
+                      gdouble        peak)
+{
+  DetectorCluster cluster;
+  guint i;
+
+  for (i = 0; i < board->clusters->len; i++)
+    {
+      DetectorCluster *cur = &g_array_index (board->clusters, DetectorCluster, i);
+
+      if ((cur->last_index + 1 < index) || (count1 < cur->count0) || (count0 > cur->count1))
+        continue;
+
+      cur->last_index = index;
+      cur->count0 = MIN (cur->count0, count0);
+      cur->count1 = MAX (cur->count1, count1);
+      cur->peak = MAX (cur->peak, peak);
+
+      return;
+    }
+
+  if (board->clusters->len >= DETECTOR_MAX_CLUSTERS)
+    return;
+
+  cluster.first_index = cluster.last_index = index;
+  cluster.count0 = count0;
+  cluster.count1 = count1;
+  cluster.peak = peak;
+  g_array_append_val (board->clusters, cluster);
+}
+
+/* Функция обрабатывает строку index борта. */
+static void
+detector_process_line (Detector *detector,
+                       guint     n_board,
+                       guint32   index)
+{
+  DetectorBoard *board = &detector->boards[n_board];
+  const gfloat *values;
+  gdouble *sums;
+  gdouble min_background;
+  guint32 n_values;
+  guint32 window = DETECTOR_GUARD + DETECTOR_TRAINING;
+  guint32 start = 0, end = 0;
+  gdouble peak = 0.0;
+  gboolean segment = FALSE;
+  gint64 time;
+  guint32 i;
+
+  values = hyscan_acoustic_data_get_values (board->data, index, &n_values, &time);
+  if ((values == NULL) || (n_values <= 2 * window))
+    return;
+
+  /* Накопленные суммы позволяют получить среднюю амплитуду любого
+   * окна двумя обращениями к памяти. */
+  g_array_set_size (board->sums, n_values + 1);
+  sums = (gdouble *) board->sums->data;
+  sums[0] = 0.0;
+  for (i = 0; i < n_values; i++)
+    sums[i + 1] = sums[i] + values[i];
+
+  min_background = DETECTOR_MIN_BACKGROUND * sums[n_values] / n_values;
+
+  for (i = window; i < n_values - window; i++)
+    {
+      gdouble background;
+
+      background = sums[i - DETECTOR_GUARD] - sums[i - window] +
+                   sums[i + window + 1] - sums[i + DETECTOR_GUARD + 1];
+      background = MAX (background / (2 * DETECTOR_TRAINING), min_background);
+
+      if ((background <= 0.0) || (values[i] <= DETECTOR_THRESHOLD * background))
+        continue;
+
+      if (segment && (i - end > DETECTOR_MERGE_GAP + 1))
+        {
+          detector_segment_add (board, index, start, end, peak);
+          segment = FALSE;
+        }
+
+      if (!segment)
+        {
+          start = i;
+          peak = 0.0;
+          segment = TRUE;
+        }
+
+      end = i;
+      peak = MAX (peak, values[i] / background);
+    }
+
+  if (segment)
+    detector_segment_add (board, index, start, end, peak);
+
+  /* Цели, не продолжившиеся на этой строке, сформированы. */
+  for (i = 0; i < board->clusters->len;)
+    {
+      DetectorCluster *cluster = &g_array_index (board->clusters, DetectorCluster, i);
+
+      if (cluster->last_index == index)
+        {
+          /* Протяжённый объект, например линия дна. */
+          if (cluster->last_index - cluster->first_index >= DETECTOR_MAX_LINES)
+            cluster->first_index = index - DETECTOR_MAX_LINES;
+          i++;
+          continue;
+        }
+
+      detector_cluster_finish (detector, n_board, cluster);
+      g_array_remove_index_fast (board->clusters, i);
+    }
+}
+
+/* Функция обрабатывает новые строки борта не дольше, чем до момента
+ * deadline. Возвращает число обработанных строк. */
+static guint
+detector_process_board (Detector *detector,
+                        guint     n_board,
+                        gint64    deadline)
+{
+  DetectorBoard *board = &detector->boards[n_board];
+  guint32 first_index, last_index;
+  guint n_lines = 0;
+
+  /* Во время записи данные борта могут появиться не сразу. */
+  if (board->data == NULL)
+    {
+      board->data = hyscan_acoustic_data_new (detector->db, detector->project_name, detector->track_name,
+                                              detector_sources[n_board], detector->raw);
+      if (board->data == NULL)
+        return 0;
+    }
+
+  if (!hyscan_acoustic_data_get_range (board->data, &first_index, &last_index))
+    return 0;
+
+  if (!board->started)
+    {
+      board->next_index = detector->live ? last_index : first_index;
+      board->started = TRUE;
+    }
+  if (board->next_index < first_index)
+    board->next_index = first_index;
+
+  /* Ограничение отставания при записи: пропущенные строки прерывают
+   * формируемые цели. */
+  if (detector->live && (board->next_index + DETECTOR_MAX_BACKLOG < last_index))
+    {
+      g_mutex_lock (&detector->lock);
+      detector->n_skipped += last_index - DETECTOR_MAX_BACKLOG - board->next_index;
+      g_mutex_unlock (&detector->lock);
+
+      board->next_index = last_index - DETECTOR_MAX_BACKLOG;
+      g_array_set_size (board->clusters, 0);
+    }
+
+  while ((board->next_index <= last_index) && (g_get_monotonic_time () < deadline))
+    {
+      detector_process_line (detector, n_board, board->next_index);
+      board->next_index += 1;
+      n_lines += 1;
+
+      if (g_atomic_int_get (&detector->stop))
+        break;
+    }
+
+  g_mutex_lock (&detector->lock);
+  detector->n_lines += n_lines;
+  g_mutex_unlock (&detector->lock);
+
+  return n_lines;
+}
+
+/* Поток обработки строк. Строки обрабатываются проходами ограниченной
+ * длительности, время прохода делится между бортами. */
+static gpointer
+detector_thread (Detector *detector)
+{
+  while (!g_atomic_int_get (&detector->stop))
+    {
+      gint64 pass_end = g_get_monotonic_time () + DETECTOR_PASS_TIME;
+      guint n_lines = 0;
+      guint i;
+
+      for (i = 0; i < G_N_ELEMENTS (detector_sources); i++)
+        {
+          gint64 now = g_get_monotonic_time ();
+          gint64 deadline = now + (pass_end - now) / (G_N_ELEMENTS (detector_sources) - i);
+
+          n_lines += detector_process_board (detector, i, deadline);
+        }
+
+      if (n_lines == 0)
+        g_usleep (DETECTOR_PAUSE);
+    }
+
+  return NULL;
+}
+
+Detector *
+detector_new (HyScanDB    *db,
+              const gchar *project_name,
+              const gchar *track_name,
+              gboolean     raw,
+              gboolean     live)
+{
+  Detector *detector;
+  guint i;
+
+  detector = g_new0 (Detector, 1);
+  detector->db = g_object_ref (db);
+  detector->project_name = g_strdup (project_name);
+  detector->track_name = g_strdup (track_name);
+  detector->raw = raw;
+  detector->live = live;
+  detector->targets = g_array_new (FALSE, FALSE, sizeof (DetectorTarget));
+  g_mutex_init (&detector->lock);
+
+  for (i = 0; i < G_N_ELEMENTS (detector_sources); i++)
+    {
+      detector->boards[i].sums = g_array_new (FALSE, FALSE, sizeof (gdouble));
+      detector->boards[i].clusters = g_array_new (FALSE, FALSE, sizeof (DetectorCluster));
+    }
+
+  detector->thread = g_thread_new ("detector", (GThreadFunc) detector_thread, detector);
+
+  return detector;
+}
+
+GArray *
+detector_take_targets (Detector *detector)
+{
+  GArray *targets = NULL;
+
+  g_mutex_lock (&detector->lock);
+  if (detector->targets->len > 0)
+    {
+      targets = detector->targets;
+      detector->targets = g_array_new (FALSE, FALSE, sizeof (DetectorTarget));
+    }
+  g_mutex_unlock (&detector->lock);
+
+  return targets;
+}
+
+void
+detector_get_stats (Detector *detector,
+                    guint64  *n_lines,
+                    guint64  *n_skipped)
+{
+  g_mutex_lock (&detector->lock);
+  *n_lines = detector->n_lines;
+  *n_skipped = detector->n_skipped;
+  g_mutex_unlock (&detector->lock);
+}
+
+void
+detector_free (Detector *detector)
+{
+  guint i;
+
+  g_atomic_int_set (&detector->stop, TRUE);
+  g_thread_join (detector->thread);
+
+  for (i = 0; i < G_N_ELEMENTS (detector_sources); i++)
+    {
+      g_clear_object (&detector->boards[i].data);
+      g_array_unref (detector->boards[i].sums);
+      g_array_unref (detector->boards[i].clusters);
+    }
+
+  g_array_unref (detector->targets);
+  g_mutex_clear (&detector->lock);
+  g_object_unref (detector->db);
+  g_free (detector->project_name);
+  g_free (detector->track_name);
+  g_free (detector);
+}
@@ -0,0 +1,50 @@
+#ifndef __DETECTOR_H__
+#define __DETECTOR_H__
+
+#include <hyscan-db.h>
+
+/* Обнаруженная цель. Границы заданы как у метки водопада: строка
+ * и отсчёт центра цели и половины её размеров. */
+typedef struct
+{
+  HyScanSourceType             source;         /* Борт. */
+  guint32                      index;          /* Строка центра цели. */
+  guint32                      count;          /* Отсчёт центра цели. */
+  guint32                      height;         /* Половина размера вдоль галса, строки. */
+  guint32                      width;          /* Половина размера по дальности, отсчёты. */
+  gdouble                      snr;            /* Превышение над фоном, дБ. */
+} DetectorTarget;
+
+/* Автоматическое обнаружение целей. Каждая новая строка бортов
+ * обрабатывается обнаружителем с постоянным уровнем ложных тревог
+ * (CA-CFAR): амплитуда отсчёта сравнивается со средней амплитудой
+ * окружающих отсчётов, вычисляемой по накопленным суммам за один проход
+ * строки. Превышения, повторяющиеся на соседних строках, объединяются
+ * в цели. Протяжённые объекты, например линия дна, целями не считаются.
+ * Строки обрабатываются в отдельном потоке с ограниченным временем
+ * обработки: при записи галса отставание от последней строки
+ * ограничено, и при перегрузке часть строк пропускается. */
+typedef struct _Detector Detector;
+
+/* Функция создаёт обнаружитель для галса и запускает обработку строк.
+ * Для записываемого галса (live) обработка начинается с последних строк,
+ * иначе - с начала галса. */
+Detector      *detector_new            (HyScanDB                      *db,
+                                        const gchar                   *project_name,
+                                        const gchar                   *track_name,
+                                        gboolean                       raw,
+                                        gboolean                       live);
+
+/* Функция возвращает цели, обнаруженные с момента последнего вызова,
+ * или NULL. Массив DetectorTarget освобождается g_array_unref. */
+GArray        *detector_take_targets   (Detector                      *detector);
+
+/* Функция возвращает число обработанных и пропущенных строк. */
+void           detector_get_stats      (Detector                      *detector,
+                                        guint64                       *n_lines,
+                                        guint64                       *n_skipped);
+
+/* Функция останавливает обработку и освобождает обнаружитель. */
+void           detector_free           (Detector                      *detector);
+
+#endif /* __DETECTOR_H__ */
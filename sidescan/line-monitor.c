@@ -0,0 +1,206 @@
+#include "line-monitor.h"
+
+#include <hyscan-core-types.h>
+#include <string.h>
+
+#define LINE_MONITOR_N_PERIODS         16              /* Число периодов для оценки периода зондирования. */
+#define LINE_MONITOR_GAP_FACTOR        1.5             /* Разрыв, считающийся пропуском строк, в периодах. */
+
+static const HyScanSourceType line_monitor_sources[] = { HYSCAN_SOURCE_SIDE_SCAN_STARBOARD, HYSCAN_SOURCE_SIDE_SCAN_PORT };
+
+/* Канал данных борта. */
+typedef struct
+{
+  gint32                       channel_id;
+  guint32                      next_index;     /* Индекс следующей необработанной строки. */
+  gint64                       prev_time;      /* Время предыдущей строки, мкс. */
+
+  gint64                       periods[LINE_MONITOR_N_PERIODS];
+  guint                        n_periods;
+
+  guint64                      n_lines;
+  guint64                      n_dropped;
+} LineMonitorChannel;
+
+struct _LineMonitor
+{
+  HyScanDB                    *db;
+  gint32                       project_id;
+  gint32                       track_id;
+
+  LineMonitorChannel           channels[G_N_ELEMENTS (line_monitor_sources)];
+};
+
+/* Функция оценивает период зондирования как медиану последних периодов. */
+static gint64
+line_monitor_period (LineMonitorChannel *channel)
+{
+  gint64 periods[LINE_MONITOR_N_PERIODS];
+  guint n = MIN (channel->n_periods, LINE_MONITOR_N_PERIODS);
+  guint i, j;
+
+  memcpy (periods, channel->periods, n * sizeof (gint64));
+
+  for (i = 1; i < n; i++)
+    {
+      gint64 period = periods[i];
+
+      for (j = i; (j > 0) && (periods[j - 1] > period); j--)
+        periods[j] = periods[j - 1];
+      periods[j] = period;
+    }
+
+  return periods[n / 2];
+}
+
+/* Функция учитывает строку с временем time. */
+static void
+line_monitor_add_line (LineMonitorChannel *channel,
+                       gint64              time)
+{
+  gint64 interval;
+
+  channel->n_lines += 1;
+
+  if (channel->n_lines == 1)
+    {
+      channel->prev_time = time;
+      return;
+    }
+
+  interval = time - channel->prev_time;
+  channel->prev_time = time;
+  if (interval <= 0)
+    return;
+
+  /* Пропуск определяется только после накопления статистики периода.
+   * Сам разрыв в статистику не попадает, чтобы серия пропусков
+   * не изменяла оценку периода. */
+  if (channel->n_periods >= LINE_MONITOR_N_PERIODS)
+    {
+      gint64 period = line_monitor_period (channel);
+
+      if (interval > LINE_MONITOR_GAP_FACTOR * period)
+        {
+          channel->n_dropped += (interval + period / 2) / period - 1;
+          return;
+        }
+    }
+
+  channel->periods[channel->n_periods % LINE_MONITOR_N_PERIODS] = interval;
+  channel->n_periods += 1;
+}
+
+LineMonitor *
+line_monitor_new (HyScanDB    *db,
+                  const gchar *project_name,
+                  const gchar *track_name)
+{
+  LineMonitor *monitor;
+  guint i;
+
+  monitor = g_new0 (LineMonitor, 1);
+  monitor->db = g_object_ref (db);
+  monitor->track_id = -1;
+
+  for (i = 0; i < G_N_ELEMENTS (monitor->channels); i++)
+    monitor->channels[i].channel_id = -1;
+
+  monitor->project_id = hyscan_db_project_open (db, project_name);
+  if (monitor->project_id >= 0)
+    monitor->track_id = hyscan_db_track_open (db, monitor->project_id, track_name);
+
+  return monitor;
+}
+
+guint
+line_monitor_update (LineMonitor *monitor)
+{
+  guint n_lines = 0;
+  guint i;
+
+  if (monitor->track_id < 0)
+    return 0;
+
+  for (i = 0; i < G_N_ELEMENTS (monitor->channels); i++)
+    {
+      LineMonitorChannel *channel = &monitor->channels[i];
+      guint32 first_index;
+      guint32 last_index;
+      guint32 j;
+
+      /* Во время записи каналы данных появляются после первой строки. */
+      if (channel->channel_id < 0)
+        {
+          const gchar *channel_name;
+
+          channel_name = hyscan_channel_get_name_by_types (line_monitor_sources[i], TRUE, 1);
+          channel->channel_id = hyscan_db_channel_open (monitor->db, monitor->track_id, channel_name);
+          if (channel->channel_id < 0)
+            continue;
+        }
+
+      if (!hyscan_db_channel_get_data_range (monitor->db, channel->channel_id, &first_index, &last_index))
+        continue;
+
+      /* Строки, удалённые из начала канала до обработки, пропуском не считаются. */
+      if (channel->next_index < first_index)
+        channel->next_index = first_index;
+
+      /* Считываются только метки времени, без данных строк. */
+      for (j = channel->next_index; j <= last_index; j++)
+        {
+          guint32 size = 0;
+          gint64 time;
+
+          if (!hyscan_db_channel_get_data (monitor->db, channel->channel_id, j, NULL, &size, &time))
+            continue;
+
+          line_monitor_add_line (channel, time);
+          n_lines += 1;
+        }
+
+      channel->next_index = last_index + 1;
+    }
+
+  return n_lines;
+}
+
+void
+line_monitor_get_stats (LineMonitor *monitor,
+                        guint64     *n_lines,
+                        guint64     *n_dropped)
+{
+  guint64 lines = 0;
+  guint64 dropped = 0;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (monitor->channels); i++)
+    {
+      lines += monitor->channels[i].n_lines;
+      dropped += monitor->channels[i].n_dropped;
+    }
+
+  if (n_lines != NULL)
+    *n_lines = lines;
+  if (n_dropped != NULL)
+    *n_dropped = dropped;
+}
+
+void
+line_monitor_free (LineMonitor *monitor)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (monitor->channels); i++)
+    if (monitor->channels[i].channel_id >= 0)
+      hyscan_db_close (monitor->db, monitor->channels[i].channel_id);
+
+  if (monitor->track_id >= 0)
+    hyscan_db_close (monitor->db, monitor->track_id);
+  if (monitor->project_id >= 0)
+    hyscan_db_close (monitor->db, monitor->project_id);
+
+  g_object_unref (monitor->db);
+  g_free (monitor);
+}
@@ -0,0 +1,29 @@
+#ifndef __LINE_MONITOR_H__
+#define __LINE_MONITOR_H__
+
+#include <hyscan-db.h>
+
+/* Контроль записи строк гидролокатора. По меткам времени строк,
+ * записанных в каналы бортов, определяется типичный период зондирования
+ * и число строк, пропущенных при приёме или записи данных. Метки времени
+ * считываются только для строк, добавленных с момента последней проверки. */
+typedef struct _LineMonitor LineMonitor;
+
+/* Функция создаёт контроль записи строк галса. */
+LineMonitor   *line_monitor_new        (HyScanDB                      *db,
+                                        const gchar                   *project_name,
+                                        const gchar                   *track_name);
+
+/* Функция обрабатывает строки, записанные с момента последнего вызова.
+ * Возвращает число новых строк. */
+guint          line_monitor_update     (LineMonitor                   *monitor);
+
+/* Функция возвращает число записанных и пропущенных строк всех бортов. */
+void           line_monitor_get_stats  (LineMonitor                   *monitor,
+                                        guint64                       *n_lines,
+                                        guint64                       *n_dropped);
+
+/* Функция освобождает контроль записи строк. */
+void           line_monitor_free       (LineMonitor                   *monitor);
+
+#endif /* __LINE_MONITOR_H__ */
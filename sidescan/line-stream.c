@@ -0,0 +1,909 @@
+#include "line-stream.h"
+
+#include <hyscan-acoustic-data.h>
+#include <hyscan-data-writer.h>
+#include <gio/gio.h>
+#include <string.h>
+
+#define LINE_STREAM_MAGIC              0x53534C53      /* Сигнатура протокола "SSLS". */
+#define LINE_STREAM_VERSION            2               /* Версия протокола. */
+#define LINE_STREAM_MAX_CLIENTS        16              /* Максимальное число клиентов. */
+#define LINE_STREAM_BATCH              32              /* Максимальное число строк в сообщении. */
+#define LINE_STREAM_PERIOD             100000          /* Период проверки новых строк, мкс. */
+#define LINE_STREAM_KEEPALIVE          1000000         /* Период сообщений при отсутствии новых строк, мкс. */
+#define LINE_STREAM_TIMEOUT            10              /* Время ожидания приёма и передачи, с. */
+#define LINE_STREAM_RECONNECT          2000000         /* Период повторного подключения клиента, мкс. */
+#define LINE_STREAM_MAX_NAME           1024            /* Максимальная длина названия галса. */
+#define LINE_STREAM_MAX_VALUES         (1024 * 1024)   /* Максимальное число отсчётов в строке. */
+
+/* Сообщения сервера. */
+enum
+{
+  LINE_STREAM_IDLE,                            /* Новых строк нет. */
+  LINE_STREAM_TRACK,                           /* Начало передачи галса: название. */
+  LINE_STREAM_LINES                            /* Строки борта: параметры данных и отсчёты. */
+};
+
+/* Способ упаковки отсчётов строк. */
+enum
+{
+  LINE_STREAM_STORED,                          /* Без сжатия. */
+  LINE_STREAM_DELTA_DEFLATE                    /* Разностное кодирование и сжатие deflate. */
+};
+
+static const HyScanSourceType line_stream_sources[] = { HYSCAN_SOURCE_SIDE_SCAN_STARBOARD, HYSCAN_SOURCE_SIDE_SCAN_PORT };
+
+#define LINE_STREAM_N_BOARDS           G_N_ELEMENTS (line_stream_sources)
+
+/* Строка в сообщении. */
+typedef struct
+{
+  gint64                       time;
+  guint32                      n_values;
+} LineStreamLine;
+
+/* Буферы упаковки строк. */
+typedef struct
+{
+  GConverter                  *converter;
+  GArray                      *lines;          /* Строки сообщения LineStreamLine. */
+  GArray                      *values;         /* Отсчёты строк guint16. */
+  GByteArray                  *packed;
+} LineStreamCodec;
+
+/* Состояние сервера, общее для обработчиков подключений. Обработчик
+ * подключения, ожидающего в очереди пула потоков, может начать работу
+ * после освобождения сервера, поэтому ссылку на состояние держит
+ * обработчик сигнала "run" до уничтожения службы. */
+typedef struct
+{
+  gint                         ref_count;
+  HyScanDB                    *db;
+  GCancellable                *cancellable;
+
+  GMutex                       lock;
+  gchar                       *project_name;
+  gchar                       *track_name;
+  gboolean                     raw;
+  guint                        generation;     /* Номер изменения галса. */
+
+  gint                         n_clients;
+} LineServerState;
+
+struct _LineServer
+{
+  GSocketService              *service;
+  LineServerState             *state;
+};
+
+struct _LineClient
+{
+  HyScanDataWriter            *writer;
+  gchar                       *address;
+  GCancellable                *cancellable;
+  GThread                     *thread;
+
+  gchar                       *track_name;     /* Принимаемый галс. */
+  guint32                      next_index[LINE_STREAM_N_BOARDS];
+
+  GMutex                       lock;
+  guint64                      n_lines;
+  guint64                      n_bytes;
+};
+
+static void
+line_stream_codec_init (LineStreamCodec *codec,
+                        gboolean         compress)
+{
+  if (compress)
+    codec->converter = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW, 1));
+  else
+    codec->converter = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW));
+
+  codec->lines = g_array_new (FALSE, FALSE, sizeof (LineStreamLine));
+  codec->values = g_array_new (FALSE, FALSE, sizeof (guint16));
+  codec->packed = g_byte_array_new ();
+}
+
+static void
+line_stream_codec_clear (LineStreamCodec *codec)
+{
+  g_object_unref (codec->converter);
+  g_array_unref (codec->lines);
+  g_array_unref (codec->values);
+  g_byte_array_unref (codec->packed);
+}
+
+/* Функция сжимает или распаковывает блок целиком. Возвращает размер
+ * результата или 0, если результат не поместился в буфер. */
+static gsize
+line_stream_convert (GConverter   *converter,
+                     const guchar *input,
+                     gsize         input_size,
+                     guchar       *output,
+                     gsize         output_size)
+{
+  GConverterResult result = G_CONVERTER_CONVERTED;
+  gsize total_read = 0;
+  gsize total_written = 0;
+
+  g_converter_reset (converter);
+
+  while (result != G_CONVERTER_FINISHED)
+    {
+      gsize bytes_read, bytes_written;
+
+      if (total_written == output_size)
+        return 0;
+
+      result = g_converter_convert (converter,
+                                    input + total_read, input_size - total_read,
+                                    output + total_written, output_size - total_written,
+                                    G_CONVERTER_INPUT_AT_END,
+                                    &bytes_read, &bytes_written, NULL);
+      if ((result == G_CONVERTER_ERROR) || ((bytes_read == 0) && (bytes_written == 0)))
+        return 0;
+
+      total_read += bytes_read;
+      total_written += bytes_written;
+    }
+
+  return total_written;
+}
+
+/* Функция записывает строку с длиной. */
+static gboolean
+line_stream_put_string (GDataOutputStream *output,
+                        const gchar       *value,
+                        GCancellable      *cancellable,
+                        GError           **error)
+{
+  guint32 length = (value != NULL) ? strlen (value) : 0;
+
+  if (!g_data_output_stream_put_uint32 (output, length, cancellable, error))
+    return FALSE;
+
+  return g_output_stream_write_all (G_OUTPUT_STREAM (output), value, length, NULL, cancellable, error);
+}
+
+/* Функции чтения чисел. Если предыдущее чтение завершилось ошибкой,
+ * чтение не выполняется и возвращается 0, поэтому ошибку можно проверять
+ * один раз после чтения нескольких полей сообщения. */
+static guint32
+line_stream_read_uint32 (GDataInputStream *input,
+                         GCancellable     *cancellable,
+                         GError          **error)
+{
+  if (*error != NULL)
+    return 0;
+
+  return g_data_input_stream_read_uint32 (input, cancellable, error);
+}
+
+static gint64
+line_stream_read_int64 (GDataInputStream *input,
+                        GCancellable     *cancellable,
+                        GError          **error)
+{
+  if (*error != NULL)
+    return 0;
+
+  return g_data_input_stream_read_int64 (input, cancellable, error);
+}
+
+/* Функция читает строку с длиной. */
+static gchar *
+line_stream_get_string (GDataInputStream *input,
+                        GCancellable     *cancellable,
+                        GError          **error)
+{
+  guint32 length;
+  gchar *value;
+  gsize read_size;
+
+  length = line_stream_read_uint32 (input, cancellable, error);
+  if (*error != NULL)
+    return NULL;
+
+  if (length > LINE_STREAM_MAX_NAME)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "invalid string length");
+      return NULL;
+    }
+
+  value = g_malloc (length + 1);
+  if (!g_input_stream_read_all (G_INPUT_STREAM (input), value, length, &read_size, cancellable, error) ||
+      (read_size != length))
+    {
+      g_free (value);
+      return NULL;
+    }
+  value[length] = '\0';
+
+  return value;
+}
+
+/* Функция передаёт строки борта от first_index до last_index. */
+static gboolean
+line_server_send_lines (LineStreamCodec    *codec,
+                        GDataOutputStream  *output,
+                        HyScanAcousticData *data,
+                        HyScanSourceType    source,
+                        guint32             first_index,
+                        guint32             last_index,
+                        GCancellable       *cancellable,
+                        GError            **error)
+{
+  HyScanAcousticDataInfo info;
+  guint16 *values;
+  gsize raw_size;
+  gsize packed_size;
+  guint32 method;
+  guint32 index;
+  guint i;
+
+  g_array_set_size (codec->lines, 0);
+  g_array_set_size (codec->values, 0);
+
+  /* Амплитуды от 0 до 1 квантуются до 16 бит и заменяются разностями
+   * соседних отсчётов строки, которые deflate сжимает лучше. */
+  for (index = first_index; index <= last_index; index++)
+    {
+      LineStreamLine line;
+      const gfloat *amplitudes;
+      guint32 n_values;
+      guint16 prev = 0;
+      guint j;
+
+      amplitudes = hyscan_acoustic_data_get_values (data, index, &n_values, &line.time);
+      if (amplitudes == NULL)
+        n_values = 0;
+
+      line.n_values = MIN (n_values, LINE_STREAM_MAX_VALUES);
+      g_array_append_val (codec->lines, line);
+
+      g_array_set_size (codec->values, codec->values->len + line.n_values);
+      values = &g_array_index (codec->values, guint16, codec->values->len - line.n_values);
+      for (j = 0; j < line.n_values; j++)
+        {
+          guint16 value = CLAMP (amplitudes[j], 0.0f, 1.0f) * G_MAXUINT16 + 0.5f;
+
+          values[j] = GUINT16_TO_LE ((guint16) (value - prev));
+          prev = value;
+        }
+    }
+
+  raw_size = codec->values->len * sizeof (guint16);
+  g_byte_array_set_size (codec->packed, raw_size + raw_size / 8 + 64);
+  packed_size = line_stream_convert (codec->converter, (guchar *) codec->values->data, raw_size,
+                                     codec->packed->data, codec->packed->len);
+
+  method = LINE_STREAM_DELTA_DEFLATE;
+  if ((packed_size == 0) || (packed_size >= raw_size))
+    {
+      method = LINE_STREAM_STORED;
+      packed_size = raw_size;
+      memcpy (codec->packed->data, codec->values->data, raw_size);
+    }
+
+  /* Параметры данных (частота дискретизации, параметры сигнала, антенны
+   * и АЦП) передаются структурой целиком, поэтому сервер и клиент должны
+   * быть собраны с одной версией библиотек HyScan. */
+  info = hyscan_acoustic_data_get_info (data);
+  if (!g_data_output_stream_put_uint32 (output, LINE_STREAM_LINES, cancellable, error) ||
+      !g_data_output_stream_put_uint32 (output, source, cancellable, error) ||
+      !g_data_output_stream_put_uint32 (output, sizeof (info), cancellable, error) ||
+      !g_output_stream_write_all (G_OUTPUT_STREAM (output), &info, sizeof (info), NULL, cancellable, error) ||
+      !g_data_output_stream_put_uint32 (output, first_index, cancellable, error) ||
+      !g_data_output_stream_put_uint32 (output, codec->lines->len, cancellable, error))
+    {
+      return FALSE;
+    }
+
+  for (i = 0; i < codec->lines->len; i++)
+    {
+      LineStreamLine *line = &g_array_index (codec->lines, LineStreamLine, i);
+
+      if (!g_data_output_stream_put_int64 (output, line->time, cancellable, error) ||
+          !g_data_output_stream_put_uint32 (output, line->n_values, cancellable, error))
+        {
+          return FALSE;
+        }
+    }
+
+  if (!g_data_output_stream_put_uint32 (output, method, cancellable, error) ||
+      !g_data_output_stream_put_uint32 (output, packed_size, cancellable, error))
+    {
+      return FALSE;
+    }
+
+  return g_output_stream_write_all (G_OUTPUT_STREAM (output), codec->packed->data, packed_size,
+                                    NULL, cancellable, error);
+}
+
+static LineServerState *
+line_server_state_ref (LineServerState *state)
+{
+  g_atomic_int_inc (&state->ref_count);
+
+  return state;
+}
+
+static void
+line_server_state_unref (LineServerState *state)
+{
+  if (!g_atomic_int_dec_and_test (&state->ref_count))
+    return;
+
+  g_object_unref (state->cancellable);
+  g_object_unref (state->db);
+  g_mutex_clear (&state->lock);
+  g_free (state->project_name);
+  g_free (state->track_name);
+  g_free (state);
+}
+
+/* Функция освобождения ссылки обработчика сигнала "run". */
+static void
+line_server_state_notify (gpointer  data,
+                          GClosure *closure)
+{
+  line_server_state_unref (data);
+}
+
+/* Обработчик подключения клиента, выполняется в отдельном потоке.
+ * Клиент сообщает галс и строки, которые он уже принял, после чего
+ * сервер передаёт ему новые строки текущего галса. */
+static gboolean
+line_server_run (GThreadedSocketService *service,
+                 GSocketConnection      *connection,
+                 GObject                *source_object,
+                 LineServerState        *state)
+{
+  HyScanAcousticData *data[LINE_STREAM_N_BOARDS] = { NULL };
+  guint32 next_index[LINE_STREAM_N_BOARDS] = { 0 };
+  GDataInputStream *input;
+  GDataOutputStream *output;
+  LineStreamCodec codec;
+  GError *error = NULL;
+  gchar *client_track = NULL;
+  gchar *project_name = NULL;
+  gchar *track_name = NULL;
+  gboolean raw = FALSE;
+  gboolean send_track = FALSE;
+  guint generation = 0;
+  gint64 last_send;
+  guint i;
+
+  g_atomic_int_inc (&state->n_clients);
+  g_socket_set_timeout (g_socket_connection_get_socket (connection), LINE_STREAM_TIMEOUT);
+
+  input = g_data_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM (connection)));
+  output = g_data_output_stream_new (g_io_stream_get_output_stream (G_IO_STREAM (connection)));
+  line_stream_codec_init (&codec, TRUE);
+
+  /* Приветствие клиента. */
+  if ((line_stream_read_uint32 (input, state->cancellable, &error) != LINE_STREAM_MAGIC) ||
+      (line_stream_read_uint32 (input, state->cancellable, &error) != LINE_STREAM_VERSION))
+    {
+      goto exit;
+    }
+
+  client_track = line_stream_get_string (input, state->cancellable, &error);
+  if (client_track == NULL)
+    goto exit;
+
+  for (i = 0; i < LINE_STREAM_N_BOARDS; i++)
+    next_index[i] = line_stream_read_uint32 (input, state->cancellable, &error);
+  if (error != NULL)
+    goto exit;
+
+  last_send = g_get_monotonic_time ();
+  while (!g_cancellable_is_cancelled (state->cancellable))
+    {
+      guint n_lines = 0;
+
+      /* Смена текущего галса. Если клиент уже принимал этот галс,
+       * передача продолжается с первой непринятой строки. */
+      g_mutex_lock (&state->lock);
+      if (state->generation != generation)
+        {
+          generation = state->generation;
+          g_free (project_name);
+          g_free (track_name);
+          project_name = g_strdup (state->project_name);
+          track_name = g_strdup (state->track_name);
+          raw = state->raw;
+
+          for (i = 0; i < LINE_STREAM_N_BOARDS; i++)
+            {
+              g_clear_object (&data[i]);
+              if (g_strcmp0 (track_name, client_track) != 0)
+                next_index[i] = 0;
+            }
+
+          send_track = (track_name != NULL);
+        }
+      g_mutex_unlock (&state->lock);
+
+      /* Число принятых строк относится только к галсу, передаваемому
+       * в момент подключения. */
+      g_clear_pointer (&client_track, g_free);
+
+      if (send_track)
+        {
+          if (!g_data_output_stream_put_uint32 (output, LINE_STREAM_TRACK, state->cancellable, &error) ||
+              !line_stream_put_string (output, track_name, state->cancellable, &error))
+            {
+              goto exit;
+            }
+          send_track = FALSE;
+        }
+
+      for (i = 0; (track_name != NULL) && (i < LINE_STREAM_N_BOARDS); i++)
+        {
+          guint32 first_index, last_index;
+
+          /* Во время записи данные борта могут появиться не сразу. */
+          if (data[i] == NULL)
+            {
+              data[i] = hyscan_acoustic_data_new (state->db, project_name, track_name,
+                                                  line_stream_sources[i], raw);
+              if (data[i] == NULL)
+                continue;
+            }
+
+          if (!hyscan_acoustic_data_get_range (data[i], &first_index, &last_index))
+            continue;
+
+          next_index[i] = MAX (next_index[i], first_index);
+          if (next_index[i] > last_index)
+            continue;
+
+          last_index = MIN (last_index, next_index[i] + LINE_STREAM_BATCH - 1);
+          if (!line_server_send_lines (&codec, output, data[i], line_stream_sources[i],
+                                       next_index[i], last_index, state->cancellable, &error))
+            {
+              goto exit;
+            }
+
+          n_lines += last_index - next_index[i] + 1;
+          next_index[i] = last_index + 1;
+        }
+
+      if (n_lines > 0)
+        {
+          last_send = g_get_monotonic_time ();
+          continue;
+        }
+
+      /* Сообщение без данных позволяет клиенту обнаружить разрыв соединения. */
+      if (g_get_monotonic_time () - last_send > LINE_STREAM_KEEPALIVE)
+        {
+          if (!g_data_output_stream_put_uint32 (output, LINE_STREAM_IDLE, state->cancellable, &error))
+            goto exit;
+          last_send = g_get_monotonic_time ();
+        }
+
+      g_usleep (LINE_STREAM_PERIOD);
+    }
+
+exit:
+  if ((error != NULL) && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    g_message ("line server: %s", error->message);
+
+  g_clear_error (&error);
+  for (i = 0; i < LINE_STREAM_N_BOARDS; i++)
+    g_clear_object (&data[i]);
+  line_stream_codec_clear (&codec);
+  g_object_unref (input);
+  g_object_unref (output);
+  g_free (client_track);
+  g_free (project_name);
+  g_free (track_name);
+
+  g_atomic_int_dec_and_test (&state->n_clients);
+
+  return TRUE;
+}
+
+LineServer *
+line_server_new (HyScanDB *db,
+                 guint16   port)
+{
+  LineServer *server;
+  GError *error = NULL;
+
+  server = g_new0 (LineServer, 1);
+  server->state = g_new0 (LineServerState, 1);
+  server->state->ref_count = 1;
+  server->state->db = g_object_ref (db);
+  server->state->cancellable = g_cancellable_new ();
+  g_mutex_init (&server->state->lock);
+
+  server->service = g_threaded_socket_service_new (LINE_STREAM_MAX_CLIENTS);
+  if (!g_socket_listener_add_inet_port (G_SOCKET_LISTENER (server->service), port, NULL, &error))
+    {
+      g_message ("can't start line server on port %u: %s", port, error->message);
+      g_error_free (error);
+      line_server_free (server);
+      return NULL;
+    }
+
+  g_signal_connect_data (server->service, "run", G_CALLBACK (line_server_run),
+                         line_server_state_ref (server->state),
+                         line_server_state_notify, 0);
+  g_socket_service_start (server->service);
+
+  return server;
+}
+
+void
+line_server_set_track (LineServer  *server,
+                       const gchar *project_name,
+                       const gchar *track_name,
+                       gboolean     raw)
+{
+  LineServerState *state = server->state;
+
+  g_mutex_lock (&state->lock);
+
+  if ((g_strcmp0 (state->project_name, project_name) != 0) ||
+      (g_strcmp0 (state->track_name, track_name) != 0) || (state->raw != raw))
+    {
+      g_free (state->project_name);
+      g_free (state->track_name);
+      state->project_name = g_strdup (project_name);
+      state->track_name = g_strdup (track_name);
+      state->raw = raw;
+      state->generation += 1;
+    }
+
+  g_mutex_unlock (&state->lock);
+}
+
+guint
+line_server_get_n_clients (LineServer *server)
+{
+  return g_atomic_int_get (&server->state->n_clients);
+}
+
+void
+line_server_free (LineServer *server)
+{
+  /* Завершаем обработку подключений и дожидаемся окончания начавшихся.
+   * Подключения из очереди пула потоков завершаются сразу после запуска,
+   * так как операция отменена, а состояние остаётся доступным им до
+   * уничтожения службы. */
+  g_cancellable_cancel (server->state->cancellable);
+  g_socket_service_stop (server->service);
+  g_socket_listener_close (G_SOCKET_LISTENER (server->service));
+  while (g_atomic_int_get (&server->state->n_clients) > 0)
+    g_usleep (LINE_STREAM_PERIOD);
+
+  g_object_unref (server->service);
+  line_server_state_unref (server->state);
+  g_free (server);
+}
+
+/* Функция принимает строки борта и записывает их в галс. */
+static gboolean
+line_client_receive_lines (LineClient       *client,
+                           LineStreamCodec  *codec,
+                           GDataInputStream *input,
+                           GError          **error)
+{
+  HyScanAcousticDataInfo info;
+  GArray *amplitudes;
+  HyScanSourceType source;
+  guint32 first_index;
+  guint32 n_lines;
+  guint32 method;
+  guint32 packed_size;
+  gsize read_size;
+  gsize raw_size;
+  guint32 info_size;
+  guint16 *values;
+  guint board;
+  guint i;
+
+  memset (&info, 0, sizeof (info));
+
+  source = line_stream_read_uint32 (input, client->cancellable, error);
+  info_size = line_stream_read_uint32 (input, client->cancellable, error);
+  if (*error != NULL)
+    return FALSE;
+
+  if (info_size != sizeof (info))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "incompatible data info");
+      return FALSE;
+    }
+
+  if (!g_input_stream_read_all (G_INPUT_STREAM (input), &info, sizeof (info),
+                                &read_size, client->cancellable, error) ||
+      (read_size != sizeof (info)))
+    {
+      if (*error == NULL)
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "truncated data info");
+      return FALSE;
+    }
+
+  first_index = line_stream_read_uint32 (input, client->cancellable, error);
+  n_lines = line_stream_read_uint32 (input, client->cancellable, error);
+  if (*error != NULL)
+    return FALSE;
+
+  if (n_lines > LINE_STREAM_BATCH)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "invalid number of lines");
+      return FALSE;
+    }
+
+  g_array_set_size (codec->lines, n_lines);
+  raw_size = 0;
+  for (i = 0; i < n_lines; i++)
+    {
+      LineStreamLine *line = &g_array_index (codec->lines, LineStreamLine, i);
+
+      line->time = line_stream_read_int64 (input, client->cancellable, error);
+      line->n_values = line_stream_read_uint32 (input, client->cancellable, error);
+      if ((*error == NULL) && (line->n_values > LINE_STREAM_MAX_VALUES))
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "invalid number of values");
+      if (*error != NULL)
+        return FALSE;
+
+      raw_size += line->n_values * sizeof (guint16);
+    }
+
+  method = line_stream_read_uint32 (input, client->cancellable, error);
+  packed_size = line_stream_read_uint32 (input, client->cancellable, error);
+  if (*error != NULL)
+    return FALSE;
+
+  if (packed_size > raw_size + raw_size / 8 + 64)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "invalid packed size");
+      return FALSE;
+    }
+
+  g_byte_array_set_size (codec->packed, packed_size);
+  if (!g_input_stream_read_all (G_INPUT_STREAM (input), codec->packed->data, packed_size,
+                                &read_size, client->cancellable, error) ||
+      (read_size != packed_size))
+    {
+      if (*error == NULL)
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "truncated lines");
+      return FALSE;
+    }
+
+  g_array_set_size (codec->values, raw_size / sizeof (guint16));
+  if (method == LINE_STREAM_STORED)
+    {
+      if (packed_size != raw_size)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "invalid stored size");
+          return FALSE;
+        }
+      memcpy (codec->values->data, codec->packed->data, raw_size);
+    }
+  else if ((raw_size > 0) &&
+           (line_stream_convert (codec->converter, codec->packed->data, packed_size,
+                                 (guchar *) codec->values->data, raw_size) != raw_size))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "can't unpack lines");
+      return FALSE;
+    }
+
+  for (board = 0; board < LINE_STREAM_N_BOARDS; board++)
+    if (line_stream_sources[board] == source)
+      break;
+
+  /* Строки неизвестного борта или повторно переданные строки пропускаются. */
+  if ((board == LINE_STREAM_N_BOARDS) || (client->track_name == NULL))
+    return TRUE;
+
+  /* Передаются амплитуды, а не исходные данные гидролокатора. */
+  info.data_type = HYSCAN_DATA_FLOAT;
+  amplitudes = g_array_new (FALSE, FALSE, sizeof (gfloat));
+  values = (guint16 *) codec->values->data;
+
+  for (i = 0; i < n_lines; i++)
+    {
+      LineStreamLine *line = &g_array_index (codec->lines, LineStreamLine, i);
+      HyScanDataWriterData data;
+      guint16 value = 0;
+      guint j;
+
+      g_array_set_size (amplitudes, line->n_values);
+      for (j = 0; j < line->n_values; j++)
+        {
+          value += GUINT16_FROM_LE (values[j]);
+          g_array_index (amplitudes, gfloat, j) = value / (gfloat) G_MAXUINT16;
+        }
+      values += line->n_values;
+
+      if (first_index + i < client->next_index[board])
+        continue;
+
+      data.time = line->time;
+      data.size = line->n_values * sizeof (gfloat);
+      data.data = amplitudes->data;
+      hyscan_data_writer_acoustic_add_data (client->writer, source, &info, &data);
+
+      client->next_index[board] = first_index + i + 1;
+    }
+
+  g_array_unref (amplitudes);
+
+  g_mutex_lock (&client->lock);
+  client->n_lines += n_lines;
+  client->n_bytes += packed_size;
+  g_mutex_unlock (&client->lock);
+
+  return TRUE;
+}
+
+/* Функция принимает сообщения сервера до разрыва соединения. */
+static void
+line_client_receive (LineClient        *client,
+                     GSocketConnection *connection)
+{
+  GDataInputStream *input;
+  GDataOutputStream *output;
+  LineStreamCodec codec;
+  GError *error = NULL;
+  guint i;
+
+  g_socket_set_timeout (g_socket_connection_get_socket (connection), LINE_STREAM_TIMEOUT);
+
+  input = g_data_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM (connection)));
+  output = g_data_output_stream_new (g_io_stream_get_output_stream (G_IO_STREAM (connection)));
+  line_stream_codec_init (&codec, FALSE);
+
+  /* Приветствие: принимаемый галс и число принятых строк бортов. */
+  if (!g_data_output_stream_put_uint32 (output, LINE_STREAM_MAGIC, client->cancellable, &error) ||
+      !g_data_output_stream_put_uint32 (output, LINE_STREAM_VERSION, client->cancellable, &error) ||
+      !line_stream_put_string (output, client->track_name, client->cancellable, &error))
+    {
+      goto exit;
+    }
+
+  for (i = 0; i < LINE_STREAM_N_BOARDS; i++)
+    if (!g_data_output_stream_put_uint32 (output, client->next_index[i], client->cancellable, &error))
+      goto exit;
+
+  while (error == NULL)
+    {
+      guint32 message = line_stream_read_uint32 (input, client->cancellable, &error);
+
+      if (error != NULL)
+        break;
+
+      if (message == LINE_STREAM_TRACK)
+        {
+          gchar *track_name = line_stream_get_string (input, client->cancellable, &error);
+
+          if (track_name == NULL)
+            break;
+
+          /* Новый галс. Продолжение передачи после повторного
+           * подключения дописывает уже открытый галс. */
+          if (g_strcmp0 (track_name, client->track_name) != 0)
+            {
+              g_clear_pointer (&client->track_name, g_free);
+              memset (client->next_index, 0, sizeof (client->next_index));
+
+              if (hyscan_data_writer_start (client->writer, track_name, HYSCAN_TRACK_SURVEY))
+                client->track_name = g_strdup (track_name);
+              else
+                g_message ("line client: can't create track '%s'", track_name);
+            }
+
+          g_free (track_name);
+        }
+      else if (message == LINE_STREAM_LINES)
+        {
+          line_client_receive_lines (client, &codec, input, &error);
+        }
+      else if (message != LINE_STREAM_IDLE)
+        {
+          g_set_error (&error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "unknown message %u", message);
+        }
+    }
+
+exit:
+  if ((error != NULL) && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    g_message ("line client: %s", error->message);
+
+  g_clear_error (&error);
+  line_stream_codec_clear (&codec);
+  g_object_unref (input);
+  g_object_unref (output);
+}
+
+/* Поток клиента. */
+static gpointer
+line_client_thread (LineClient *client)
+{
+  GSocketClient *socket_client = g_socket_client_new ();
+
+  while (!g_cancellable_is_cancelled (client->cancellable))
+    {
+      GSocketConnection *connection;
+      gint64 wait;
+
+      connection = g_socket_client_connect_to_host (socket_client, client->address, LINE_STREAM_DEFAULT_PORT,
+                                                    client->cancellable, NULL);
+      if (connection != NULL)
+        {
+          line_client_receive (client, connection);
+          g_object_unref (connection);
+        }
+
+      for (wait = 0; (wait < LINE_STREAM_RECONNECT) && !g_cancellable_is_cancelled (client->cancellable);
+           wait += LINE_STREAM_PERIOD)
+        {
+          g_usleep (LINE_STREAM_PERIOD);
+        }
+    }
+
+  g_object_unref (socket_client);
+
+  return NULL;
+}
+
+LineClient *
+line_client_new (HyScanDB    *db,
+                 const gchar *project_name,
+                 const gchar *address)
+{
+  LineClient *client;
+
+  client = g_new0 (LineClient, 1);
+  client->writer = hyscan_data_writer_new ();
+  client->address = g_strdup (address);
+  client->cancellable = g_cancellable_new ();
+  g_mutex_init (&client->lock);
+
+  hyscan_data_writer_set_db (client->writer, db);
+  if (!hyscan_data_writer_set_project (client->writer, project_name))
+    {
+      g_message ("line client: can't set project '%s'", project_name);
+      line_client_free (client);
+      return NULL;
+    }
+
+  client->thread = g_thread_new ("line-client", (GThreadFunc) line_client_thread, client);
+
+  return client;
+}
+
+void
+line_client_get_stats (LineClient *client,
+                       guint64    *n_lines,
+                       guint64    *n_bytes)
+{
+  g_mutex_lock (&client->lock);
+  *n_lines = client->n_lines;
+  *n_bytes = client->n_bytes;
+  g_mutex_unlock (&client->lock);
+}
+
+void
+line_client_free (LineClient *client)
+{
+  g_cancellable_cancel (client->cancellable);
+  if (client->thread != NULL)
+    g_thread_join (client->thread);
+
+  if (client->track_name != NULL)
+    hyscan_data_writer_stop (client->writer);
+
+  g_object_unref (client->writer);
+  g_object_unref (client->cancellable);
+  g_mutex_clear (&client->lock);
+  g_free (client->address);
+  g_free (client->track_name);
+  g_free (client);
+}
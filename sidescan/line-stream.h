@@ -0,0 +1,52 @@
+#ifndef __LINE_STREAM_H__
+#define __LINE_STREAM_H__
+
+#include <hyscan-db.h>
+
+#define LINE_STREAM_DEFAULT_PORT       10050           /* Порт сервера строк по умолчанию. */
+
+/* Передача строк записываемого галса на рабочие места просмотра.
+ * Сервер работает на станции записи и передаёт каждому подключённому
+ * клиенту строки бортов текущего галса по мере их записи: амплитуды
+ * квантуются до 16 бит, кодируются разностями соседних отсчётов и
+ * сжимаются deflate. Клиент записывает принятые строки в локальную
+ * базу данных, из которой их отображает водопад рабочего места, поэтому
+ * станция записи читает каждую строку один раз на клиента и не строит
+ * для клиентов изображение. */
+typedef struct _LineServer LineServer;
+typedef struct _LineClient LineClient;
+
+/* Функция запускает сервер строк на порту port. Возвращает NULL,
+ * если порт занят. */
+LineServer    *line_server_new         (HyScanDB                      *db,
+                                        guint16                        port);
+
+/* Функция задаёт галс, строки которого передаются клиентам. NULL
+ * прекращает передачу. */
+void           line_server_set_track   (LineServer                    *server,
+                                        const gchar                   *project_name,
+                                        const gchar                   *track_name,
+                                        gboolean                       raw);
+
+/* Функция возвращает число подключённых клиентов. */
+guint          line_server_get_n_clients (LineServer                  *server);
+
+/* Функция останавливает сервер и освобождает его. */
+void           line_server_free        (LineServer                    *server);
+
+/* Функция подключается к серверу строк по адресу address (узел[:порт])
+ * и записывает принятые галсы в проект project_name локальной базы данных.
+ * При разрыве соединения подключение повторяется. */
+LineClient    *line_client_new         (HyScanDB                      *db,
+                                        const gchar                   *project_name,
+                                        const gchar                   *address);
+
+/* Функция возвращает число принятых строк и объём принятых данных. */
+void           line_client_get_stats   (LineClient                    *client,
+                                        guint64                       *n_lines,
+                                        guint64                       *n_bytes);
+
+/* Функция отключается от сервера и освобождает клиента. */
+void           line_client_free        (LineClient                    *client);
+
+#endif /* __LINE_STREAM_H__ */
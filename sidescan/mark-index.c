@@ -0,0 +1,338 @@
+#include "mark-index.h"
+
+#include <string.h>
+
+#define MARK_INDEX_TRACK_CELL          256             /* Размер ячейки по строкам и отсчётам. */
+#define MARK_INDEX_MAX_CELLS           64              /* Максимальное число ячеек, занимаемых одной меткой. */
+
+typedef struct
+{
+  const gchar                 *id;             /* Идентификатор метки. */
+  HyScanMarkManagerMarkLoc    *loc;            /* Метка. */
+  guint                        stamp;          /* Номер последнего запроса, в который попала метка. */
+} MarkIndexEntry;
+
+typedef struct
+{
+  GHashTable                  *cells;          /* Ячейки сетки: gint64 -> GPtrArray с MarkIndexEntry. */
+  GPtrArray                   *large;          /* Метки, занимающие слишком много ячеек. */
+} MarkIndexGrid;
+
+struct _MarkIndex
+{
+  GHashTable                  *marks;          /* Таблица меток HyScanMarkManagerMarkLoc. */
+  GHashTable                  *entries;        /* Идентификатор метки -> MarkIndexEntry. */
+  GHashTable                  *tracks;         /* Идентификатор галса -> MarkIndexGrid. */
+  guint                        stamp;          /* Номер текущего запроса. */
+};
+
+/* Функция формирует ключ ячейки сетки. */
+static inline gint64
+mark_index_cell_key (gint32 x,
+                     gint32 y)
+{
+  return ((gint64) x << 32) | (guint32) y;
+}
+
+static MarkIndexGrid *
+mark_index_grid_new (void)
+{
+  MarkIndexGrid *grid = g_new0 (MarkIndexGrid, 1);
+
+  grid->cells = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, (GDestroyNotify) g_ptr_array_unref);
+  grid->large = g_ptr_array_new ();
+
+  return grid;
+}
+
+static void
+mark_index_grid_free (MarkIndexGrid *grid)
+{
+  g_hash_table_unref (grid->cells);
+  g_ptr_array_unref (grid->large);
+  g_free (grid);
+}
+
+/* Функция добавляет метку во все ячейки прямоугольной области сетки. */
+static void
+mark_index_grid_add (MarkIndexGrid  *grid,
+                     MarkIndexEntry *entry,
+                     gint32          x0,
+                     gint32          x1,
+                     gint32          y0,
+                     gint32          y1)
+{
+  gint32 x, y;
+
+  if ((gint64) (x1 - x0 + 1) * (y1 - y0 + 1) > MARK_INDEX_MAX_CELLS)
+    {
+      g_ptr_array_add (grid->large, entry);
+      return;
+    }
+
+  for (x = x0; x <= x1; x++)
+    for (y = y0; y <= y1; y++)
+      {
+        gint64 key = mark_index_cell_key (x, y);
+        GPtrArray *cell;
+
+        cell = g_hash_table_lookup (grid->cells, &key);
+        if (cell == NULL)
+          {
+            gint64 *cell_key = g_new (gint64, 1);
+
+            *cell_key = key;
+            cell = g_ptr_array_new ();
+            g_hash_table_insert (grid->cells, cell_key, cell);
+          }
+
+        g_ptr_array_add (cell, entry);
+      }
+}
+
+/* Функция собирает метки из ячеек прямоугольной области сетки. Метка
+ * попадает в результат, если её проверка check возвращает TRUE. Повторное
+ * добавление метки, занимающей несколько ячеек, исключается номером запроса. */
+static void
+mark_index_grid_query (MarkIndex      *index,
+                       MarkIndexGrid  *grid,
+                       gint32          x0,
+                       gint32          x1,
+                       gint32          y0,
+                       gint32          y1,
+                       gboolean      (*check) (MarkIndexEntry *entry,
+                                               gpointer        data),
+                       gpointer        data,
+                       GPtrArray      *result)
+{
+  MarkIndexEntry *entry;
+  gint32 x, y;
+  guint i;
+
+  index->stamp++;
+
+  for (i = 0; i < grid->large->len; i++)
+    {
+      entry = grid->large->pdata[i];
+      if (check (entry, data))
+        g_ptr_array_add (result, (gpointer) entry->id);
+    }
+
+  for (x = x0; x <= x1; x++)
+    for (y = y0; y <= y1; y++)
+      {
+        gint64 key = mark_index_cell_key (x, y);
+        GPtrArray *cell;
+
+        if ((cell = g_hash_table_lookup (grid->cells, &key)) == NULL)
+          continue;
+
+        for (i = 0; i < cell->len; i++)
+          {
+            entry = cell->pdata[i];
+            if (entry->stamp == index->stamp)
+              continue;
+
+            entry->stamp = index->stamp;
+            if (check (entry, data))
+              g_ptr_array_add (result, (gpointer) entry->id);
+          }
+      }
+}
+
+/* Функция возвращает область строк и отсчётов, занимаемую меткой. */
+static void
+mark_index_track_bounds (const HyScanWaterfallMark *mark,
+                         guint32                   *index0,
+                         guint32                   *index1,
+                         guint32                   *count0,
+                         guint32                   *count1)
+{
+  *index0 = (mark->index0 > mark->height) ? mark->index0 - mark->height : 0;
+  *index1 = mark->index0 + MIN (mark->height, G_MAXUINT32 - mark->index0);
+  *count0 = (mark->count0 > mark->width) ? mark->count0 - mark->width : 0;
+  *count1 = mark->count0 + MIN (mark->width, G_MAXUINT32 - mark->count0);
+}
+
+MarkIndex *
+mark_index_new (GHashTable *marks)
+{
+  MarkIndex *index;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  index = g_new0 (MarkIndex, 1);
+  index->marks = g_hash_table_ref (marks);
+  index->entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+  index->tracks = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) mark_index_grid_free);
+
+  g_hash_table_iter_init (&iter, marks);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      MarkIndexEntry *entry;
+      HyScanMarkManagerMarkLoc *loc = value;
+      HyScanWaterfallMark *mark = loc->mark;
+      MarkIndexGrid *grid;
+      guint32 index0, index1, count0, count1;
+
+      entry = g_new0 (MarkIndexEntry, 1);
+      entry->id = key;
+      entry->loc = loc;
+      g_hash_table_insert (index->entries, key, entry);
+
+      if ((mark == NULL) || (mark->track == NULL))
+        continue;
+
+      grid = g_hash_table_lookup (index->tracks, mark->track);
+      if (grid == NULL)
+        {
+          grid = mark_index_grid_new ();
+          g_hash_table_insert (index->tracks, mark->track, grid);
+        }
+
+      mark_index_track_bounds (mark, &index0, &index1, &count0, &count1);
+      mark_index_grid_add (grid, entry,
+                           index0 / MARK_INDEX_TRACK_CELL, index1 / MARK_INDEX_TRACK_CELL,
+                           count0 / MARK_INDEX_TRACK_CELL, count1 / MARK_INDEX_TRACK_CELL);
+    }
+
+  return index;
+}
+
+guint
+mark_index_get_n_marks (MarkIndex *index)
+{
+  return g_hash_table_size (index->entries);
+}
+
+/* Функция возвращает память ячеек сетки. */
+static gsize
+mark_index_grid_get_memory (MarkIndexGrid *grid)
+{
+  GHashTableIter iter;
+  gpointer value;
+  gsize size;
+
+  size = sizeof (MarkIndexGrid) + (grid->large->len + 3) * sizeof (gpointer);
+
+  g_hash_table_iter_init (&iter, grid->cells);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GPtrArray *cell = value;
+
+      size += sizeof (gint64) + sizeof (GPtrArray) + 4 * sizeof (gpointer) + cell->len * sizeof (gpointer);
+    }
+
+  return size;
+}
+
+gsize
+mark_index_get_memory (MarkIndex *index)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  gsize size = sizeof (MarkIndex);
+
+  /* Метка, её строки и записи таблиц меток и индекса. */
+  g_hash_table_iter_init (&iter, index->marks);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      HyScanMarkManagerMarkLoc *loc = value;
+      HyScanWaterfallMark *mark = loc->mark;
+
+      size += strlen (key) + 1 + sizeof (HyScanMarkManagerMarkLoc) + sizeof (MarkIndexEntry) + 6 * sizeof (gpointer);
+      if (mark == NULL)
+        continue;
+
+      size += sizeof (HyScanWaterfallMark);
+      size += (mark->track != NULL) ? strlen (mark->track) + 1 : 0;
+      size += (mark->name != NULL) ? strlen (mark->name) + 1 : 0;
+      size += (mark->description != NULL) ? strlen (mark->description) + 1 : 0;
+      size += (mark->operator_name != NULL) ? strlen (mark->operator_name) + 1 : 0;
+    }
+
+  g_hash_table_iter_init (&iter, index->tracks);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    size += mark_index_grid_get_memory (value);
+
+  return size;
+}
+
+GHashTable *
+mark_index_get_marks (MarkIndex *index)
+{
+  return index->marks;
+}
+
+const HyScanMarkManagerMarkLoc *
+mark_index_lookup (MarkIndex   *index,
+                   const gchar *mark_id)
+{
+  MarkIndexEntry *entry;
+
+  if (mark_id == NULL)
+    return NULL;
+
+  entry = g_hash_table_lookup (index->entries, mark_id);
+
+  return (entry != NULL) ? entry->loc : NULL;
+}
+
+typedef struct
+{
+  HyScanSourceType             source;
+  guint32                      index_min;
+  guint32                      index_max;
+  guint32                      count_min;
+  guint32                      count_max;
+} MarkIndexTrackArea;
+
+/* Проверка пересечения метки с областью строк и отсчётов. */
+static gboolean
+mark_index_check_track (MarkIndexEntry *entry,
+                        gpointer        data)
+{
+  MarkIndexTrackArea *area = data;
+  guint32 index0, index1, count0, count1;
+
+  if (entry->loc->mark->source0 != area->source)
+    return FALSE;
+
+  mark_index_track_bounds (entry->loc->mark, &index0, &index1, &count0, &count1);
+
+  return (index0 <= area->index_max) && (index1 >= area->index_min) &&
+         (count0 <= area->count_max) && (count1 >= area->count_min);
+}
+
+GPtrArray *
+mark_index_query_track (MarkIndex        *index,
+                        const gchar      *track,
+                        HyScanSourceType  source,
+                        guint32           index_min,
+                        guint32           index_max,
+                        guint32           count_min,
+                        guint32           count_max)
+{
+  GPtrArray *result = g_ptr_array_new ();
+  MarkIndexTrackArea area = { source, index_min, index_max, count_min, count_max };
+  MarkIndexGrid *grid;
+
+  if ((grid = g_hash_table_lookup (index->tracks, track)) == NULL)
+    return result;
+
+  mark_index_grid_query (index, grid,
+                         index_min / MARK_INDEX_TRACK_CELL, index_max / MARK_INDEX_TRACK_CELL,
+                         count_min / MARK_INDEX_TRACK_CELL, count_max / MARK_INDEX_TRACK_CELL,
+                         mark_index_check_track, &area, result);
+
+  return result;
+}
+
+void
+mark_index_free (MarkIndex *index)
+{
+  g_hash_table_unref (index->tracks);
+  g_hash_table_unref (index->entries);
+  g_hash_table_unref (index->marks);
+  g_free (index);
+}
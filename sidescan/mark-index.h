@@ -0,0 +1,43 @@
+#ifndef __MARK_INDEX_H__
+#define __MARK_INDEX_H__
+
+#include <hyscan-mark-manager.h>
+
+/* Индекс меток. Метки каждого галса размещаются в ячейках равномерной
+ * сетки по номеру строки и отсчёта. Запросы просматривают только ячейки,
+ * попадающие в заданную область. */
+typedef struct _MarkIndex MarkIndex;
+
+/* Функция создаёт индекс для меток, полученных от
+ * hyscan_mark_manager_get_w_coords. Индекс хранит ссылку на таблицу меток. */
+MarkIndex     *mark_index_new          (GHashTable                    *marks);
+
+/* Функция возвращает число меток в индексе. */
+guint          mark_index_get_n_marks  (MarkIndex                     *index);
+
+/* Функция возвращает оценку памяти, занимаемой таблицей меток и индексом, байт. */
+gsize          mark_index_get_memory   (MarkIndex                     *index);
+
+/* Функция возвращает таблицу меток, по которой построен индекс. */
+GHashTable    *mark_index_get_marks    (MarkIndex                     *index);
+
+/* Функция возвращает метку с указанным идентификатором или NULL. */
+const HyScanMarkManagerMarkLoc *
+               mark_index_lookup       (MarkIndex                     *index,
+                                        const gchar                   *mark_id);
+
+/* Функция возвращает идентификаторы меток галса, пересекающихся с указанной
+ * областью строк и отсчётов источника данных. Массив освобождается
+ * g_ptr_array_unref, строки принадлежат индексу. */
+GPtrArray     *mark_index_query_track  (MarkIndex                     *index,
+                                        const gchar                   *track,
+                                        HyScanSourceType               source,
+                                        guint32                        index_min,
+                                        guint32                        index_max,
+                                        guint32                        count_min,
+                                        guint32                        count_max);
+
+/* Функция освобождает индекс. */
+void           mark_index_free         (MarkIndex                     *index);
+
+#endif /* __MARK_INDEX_H__ */
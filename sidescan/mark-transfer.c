@@ -0,0 +1,539 @@
+#include "mark-transfer.h"
+
+#include <hyscan-waterfall-mark-data.h>
+#include <gio/gio.h>
+#include <string.h>
+
+#define MARK_TRANSFER_MAGIC            0x53534D4B      /* Сигнатура двоичного файла "SSMK". */
+#define MARK_TRANSFER_VERSION          1               /* Версия двоичного формата. */
+#define MARK_TRANSFER_NULL_STRING      G_MAXUINT32     /* Длина строки NULL в двоичном формате. */
+#define MARK_TRANSFER_MAX_STRING       (1024 * 1024)   /* Максимальная длина строки в двоичном формате. */
+#define MARK_TRANSFER_N_FIELDS         12              /* Число полей метки. */
+
+/* Заголовок файла CSV. */
+static const gchar *csv_header = "track,name,description,operator,labels,creation_time,"
+                                 "modification_time,source,index0,count0,width,height";
+
+/* Функция определяет формат файла по расширению. */
+static gboolean
+mark_transfer_is_csv (const gchar *path)
+{
+  return g_str_has_suffix (path, ".csv") || g_str_has_suffix (path, ".CSV");
+}
+
+/* Функция добавляет поле CSV к строке, экранируя его при необходимости. */
+static void
+csv_append_field (GString     *line,
+                  const gchar *value)
+{
+  const gchar *p;
+
+  if (line->len > 0)
+    g_string_append_c (line, ',');
+
+  if (value == NULL)
+    return;
+
+  if (strpbrk (value, ",\"\r\n") == NULL)
+    {
+      g_string_append (line, value);
+      return;
+    }
+
+  g_string_append_c (line, '"');
+  for (p = value; *p != '\0'; p++)
+    {
+      if (*p == '"')
+        g_string_append_c (line, '"');
+      g_string_append_c (line, *p);
+    }
+  g_string_append_c (line, '"');
+}
+
+/* Функция читает запись CSV. Поле в кавычках может занимать несколько
+ * строк. Возвращает массив полей или NULL в конце файла. */
+static gchar **
+csv_read_record (GDataInputStream *input,
+                 GError          **error)
+{
+  GPtrArray *fields;
+  GString *field;
+  gboolean quoted = FALSE;
+  gchar *line;
+
+  line = g_data_input_stream_read_line_utf8 (input, NULL, NULL, error);
+  if (line == NULL)
+    return NULL;
+
+  fields = g_ptr_array_new ();
+  field = g_string_new (NULL);
+
+  while (TRUE)
+    {
+      const gchar *p;
+
+      for (p = line; *p != '\0'; p++)
+        {
+          if (quoted)
+            {
+              if ((p[0] == '"') && (p[1] == '"'))
+                g_string_append_c (field, *p++);
+              else if (*p == '"')
+                quoted = FALSE;
+              else
+                g_string_append_c (field, *p);
+            }
+          else if (*p == '"')
+            {
+              quoted = TRUE;
+            }
+          else if (*p == ',')
+            {
+              g_ptr_array_add (fields, g_string_free (field, FALSE));
+              field = g_string_new (NULL);
+            }
+          else if (*p != '\r')
+            {
+              g_string_append_c (field, *p);
+            }
+        }
+
+      g_free (line);
+
+      if (!quoted)
+        break;
+
+      /* Перевод строки внутри поля в кавычках. */
+      line = g_data_input_stream_read_line_utf8 (input, NULL, NULL, error);
+      if (line == NULL)
+        break;
+
+      g_string_append_c (field, '\n');
+    }
+
+  g_ptr_array_add (fields, g_string_free (field, FALSE));
+  g_ptr_array_add (fields, NULL);
+
+  return (gchar **) g_ptr_array_free (fields, FALSE);
+}
+
+/* Функция записывает метку в файл CSV. */
+static gboolean
+csv_write_mark (GOutputStream             *output,
+                const HyScanWaterfallMark *mark,
+                GString                   *line,
+                GError                   **error)
+{
+  gchar value[32];
+
+  g_string_truncate (line, 0);
+
+  csv_append_field (line, mark->track);
+  csv_append_field (line, mark->name);
+  csv_append_field (line, mark->description);
+  csv_append_field (line, mark->operator_name);
+  g_snprintf (value, sizeof (value), "%" G_GUINT64_FORMAT, mark->labels);
+  csv_append_field (line, value);
+  g_snprintf (value, sizeof (value), "%" G_GINT64_FORMAT, mark->creation_time);
+  csv_append_field (line, value);
+  g_snprintf (value, sizeof (value), "%" G_GINT64_FORMAT, mark->modification_time);
+  csv_append_field (line, value);
+  csv_append_field (line, hyscan_source_get_id_by_type (mark->source0));
+  g_snprintf (value, sizeof (value), "%u", mark->index0);
+  csv_append_field (line, value);
+  g_snprintf (value, sizeof (value), "%u", mark->count0);
+  csv_append_field (line, value);
+  g_snprintf (value, sizeof (value), "%u", mark->width);
+  csv_append_field (line, value);
+  g_snprintf (value, sizeof (value), "%u", mark->height);
+  csv_append_field (line, value);
+  g_string_append_c (line, '\n');
+
+  return g_output_stream_write_all (output, line->str, line->len, NULL, NULL, error);
+}
+
+/* Функция разбирает метку из полей записи CSV. */
+static gboolean
+csv_parse_mark (gchar               **fields,
+                HyScanWaterfallMark  *mark)
+{
+  guint64 values[MARK_TRANSFER_N_FIELDS];
+  gint64 creation_time;
+  gint64 modification_time;
+  guint i;
+
+  if (g_strv_length (fields) != MARK_TRANSFER_N_FIELDS)
+    return FALSE;
+
+  memset (mark, 0, sizeof (*mark));
+
+  /* Значения вне диапазона полей метки считаются ошибкой, а не обрезаются. */
+  if (!g_ascii_string_to_unsigned (fields[4], 10, 0, G_MAXUINT64, &values[4], NULL) ||
+      !g_ascii_string_to_signed (fields[5], 10, G_MININT64, G_MAXINT64, &creation_time, NULL) ||
+      !g_ascii_string_to_signed (fields[6], 10, G_MININT64, G_MAXINT64, &modification_time, NULL))
+    {
+      return FALSE;
+    }
+
+  for (i = 8; i < MARK_TRANSFER_N_FIELDS; i++)
+    if (!g_ascii_string_to_unsigned (fields[i], 10, 0, G_MAXUINT32, &values[i], NULL))
+      return FALSE;
+
+  mark->track = fields[0];
+  mark->name = fields[1];
+  mark->description = fields[2];
+  mark->operator_name = fields[3];
+  mark->labels = values[4];
+  mark->creation_time = creation_time;
+  mark->modification_time = modification_time;
+  mark->source0 = hyscan_source_get_type_by_id (fields[7]);
+  mark->index0 = values[8];
+  mark->count0 = values[9];
+  mark->width = values[10];
+  mark->height = values[11];
+
+  return (mark->source0 != HYSCAN_SOURCE_INVALID);
+}
+
+/* Функция записывает строку в двоичном формате. */
+static gboolean
+bin_write_string (GDataOutputStream *output,
+                  const gchar       *value,
+                  GError           **error)
+{
+  guint32 length = (value != NULL) ? strlen (value) : MARK_TRANSFER_NULL_STRING;
+
+  if (!g_data_output_stream_put_uint32 (output, length, NULL, error))
+    return FALSE;
+
+  if (value == NULL)
+    return TRUE;
+
+  return g_output_stream_write_all (G_OUTPUT_STREAM (output), value, length, NULL, NULL, error);
+}
+
+/* Функции чтения чисел в двоичном формате. Если предыдущее чтение
+ * завершилось ошибкой, чтение не выполняется и возвращается 0. */
+static guint32
+bin_read_uint32 (GDataInputStream *input,
+                 GError          **error)
+{
+  return (*error == NULL) ? g_data_input_stream_read_uint32 (input, NULL, error) : 0;
+}
+
+static guint64
+bin_read_uint64 (GDataInputStream *input,
+                 GError          **error)
+{
+  return (*error == NULL) ? g_data_input_stream_read_uint64 (input, NULL, error) : 0;
+}
+
+static gint64
+bin_read_int64 (GDataInputStream *input,
+                GError          **error)
+{
+  return (*error == NULL) ? g_data_input_stream_read_int64 (input, NULL, error) : 0;
+}
+
+/* Функция читает строку в двоичном формате. */
+static gboolean
+bin_read_string (GDataInputStream *input,
+                 gchar           **value,
+                 GError          **error)
+{
+  guint32 length;
+  gsize read_size;
+
+  *value = NULL;
+
+  length = g_data_input_stream_read_uint32 (input, NULL, error);
+  if ((error != NULL) && (*error != NULL))
+    return FALSE;
+
+  if (length == MARK_TRANSFER_NULL_STRING)
+    return TRUE;
+
+  if (length > MARK_TRANSFER_MAX_STRING)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "string is too long (%u bytes)", length);
+      return FALSE;
+    }
+
+  *value = g_malloc (length + 1);
+  if (!g_input_stream_read_all (G_INPUT_STREAM (input), *value, length, &read_size, NULL, error) ||
+      (read_size != length))
+    {
+      if ((error != NULL) && (*error == NULL))
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "unexpected end of file");
+      g_clear_pointer (value, g_free);
+      return FALSE;
+    }
+  (*value)[length] = '\0';
+
+  return TRUE;
+}
+
+/* Функция записывает метку в двоичном формате. Каждой метке
+ * предшествует байт 1, файл завершается байтом 0. */
+static gboolean
+bin_write_mark (GDataOutputStream         *output,
+                const HyScanWaterfallMark *mark,
+                GError                   **error)
+{
+  return g_data_output_stream_put_byte (output, 1, NULL, error) &&
+         bin_write_string (output, mark->track, error) &&
+         bin_write_string (output, mark->name, error) &&
+         bin_write_string (output, mark->description, error) &&
+         bin_write_string (output, mark->operator_name, error) &&
+         g_data_output_stream_put_uint64 (output, mark->labels, NULL, error) &&
+         g_data_output_stream_put_int64 (output, mark->creation_time, NULL, error) &&
+         g_data_output_stream_put_int64 (output, mark->modification_time, NULL, error) &&
+         g_data_output_stream_put_uint32 (output, mark->source0, NULL, error) &&
+         g_data_output_stream_put_uint32 (output, mark->index0, NULL, error) &&
+         g_data_output_stream_put_uint32 (output, mark->count0, NULL, error) &&
+         g_data_output_stream_put_uint32 (output, mark->width, NULL, error) &&
+         g_data_output_stream_put_uint32 (output, mark->height, NULL, error);
+}
+
+/* Функция читает метку в двоичном формате. Возвращает FALSE в конце
+ * файла или при ошибке, ошибка отличается установленным error. */
+static gboolean
+bin_read_mark (GDataInputStream    *input,
+               HyScanWaterfallMark *mark,
+               GError             **error)
+{
+  guint8 tag;
+
+  memset (mark, 0, sizeof (*mark));
+
+  tag = g_data_input_stream_read_byte (input, NULL, error);
+  if ((*error != NULL) || (tag == 0))
+    return FALSE;
+
+  if (!bin_read_string (input, &mark->track, error) ||
+      !bin_read_string (input, &mark->name, error) ||
+      !bin_read_string (input, &mark->description, error) ||
+      !bin_read_string (input, &mark->operator_name, error))
+    {
+      return FALSE;
+    }
+
+  mark->labels = bin_read_uint64 (input, error);
+  mark->creation_time = bin_read_int64 (input, error);
+  mark->modification_time = bin_read_int64 (input, error);
+  mark->source0 = bin_read_uint32 (input, error);
+  mark->index0 = bin_read_uint32 (input, error);
+  mark->count0 = bin_read_uint32 (input, error);
+  mark->width = bin_read_uint32 (input, error);
+  mark->height = bin_read_uint32 (input, error);
+
+  return (*error == NULL);
+}
+
+/* Функция освобождает строки метки, прочитанной в двоичном формате. */
+static void
+bin_clear_mark (HyScanWaterfallMark *mark)
+{
+  g_clear_pointer (&mark->track, g_free);
+  g_clear_pointer (&mark->name, g_free);
+  g_clear_pointer (&mark->description, g_free);
+  g_clear_pointer (&mark->operator_name, g_free);
+}
+
+gboolean
+mark_transfer_export (HyScanDB    *db,
+                      const gchar *project_name,
+                      const gchar *path)
+{
+  HyScanWaterfallMarkData *data;
+  GFile *file = NULL;
+  GFileOutputStream *file_output = NULL;
+  GOutputStream *output = NULL;
+  GString *line = NULL;
+  GError *error = NULL;
+  gboolean csv;
+  gchar **ids = NULL;
+  guint n_ids = 0;
+  guint n_exported = 0;
+  guint i;
+
+  data = hyscan_waterfall_mark_data_new (db, project_name);
+  if (data == NULL)
+    {
+      g_message ("can't open marks of project '%s'", project_name);
+      return FALSE;
+    }
+
+  file = g_file_new_for_commandline_arg (path);
+  file_output = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error);
+  if (file_output == NULL)
+    goto exit;
+
+  csv = mark_transfer_is_csv (path);
+  output = G_OUTPUT_STREAM (g_data_output_stream_new (G_OUTPUT_STREAM (file_output)));
+  line = g_string_new (NULL);
+
+  if (csv)
+    {
+      g_string_printf (line, "%s\n", csv_header);
+      if (!g_output_stream_write_all (output, line->str, line->len, NULL, NULL, &error))
+        goto exit;
+    }
+  else
+    {
+      if (!g_data_output_stream_put_uint32 (G_DATA_OUTPUT_STREAM (output), MARK_TRANSFER_MAGIC, NULL, &error) ||
+          !g_data_output_stream_put_uint32 (G_DATA_OUTPUT_STREAM (output), MARK_TRANSFER_VERSION, NULL, &error))
+        {
+          goto exit;
+        }
+    }
+
+  ids = hyscan_waterfall_mark_data_get_ids (data, &n_ids);
+  for (i = 0; i < n_ids; i++)
+    {
+      HyScanWaterfallMark *mark;
+      gboolean status;
+
+      if ((mark = hyscan_waterfall_mark_data_get (data, ids[i])) == NULL)
+        continue;
+
+      if (csv)
+        status = csv_write_mark (output, mark, line, &error);
+      else
+        status = bin_write_mark (G_DATA_OUTPUT_STREAM (output), mark, &error);
+
+      hyscan_waterfall_mark_free (mark);
+
+      if (!status)
+        goto exit;
+
+      n_exported += 1;
+    }
+
+  if (!csv && !g_data_output_stream_put_byte (G_DATA_OUTPUT_STREAM (output), 0, NULL, &error))
+    goto exit;
+
+  g_output_stream_close (output, NULL, &error);
+
+exit:
+  if (error != NULL)
+    g_message ("can't export marks to '%s': %s", path, error->message);
+  else
+    g_print ("%u marks exported\n", n_exported);
+
+  g_strfreev (ids);
+  if (line != NULL)
+    g_string_free (line, TRUE);
+  g_clear_object (&output);
+  g_clear_object (&file_output);
+  g_clear_object (&file);
+  g_object_unref (data);
+
+  if (error != NULL)
+    {
+      g_error_free (error);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+gboolean
+mark_transfer_import (HyScanDB    *db,
+                      const gchar *project_name,
+                      const gchar *path)
+{
+  HyScanWaterfallMarkData *data;
+  GFile *file = NULL;
+  GFileInputStream *file_input = NULL;
+  GDataInputStream *input = NULL;
+  GError *error = NULL;
+  guint n_marks = 0;
+  guint n_invalid = 0;
+
+  data = hyscan_waterfall_mark_data_new (db, project_name);
+  if (data == NULL)
+    {
+      g_message ("can't open marks of project '%s'", project_name);
+      return FALSE;
+    }
+
+  file = g_file_new_for_commandline_arg (path);
+  file_input = g_file_read (file, NULL, &error);
+  if (file_input == NULL)
+    goto exit;
+
+  input = g_data_input_stream_new (G_INPUT_STREAM (file_input));
+
+  if (mark_transfer_is_csv (path))
+    {
+      gchar **fields;
+
+      while ((fields = csv_read_record (input, &error)) != NULL)
+        {
+          HyScanWaterfallMark mark;
+
+          /* Заголовок и пустые строки. */
+          if ((fields[0] == NULL) || ((fields[1] == NULL) && (fields[0][0] == '\0')) ||
+              ((n_marks + n_invalid == 0) && (g_strcmp0 (fields[0], "track") == 0)))
+            {
+              g_strfreev (fields);
+              continue;
+            }
+
+          if (csv_parse_mark (fields, &mark) && hyscan_waterfall_mark_data_add (data, &mark))
+            n_marks += 1;
+          else
+            n_invalid += 1;
+
+          g_strfreev (fields);
+        }
+    }
+  else
+    {
+      HyScanWaterfallMark mark;
+      guint32 magic, version;
+
+      magic = bin_read_uint32 (input, &error);
+      version = bin_read_uint32 (input, &error);
+      if (error != NULL)
+        goto exit;
+
+      if ((magic != MARK_TRANSFER_MAGIC) || (version != MARK_TRANSFER_VERSION))
+        {
+          g_set_error (&error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "unsupported file format");
+          goto exit;
+        }
+
+      while (bin_read_mark (input, &mark, &error))
+        {
+          if (hyscan_waterfall_mark_data_add (data, &mark))
+            n_marks += 1;
+          else
+            n_invalid += 1;
+
+          bin_clear_mark (&mark);
+        }
+
+      bin_clear_mark (&mark);
+    }
+
+exit:
+  if (error != NULL)
+    g_message ("can't import marks from '%s': %s", path, error->message);
+  else
+    g_print ("%u marks imported, %u skipped\n", n_marks, n_invalid);
+
+  g_clear_object (&input);
+  g_clear_object (&file_input);
+  g_clear_object (&file);
+  g_object_unref (data);
+
+  if (error != NULL)
+    {
+      g_error_free (error);
+      return FALSE;
+    }
+
+  return TRUE;
+}
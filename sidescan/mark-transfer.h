@@ -0,0 +1,20 @@
+#ifndef __MARK_TRANSFER_H__
+#define __MARK_TRANSFER_H__
+
+#include <hyscan-db.h>
+
+/* Функция экспортирует все метки проекта в файл. Формат файла определяется
+ * расширением: ".csv" - текст CSV, иначе - компактный двоичный формат.
+ * Метки записываются в файл по одной, без накопления в памяти. */
+gboolean       mark_transfer_export    (HyScanDB                      *db,
+                                        const gchar                   *project_name,
+                                        const gchar                   *path);
+
+/* Функция импортирует метки из файла в проект. Формат файла определяется
+ * так же, как при экспорте. Файл читается потоком, метки записываются
+ * в базу данных по мере чтения. */
+gboolean       mark_transfer_import    (HyScanDB                      *db,
+                                        const gchar                   *project_name,
+                                        const gchar                   *path);
+
+#endif /* __MARK_TRANSFER_H__ */
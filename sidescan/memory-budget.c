@@ -0,0 +1,265 @@
+#include "memory-budget.h"
+
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define MEMORY_BUDGET_SHRINK_MARGIN    0.9             /* Доля ограничения, до которой уменьшается память. */
+#define MEMORY_BUDGET_WARN_PERIOD      (60 * G_TIME_SPAN_SECOND) /* Период сообщений о превышении ограничения. */
+
+/* Подсистема. */
+typedef struct
+{
+  gchar                       *name;
+  MemoryBudgetUsageFunc        usage;
+  MemoryBudgetShrinkFunc       shrink;
+  gpointer                     data;
+  gboolean                     limit;          /* Функция usage возвращает ограничение памяти. */
+  gsize                        size;           /* Память по результатам последней проверки. */
+} MemoryBudgetItem;
+
+struct _MemoryBudget
+{
+  gsize                        limit;
+  GArray                      *items;          /* Подсистемы MemoryBudgetItem. */
+  gsize                        rss;            /* Память процесса по результатам последней проверки. */
+  gint64                       warn_time;      /* Время последнего сообщения о превышении ограничения. */
+};
+
+/* Функция возвращает объём памяти процесса или 0, если он неизвестен. */
+static gsize
+memory_budget_get_rss (void)
+{
+  gsize rss = 0;
+
+#ifdef G_OS_UNIX
+  gchar *statm;
+
+  if (g_file_get_contents ("/proc/self/statm", &statm, NULL, NULL))
+    {
+      gchar **values = g_strsplit (statm, " ", 3);
+
+      if (g_strv_length (values) >= 2)
+        rss = g_ascii_strtoull (values[1], NULL, 10) * sysconf (_SC_PAGESIZE);
+
+      g_strfreev (values);
+      g_free (statm);
+    }
+#endif
+
+  return rss;
+}
+
+/* Функция определяет память подсистем и процесса. */
+static void
+memory_budget_measure (MemoryBudget *budget)
+{
+  guint i;
+
+  for (i = 0; i < budget->items->len; i++)
+    {
+      MemoryBudgetItem *item = &g_array_index (budget->items, MemoryBudgetItem, i);
+
+      item->size = item->usage (item->data);
+    }
+
+  budget->rss = memory_budget_get_rss ();
+}
+
+static gint
+memory_budget_compare_size (gconstpointer a,
+                            gconstpointer b)
+{
+  const MemoryBudgetItem *item_a = *(MemoryBudgetItem * const *) a;
+  const MemoryBudgetItem *item_b = *(MemoryBudgetItem * const *) b;
+
+  /* Фактический объём подсистем с ограничением неизвестен. */
+  if (item_a->limit != item_b->limit)
+    return item_a->limit ? 1 : -1;
+
+  return (item_a->size < item_b->size) - (item_a->size > item_b->size);
+}
+
+/* Функция форматирует объём памяти. */
+static gchar *
+memory_budget_format (gsize size)
+{
+  return g_strdup_printf ("%.1f MB", size / (1024.0 * 1024.0));
+}
+
+MemoryBudget *
+memory_budget_new (gsize limit)
+{
+  MemoryBudget *budget;
+
+  budget = g_new0 (MemoryBudget, 1);
+  budget->limit = limit;
+  budget->items = g_array_new (FALSE, FALSE, sizeof (MemoryBudgetItem));
+  budget->warn_time = -MEMORY_BUDGET_WARN_PERIOD;
+
+  return budget;
+}
+
+/* Функция добавляет подсистему. */
+static void
+memory_budget_add_item (MemoryBudget           *budget,
+                        const gchar            *name,
+                        MemoryBudgetUsageFunc   usage,
+                        MemoryBudgetShrinkFunc  shrink,
+                        gpointer                data,
+                        gboolean                limit)
+{
+  MemoryBudgetItem item;
+
+  item.name = g_strdup (name);
+  item.usage = usage;
+  item.shrink = shrink;
+  item.data = data;
+  item.limit = limit;
+  item.size = 0;
+
+  g_array_append_val (budget->items, item);
+}
+
+void
+memory_budget_add (MemoryBudget           *budget,
+                   const gchar            *name,
+                   MemoryBudgetUsageFunc   usage,
+                   MemoryBudgetShrinkFunc  shrink,
+                   gpointer                data)
+{
+  memory_budget_add_item (budget, name, usage, shrink, data, FALSE);
+}
+
+void
+memory_budget_add_limit (MemoryBudget           *budget,
+                         const gchar            *name,
+                         MemoryBudgetUsageFunc   usage,
+                         MemoryBudgetShrinkFunc  shrink,
+                         gpointer                data)
+{
+  memory_budget_add_item (budget, name, usage, shrink, data, TRUE);
+}
+
+gboolean
+memory_budget_check (MemoryBudget *budget)
+{
+  GPtrArray *order;
+  gboolean shrunk = FALSE;
+  gint64 now;
+  gsize target;
+  guint i;
+
+  memory_budget_measure (budget);
+
+  if ((budget->limit == 0) || (budget->rss <= budget->limit))
+    return FALSE;
+
+  /* Память уменьшается начиная с подсистемы, занимающей больше всего
+   * памяти, до тех пор, пока память процесса не опустится ниже порога.
+   * Подсистемы с ограничением памяти уменьшаются последними. */
+  order = g_ptr_array_new ();
+  for (i = 0; i < budget->items->len; i++)
+    {
+      MemoryBudgetItem *item = &g_array_index (budget->items, MemoryBudgetItem, i);
+
+      if (item->shrink != NULL)
+        g_ptr_array_add (order, item);
+    }
+  g_ptr_array_sort (order, memory_budget_compare_size);
+
+  target = MEMORY_BUDGET_SHRINK_MARGIN * budget->limit;
+  for (i = 0; i < order->len; i++)
+    {
+      MemoryBudgetItem *item = g_ptr_array_index (order, i);
+
+      if (!item->shrink (item->data))
+        continue;
+
+      shrunk = TRUE;
+
+#ifdef __GLIBC__
+      malloc_trim (0);
+#endif
+
+      if (memory_budget_get_rss () <= target)
+        break;
+    }
+
+  g_ptr_array_unref (order);
+
+  /* Если уменьшать больше нечего, ограничение будет превышено при каждой
+   * проверке, поэтому сообщение об этом выводится не чаще периода. */
+  now = g_get_monotonic_time ();
+  if (shrunk)
+    {
+      g_message ("memory limit exceeded, caches reduced");
+      memory_budget_measure (budget);
+    }
+  else if (now - budget->warn_time >= MEMORY_BUDGET_WARN_PERIOD)
+    {
+      g_message ("memory limit exceeded, nothing left to reduce");
+      budget->warn_time = now;
+    }
+
+  return shrunk;
+}
+
+gchar *
+memory_budget_report (MemoryBudget *budget,
+                      const gchar  *separator)
+{
+  GString *report = g_string_new (NULL);
+  gsize total = 0;
+  gchar *size;
+  guint i;
+
+  for (i = 0; i < budget->items->len; i++)
+    {
+      MemoryBudgetItem *item = &g_array_index (budget->items, MemoryBudgetItem, i);
+
+      size = memory_budget_format (item->size);
+      g_string_append_printf (report, "%s%s%s: %s", (i > 0) ? separator : "", item->name,
+                              item->limit ? " (limit)" : "", size);
+      g_free (size);
+
+      /* Память подсистем с ограничением входит в неучтённую память. */
+      if (!item->limit)
+        total += item->size;
+    }
+
+  if (budget->rss > 0)
+    {
+      size = memory_budget_format ((budget->rss > total) ? budget->rss - total : 0);
+      g_string_append_printf (report, "%sother: %s", separator, size);
+      g_free (size);
+
+      size = memory_budget_format (budget->rss);
+      g_string_append_printf (report, "%sprocess: %s", separator, size);
+      g_free (size);
+    }
+
+  if (budget->limit > 0)
+    {
+      size = memory_budget_format (budget->limit);
+      g_string_append_printf (report, "%slimit: %s", separator, size);
+      g_free (size);
+    }
+
+  return g_string_free (report, FALSE);
+}
+
+void
+memory_budget_free (MemoryBudget *budget)
+{
+  guint i;
+
+  for (i = 0; i < budget->items->len; i++)
+    g_free (g_array_index (budget->items, MemoryBudgetItem, i).name);
+
+  g_array_unref (budget->items);
+  g_free (budget);
+}
@@ -0,0 +1,58 @@
+#ifndef __MEMORY_BUDGET_H__
+#define __MEMORY_BUDGET_H__
+
+#include <glib.h>
+
+/* Функция возвращает объём памяти подсистемы, байт. */
+typedef gsize (*MemoryBudgetUsageFunc)   (gpointer                       data);
+
+/* Функция уменьшает память подсистемы при нехватке памяти. Возвращает
+ * FALSE, если память подсистемы уменьшить уже нельзя. Уменьшение
+ * окончательное: учёт памяти не возвращает подсистемам память обратно. */
+typedef gboolean (*MemoryBudgetShrinkFunc) (gpointer                     data);
+
+/* Учёт памяти подсистем и ограничение общего объёма памяти процесса.
+ * Подсистемы сообщают занимаемую ими память функциями учёта. При каждой
+ * проверке определяется объём памяти процесса (RSS), и, если он
+ * превышает ограничение, вызываются функции уменьшения памяти подсистем
+ * в порядке убывания занимаемой ими памяти, после чего освобождённая
+ * память возвращается системе. Память, не учтённая подсистемами
+ * (библиотеки, буферы базы данных), показывается отдельной строкой.
+ * Подсистемы, для которых известно только ограничение памяти, а не
+ * фактический объём, в учтённую память не входят и уменьшаются после
+ * остальных. */
+typedef struct _MemoryBudget MemoryBudget;
+
+/* Функция создаёт учёт памяти с ограничением limit байт, 0 - без ограничения. */
+MemoryBudget  *memory_budget_new       (gsize                          limit);
+
+/* Функция добавляет подсистему name. Функция shrink может быть NULL. */
+void           memory_budget_add       (MemoryBudget                  *budget,
+                                        const gchar                   *name,
+                                        MemoryBudgetUsageFunc          usage,
+                                        MemoryBudgetShrinkFunc         shrink,
+                                        gpointer                       data);
+
+/* Функция добавляет подсистему name, функция usage которой возвращает
+ * не фактический объём, а ограничение памяти подсистемы. Функция shrink
+ * может быть NULL. */
+void           memory_budget_add_limit (MemoryBudget                  *budget,
+                                        const gchar                   *name,
+                                        MemoryBudgetUsageFunc          usage,
+                                        MemoryBudgetShrinkFunc         shrink,
+                                        gpointer                       data);
+
+/* Функция определяет память подсистем и процесса и при превышении
+ * ограничения уменьшает память подсистем. Возвращает TRUE, если память
+ * какой-либо подсистемы была уменьшена. */
+gboolean       memory_budget_check     (MemoryBudget                  *budget);
+
+/* Функция возвращает память подсистем, определённую последней проверкой,
+ * строками "название: объём", разделёнными separator. */
+gchar         *memory_budget_report    (MemoryBudget                  *budget,
+                                        const gchar                   *separator);
+
+/* Функция освобождает учёт памяти. */
+void           memory_budget_free      (MemoryBudget                  *budget);
+
+#endif /* __MEMORY_BUDGET_H__ */
@@ -0,0 +1,849 @@
+#include "mosaic.h"
+#include "nav-index.h"
+
+#include <hyscan-acoustic-data.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <math.h>
+
+#define MOSAIC_TILE_POINTS             (MOSAIC_TILE_SIZE * MOSAIC_TILE_SIZE)
+#define MOSAIC_TILE_BYTES              (2 * MOSAIC_TILE_POINTS * sizeof (gfloat))
+#define MOSAIC_MAX_TILES               256             /* Максимальное число тайлов в памяти. */
+#define MOSAIC_BATCH_TILES             64              /* Число тайлов, обрабатываемых за один проход. */
+#define MOSAIC_MAX_LINES               256             /* Максимальное число строк источника за одно обновление. */
+#define MOSAIC_EARTH_RADIUS            6371000.0       /* Радиус Земли, м. */
+#define MOSAIC_STATE_FILE              "mosaic.ini"    /* Файл состояния построения мозаики. */
+
+/* Источники данных мозаики и направление дальности относительно правого борта. */
+static const HyScanSourceType mosaic_sources[] = { HYSCAN_SOURCE_SIDE_SCAN_STARBOARD, HYSCAN_SOURCE_SIDE_SCAN_PORT };
+static const gdouble mosaic_sides[] = { 1.0, -1.0 };
+
+#define MOSAIC_N_SOURCES               G_N_ELEMENTS (mosaic_sources)
+
+/* Тайл мозаики. Для каждой точки хранится сумма амплитуд и число
+ * попавших в неё отсчётов, значение точки - их отношение. */
+typedef struct
+{
+  guint                        level;          /* Уровень детализации. */
+  gint                         x;              /* Номер тайла по горизонтали. */
+  gint                         y;              /* Номер тайла по вертикали. */
+  gchar                       *key;            /* Ключ тайла и название файла. */
+  gfloat                      *sum;            /* Сумма амплитуд. */
+  gfloat                      *weight;         /* Число отсчётов. */
+  gboolean                     dirty;          /* Признак несохранённых изменений. */
+  guint                        pinned;         /* Число обработчиков, использующих тайл. */
+  GList                       *link;           /* Элемент списка последних использованных тайлов. */
+} MosaicTile;
+
+/* Отсчёт, попавший в точку тайла. */
+typedef struct
+{
+  guint32                      offset;         /* Смещение точки в тайле. */
+  gfloat                       value;          /* Амплитуда. */
+} MosaicSplat;
+
+/* Задание обработки тайла: добавление отсчётов или, если отсчётов
+ * нет, сборка тайла из четырёх тайлов предыдущего уровня. */
+typedef struct
+{
+  MosaicTile                  *tile;
+  GArray                      *splats;
+  MosaicTile                  *children[4];
+} MosaicTask;
+
+/* Галс проекта. */
+typedef struct
+{
+  gchar                       *name;
+  NavIndex                    *nav;
+  HyScanAcousticData          *data[MOSAIC_N_SOURCES];
+  guint32                      next_index[MOSAIC_N_SOURCES];
+} MosaicTrack;
+
+struct _Mosaic
+{
+  HyScanDB                    *db;
+  gchar                       *project_name;
+  gchar                       *path;
+  gchar                       *state_file;
+  gdouble                      resolution;
+  guint                        nav_channel;
+  gdouble                      sound_velocity;
+
+  GKeyFile                    *state;          /* Начало координат и число обработанных строк. */
+  gboolean                     has_origin;
+  gdouble                      lat0;
+  gdouble                      lon0;
+  gdouble                      meters_per_lat;
+  gdouble                      meters_per_lon;
+
+  GHashTable                  *tracks;         /* Галсы проекта MosaicTrack. */
+
+  GMutex                       lock;           /* Блокировка таблицы тайлов. */
+  GHashTable                  *tiles;          /* Тайлы в памяти MosaicTile. */
+  GQueue                       lru;            /* Тайлы в порядке использования. */
+
+  GThreadPool                 *pool;           /* Потоки обработки тайлов. */
+  GMutex                       task_lock;
+  GCond                        task_cond;
+  guint                        n_tasks;        /* Число невыполненных заданий. */
+};
+
+/* Функция выполняет деление с округлением вниз. */
+static inline gint
+mosaic_floor_div (gint a,
+                  gint b)
+{
+  return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+/* Функция формирует ключ для номеров тайла. */
+static inline gint64
+mosaic_xy_key (gint x,
+               gint y)
+{
+  return ((gint64) x << 32) | (guint32) y;
+}
+
+/* Функция создаёт копию ключа для таблицы. */
+static gint64 *
+mosaic_xy_key_dup (gint64 key)
+{
+  gint64 *copy = g_new (gint64, 1);
+
+  *copy = key;
+
+  return copy;
+}
+
+static void
+mosaic_tile_free (MosaicTile *tile)
+{
+  g_free (tile->sum);
+  g_free (tile->key);
+  g_free (tile);
+}
+
+/* Функция сохраняет изменения тайла в файл. */
+static void
+mosaic_tile_flush (Mosaic     *mosaic,
+                   MosaicTile *tile)
+{
+  gchar *file;
+
+  if (!tile->dirty)
+    return;
+
+  file = g_build_filename (mosaic->path, tile->key, NULL);
+  if (g_file_set_contents (file, (const gchar *) tile->sum, MOSAIC_TILE_BYTES, NULL))
+    tile->dirty = FALSE;
+  else
+    g_message ("can't save mosaic tile '%s'", file);
+
+  g_free (file);
+}
+
+/* Функция удаляет из памяти давно использованные тайлы сверх допустимого
+ * числа. Функция вызывается с захваченной блокировкой таблицы тайлов. */
+static void
+mosaic_trim (Mosaic *mosaic)
+{
+  GList *link = mosaic->lru.tail;
+
+  while ((link != NULL) && (mosaic->lru.length > MOSAIC_MAX_TILES))
+    {
+      MosaicTile *tile = link->data;
+      GList *prev = link->prev;
+
+      if (tile->pinned == 0)
+        {
+          mosaic_tile_flush (mosaic, tile);
+          g_queue_delete_link (&mosaic->lru, link);
+          g_hash_table_remove (mosaic->tiles, tile->key);
+        }
+
+      link = prev;
+    }
+}
+
+/* Функция возвращает тайл из памяти или загружает его из файла. Если файла
+ * нет и create равен TRUE, создаётся пустой тайл. Функция вызывается
+ * с захваченной блокировкой таблицы тайлов. */
+static MosaicTile *
+mosaic_tile_get (Mosaic   *mosaic,
+                 guint     level,
+                 gint      x,
+                 gint      y,
+                 gboolean  create)
+{
+  MosaicTile *tile;
+  GMappedFile *mapped;
+  gchar *key;
+  gchar *file;
+  gboolean loaded = FALSE;
+
+  key = g_strdup_printf ("%u_%d_%d.tile", level, x, y);
+
+  tile = g_hash_table_lookup (mosaic->tiles, key);
+  if (tile != NULL)
+    {
+      g_free (key);
+      g_queue_unlink (&mosaic->lru, tile->link);
+      g_queue_push_head_link (&mosaic->lru, tile->link);
+      return tile;
+    }
+
+  tile = g_new0 (MosaicTile, 1);
+  tile->level = level;
+  tile->x = x;
+  tile->y = y;
+  tile->key = key;
+  tile->sum = g_malloc0 (MOSAIC_TILE_BYTES);
+  tile->weight = tile->sum + MOSAIC_TILE_POINTS;
+
+  file = g_build_filename (mosaic->path, key, NULL);
+  mapped = g_mapped_file_new (file, FALSE, NULL);
+  if (mapped != NULL)
+    {
+      if (g_mapped_file_get_length (mapped) == MOSAIC_TILE_BYTES)
+        {
+          memcpy (tile->sum, g_mapped_file_get_contents (mapped), MOSAIC_TILE_BYTES);
+          loaded = TRUE;
+        }
+      g_mapped_file_unref (mapped);
+    }
+  g_free (file);
+
+  if (!loaded && !create)
+    {
+      mosaic_tile_free (tile);
+      return NULL;
+    }
+
+  g_hash_table_insert (mosaic->tiles, tile->key, tile);
+  g_queue_push_head (&mosaic->lru, tile);
+  tile->link = mosaic->lru.head;
+
+  return tile;
+}
+
+/* Функция обработки тайла в пуле потоков. */
+static void
+mosaic_task_run (MosaicTask *task,
+                 Mosaic     *mosaic)
+{
+  MosaicTile *tile = task->tile;
+  guint i, j, q;
+
+  if (task->splats != NULL)
+    {
+      for (i = 0; i < task->splats->len; i++)
+        {
+          MosaicSplat *splat = &g_array_index (task->splats, MosaicSplat, i);
+
+          tile->sum[splat->offset] += splat->value;
+          tile->weight[splat->offset] += 1.0f;
+        }
+    }
+  else
+    {
+      const guint half = MOSAIC_TILE_SIZE / 2;
+
+      for (q = 0; q < 4; q++)
+        {
+          MosaicTile *child = task->children[q];
+          guint qx = (q & 1) * half;
+          guint qy = (q >> 1) * half;
+
+          for (j = 0; j < half; j++)
+            for (i = 0; i < half; i++)
+              {
+                guint offset = (qy + j) * MOSAIC_TILE_SIZE + qx + i;
+                guint c0 = 2 * j * MOSAIC_TILE_SIZE + 2 * i;
+                guint c1 = c0 + MOSAIC_TILE_SIZE;
+
+                if (child == NULL)
+                  {
+                    tile->sum[offset] = 0.0f;
+                    tile->weight[offset] = 0.0f;
+                    continue;
+                  }
+
+                tile->sum[offset] = child->sum[c0] + child->sum[c0 + 1] +
+                                    child->sum[c1] + child->sum[c1 + 1];
+                tile->weight[offset] = child->weight[c0] + child->weight[c0 + 1] +
+                                       child->weight[c1] + child->weight[c1 + 1];
+              }
+        }
+    }
+
+  tile->dirty = TRUE;
+
+  g_mutex_lock (&mosaic->task_lock);
+  if (--mosaic->n_tasks == 0)
+    g_cond_signal (&mosaic->task_cond);
+  g_mutex_unlock (&mosaic->task_lock);
+}
+
+/* Функция выполняет задания в пуле потоков, дожидается их завершения
+ * и освобождает задания. */
+static void
+mosaic_run_tasks (Mosaic    *mosaic,
+                  GPtrArray *tasks)
+{
+  guint i, q;
+
+  if (tasks->len == 0)
+    return;
+
+  mosaic->n_tasks = tasks->len;
+  for (i = 0; i < tasks->len; i++)
+    g_thread_pool_push (mosaic->pool, tasks->pdata[i], NULL);
+
+  g_mutex_lock (&mosaic->task_lock);
+  while (mosaic->n_tasks > 0)
+    g_cond_wait (&mosaic->task_cond, &mosaic->task_lock);
+  g_mutex_unlock (&mosaic->task_lock);
+
+  g_mutex_lock (&mosaic->lock);
+  for (i = 0; i < tasks->len; i++)
+    {
+      MosaicTask *task = tasks->pdata[i];
+
+      task->tile->pinned -= 1;
+      for (q = 0; q < 4; q++)
+        if (task->children[q] != NULL)
+          task->children[q]->pinned -= 1;
+
+      g_clear_pointer (&task->splats, g_array_unref);
+      g_free (task);
+    }
+  mosaic_trim (mosaic);
+  g_mutex_unlock (&mosaic->lock);
+
+  g_ptr_array_set_size (tasks, 0);
+}
+
+/* Функция добавляет отсчёты в тайлы нулевого уровня. Возвращает
+ * множество номеров изменённых тайлов. */
+static GHashTable *
+mosaic_apply_splats (Mosaic     *mosaic,
+                     GHashTable *buckets)
+{
+  GHashTable *dirty;
+  GHashTableIter iter;
+  GPtrArray *tasks;
+  gpointer key, value;
+
+  dirty = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+  tasks = g_ptr_array_new ();
+
+  g_hash_table_iter_init (&iter, buckets);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      gint64 xy = *(gint64 *) key;
+      MosaicTask *task = g_new0 (MosaicTask, 1);
+
+      g_mutex_lock (&mosaic->lock);
+      task->tile = mosaic_tile_get (mosaic, 0, xy >> 32, (gint32) xy, TRUE);
+      task->tile->pinned += 1;
+      g_mutex_unlock (&mosaic->lock);
+
+      task->splats = g_array_ref (value);
+      g_ptr_array_add (tasks, task);
+      g_hash_table_add (dirty, mosaic_xy_key_dup (xy));
+
+      if (tasks->len == MOSAIC_BATCH_TILES)
+        mosaic_run_tasks (mosaic, tasks);
+    }
+
+  mosaic_run_tasks (mosaic, tasks);
+  g_ptr_array_unref (tasks);
+
+  return dirty;
+}
+
+/* Функция пересобирает тайлы уровня level, покрывающие изменённые тайлы
+ * предыдущего уровня. Возвращает множество номеров изменённых тайлов. */
+static GHashTable *
+mosaic_build_level (Mosaic     *mosaic,
+                    guint       level,
+                    GHashTable *child_dirty)
+{
+  GHashTable *dirty;
+  GHashTableIter iter;
+  GPtrArray *tasks;
+  gpointer key;
+
+  dirty = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+
+  g_hash_table_iter_init (&iter, child_dirty);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      gint64 xy = *(gint64 *) key;
+      gint64 parent = mosaic_xy_key (mosaic_floor_div (xy >> 32, 2), mosaic_floor_div ((gint32) xy, 2));
+
+      if (!g_hash_table_contains (dirty, &parent))
+        g_hash_table_add (dirty, mosaic_xy_key_dup (parent));
+    }
+
+  tasks = g_ptr_array_new ();
+
+  g_hash_table_iter_init (&iter, dirty);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      gint64 xy = *(gint64 *) key;
+      gint x = xy >> 32;
+      gint y = (gint32) xy;
+      MosaicTask *task = g_new0 (MosaicTask, 1);
+      guint q;
+
+      g_mutex_lock (&mosaic->lock);
+      task->tile = mosaic_tile_get (mosaic, level, x, y, TRUE);
+      task->tile->pinned += 1;
+      for (q = 0; q < 4; q++)
+        {
+          task->children[q] = mosaic_tile_get (mosaic, level - 1, 2 * x + (q & 1), 2 * y + (q >> 1), FALSE);
+          if (task->children[q] != NULL)
+            task->children[q]->pinned += 1;
+        }
+      g_mutex_unlock (&mosaic->lock);
+
+      g_ptr_array_add (tasks, task);
+      if (tasks->len == MOSAIC_BATCH_TILES / 4)
+        mosaic_run_tasks (mosaic, tasks);
+    }
+
+  mosaic_run_tasks (mosaic, tasks);
+  g_ptr_array_unref (tasks);
+
+  return dirty;
+}
+
+/* Функция устанавливает начало местной системы координат. */
+static void
+mosaic_set_origin (Mosaic  *mosaic,
+                   gdouble  lat,
+                   gdouble  lon)
+{
+  mosaic->has_origin = TRUE;
+  mosaic->lat0 = lat;
+  mosaic->lon0 = lon;
+  mosaic->meters_per_lat = MOSAIC_EARTH_RADIUS * G_PI / 180.0;
+  mosaic->meters_per_lon = mosaic->meters_per_lat * cos (lat * G_PI / 180.0);
+}
+
+/* Функция распределяет отсчёты строки по тайлам. */
+static void
+mosaic_splat_line (Mosaic                      *mosaic,
+                   GHashTable                  *buckets,
+                   const NavPoint              *point,
+                   const HyScanAntennaPosition *antenna,
+                   gdouble                      side,
+                   gdouble                      sample_step,
+                   const gfloat                *values,
+                   guint32                      n_values)
+{
+  gdouble heading = point->heading * G_PI / 180.0;
+  gdouble forward_e = sin (heading);
+  gdouble forward_n = cos (heading);
+  gdouble right_e = cos (heading);
+  gdouble right_n = -sin (heading);
+  gdouble step = MIN (sample_step, mosaic->resolution / 2.0);
+  gdouble e0, n0;
+  GArray *splats = NULL;
+  gint64 prev_key = 0;
+  guint n_steps;
+  guint k;
+
+  /* Местоположение антенны. */
+  e0 = (point->lon - mosaic->lon0) * mosaic->meters_per_lon;
+  n0 = (point->lat - mosaic->lat0) * mosaic->meters_per_lat;
+  e0 += forward_e * antenna->x + right_e * antenna->y;
+  n0 += forward_n * antenna->x + right_n * antenna->y;
+
+  n_steps = n_values * sample_step / step;
+  for (k = 0; k < n_steps; k++)
+    {
+      MosaicSplat splat;
+      gdouble range = k * step;
+      guint32 i = range / sample_step;
+      gint gx, gy, tx, ty;
+      gint64 key;
+
+      if (i >= n_values)
+        break;
+
+      gx = floor ((e0 + side * right_e * range) / mosaic->resolution);
+      gy = floor (-(n0 + side * right_n * range) / mosaic->resolution);
+      tx = mosaic_floor_div (gx, MOSAIC_TILE_SIZE);
+      ty = mosaic_floor_div (gy, MOSAIC_TILE_SIZE);
+      key = mosaic_xy_key (tx, ty);
+
+      if ((splats == NULL) || (key != prev_key))
+        {
+          splats = g_hash_table_lookup (buckets, &key);
+          if (splats == NULL)
+            {
+              splats = g_array_new (FALSE, FALSE, sizeof (MosaicSplat));
+              g_hash_table_insert (buckets, mosaic_xy_key_dup (key), splats);
+            }
+          prev_key = key;
+        }
+
+      splat.offset = (gy - ty * MOSAIC_TILE_SIZE) * MOSAIC_TILE_SIZE + (gx - tx * MOSAIC_TILE_SIZE);
+      splat.value = values[i];
+      g_array_append_val (splats, splat);
+    }
+}
+
+/* Функция распределяет по тайлам новые строки галса. Строки, для которых
+ * ещё нет навигационных данных, откладываются до следующего обновления.
+ * Возвращает TRUE, если остались необработанные строки. */
+static gboolean
+mosaic_track_process (Mosaic      *mosaic,
+                      MosaicTrack *track,
+                      GHashTable  *buckets)
+{
+  NavPoint last_point;
+  gboolean more = FALSE;
+  guint n_points;
+  guint s;
+
+  nav_index_update (track->nav, 0);
+  n_points = nav_index_get_n_points (track->nav);
+  if (n_points < 2)
+    return FALSE;
+
+  if (!mosaic->has_origin)
+    {
+      NavPoint first_point;
+
+      nav_index_get_point (track->nav, 0, &first_point);
+      mosaic_set_origin (mosaic, first_point.lat, first_point.lon);
+      g_key_file_set_double (mosaic->state, "origin", "lat", first_point.lat);
+      g_key_file_set_double (mosaic->state, "origin", "lon", first_point.lon);
+    }
+
+  nav_index_get_point (track->nav, n_points - 1, &last_point);
+
+  for (s = 0; s < MOSAIC_N_SOURCES; s++)
+    {
+      HyScanAntennaPosition antenna;
+      HyScanAcousticDataInfo info;
+      guint32 first_index, last_index;
+      guint32 index, end;
+      gdouble sample_step;
+      gboolean pending = FALSE;
+
+      if (track->data[s] == NULL)
+        {
+          track->data[s] = hyscan_acoustic_data_new (mosaic->db, mosaic->project_name,
+                                                     track->name, mosaic_sources[s], FALSE);
+          if (track->data[s] == NULL)
+            continue;
+        }
+
+      if (!hyscan_acoustic_data_get_range (track->data[s], &first_index, &last_index))
+        continue;
+
+      info = hyscan_acoustic_data_get_info (track->data[s]);
+      if (info.data_rate <= 0.0)
+        continue;
+
+      sample_step = mosaic->sound_velocity / (2.0 * info.data_rate);
+      antenna = hyscan_acoustic_data_get_position (track->data[s]);
+
+      /* Все записанные строки уже обработаны. */
+      index = MAX (track->next_index[s], first_index);
+      if (index > last_index)
+        continue;
+
+      end = last_index;
+      if (last_index - index >= MOSAIC_MAX_LINES)
+        {
+          end = index + MOSAIC_MAX_LINES - 1;
+          pending = TRUE;
+        }
+
+      for (; index <= end; index++)
+        {
+          const gfloat *values;
+          guint32 n_values;
+          gint64 time;
+          NavPoint point;
+
+          /* Строка в пределах записанных, но не читается - пропускаем её. */
+          values = hyscan_acoustic_data_get_values (track->data[s], index, &n_values, &time);
+          if (values == NULL)
+            continue;
+
+          /* Навигационные данные для строки ещё не поступили. */
+          if (time > last_point.time)
+            {
+              pending = FALSE;
+              break;
+            }
+
+          if (nav_index_get_position (track->nav, time, &point))
+            {
+              mosaic_splat_line (mosaic, buckets, &point, &antenna, mosaic_sides[s],
+                                 sample_step, values, n_values);
+            }
+        }
+
+      if (index != track->next_index[s])
+        {
+          track->next_index[s] = index;
+          g_key_file_set_int64 (mosaic->state, track->name,
+                                hyscan_source_get_id_by_type (mosaic_sources[s]), index);
+        }
+
+      more |= pending;
+    }
+
+  return more;
+}
+
+static void
+mosaic_track_free (MosaicTrack *track)
+{
+  guint s;
+
+  for (s = 0; s < MOSAIC_N_SOURCES; s++)
+    g_clear_object (&track->data[s]);
+  nav_index_free (track->nav);
+  g_free (track->name);
+  g_free (track);
+}
+
+/* Функция добавляет новые галсы проекта. */
+static void
+mosaic_update_tracks (Mosaic *mosaic)
+{
+  gint32 project_id;
+  gchar **tracks;
+  guint i, s;
+
+  project_id = hyscan_db_project_open (mosaic->db, mosaic->project_name);
+  if (project_id < 0)
+    return;
+
+  tracks = hyscan_db_track_list (mosaic->db, project_id);
+  hyscan_db_close (mosaic->db, project_id);
+
+  for (i = 0; (tracks != NULL) && (tracks[i] != NULL); i++)
+    {
+      MosaicTrack *track;
+
+      if (g_hash_table_contains (mosaic->tracks, tracks[i]))
+        continue;
+
+      track = g_new0 (MosaicTrack, 1);
+      track->name = g_strdup (tracks[i]);
+      track->nav = nav_index_new (mosaic->db, mosaic->project_name, track->name, mosaic->nav_channel);
+
+      for (s = 0; s < MOSAIC_N_SOURCES; s++)
+        {
+          track->next_index[s] = g_key_file_get_int64 (mosaic->state, track->name,
+                                                       hyscan_source_get_id_by_type (mosaic_sources[s]),
+                                                       NULL);
+        }
+
+      g_hash_table_insert (mosaic->tracks, track->name, track);
+    }
+
+  g_strfreev (tracks);
+}
+
+/* Функция сохраняет изменённые тайлы и состояние построения. Состояние
+ * сохраняется после тайлов, поэтому после перезапуска строки не будут
+ * добавлены в мозаику повторно. */
+static void
+mosaic_save (Mosaic *mosaic)
+{
+  GError *error = NULL;
+  GList *link;
+
+  g_mutex_lock (&mosaic->lock);
+  for (link = mosaic->lru.head; link != NULL; link = link->next)
+    mosaic_tile_flush (mosaic, link->data);
+  g_mutex_unlock (&mosaic->lock);
+
+  if (!g_key_file_save_to_file (mosaic->state, mosaic->state_file, &error))
+    {
+      g_message ("can't save mosaic state: %s", error->message);
+      g_error_free (error);
+    }
+}
+
+/* Функция удаляет файлы тайлов из каталога мозаики. */
+static void
+mosaic_remove_tiles (Mosaic *mosaic)
+{
+  const gchar *name;
+  GDir *dir;
+
+  if ((dir = g_dir_open (mosaic->path, 0, NULL)) == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      gchar *file;
+
+      if (!g_str_has_suffix (name, ".tile"))
+        continue;
+
+      file = g_build_filename (mosaic->path, name, NULL);
+      g_remove (file);
+      g_free (file);
+    }
+
+  g_dir_close (dir);
+}
+
+Mosaic *
+mosaic_new (HyScanDB    *db,
+            const gchar *project_name,
+            const gchar *path,
+            gdouble      resolution,
+            guint        nav_channel,
+            gdouble      sound_velocity)
+{
+  Mosaic *mosaic;
+
+  if (g_mkdir_with_parents (path, 0755) != 0)
+    {
+      g_message ("can't create mosaic directory '%s'", path);
+      return NULL;
+    }
+
+  mosaic = g_new0 (Mosaic, 1);
+  mosaic->db = g_object_ref (db);
+  mosaic->project_name = g_strdup (project_name);
+  mosaic->path = g_strdup (path);
+  mosaic->state_file = g_build_filename (path, MOSAIC_STATE_FILE, NULL);
+  mosaic->resolution = (resolution > 0.0) ? resolution : 0.5;
+  mosaic->nav_channel = nav_channel;
+  mosaic->sound_velocity = sound_velocity;
+
+  mosaic->state = g_key_file_new ();
+  g_key_file_load_from_file (mosaic->state, mosaic->state_file, G_KEY_FILE_NONE, NULL);
+
+  /* Мозаика с другим разрешением строится заново. */
+  if (g_key_file_get_double (mosaic->state, "mosaic", "resolution", NULL) != mosaic->resolution)
+    {
+      mosaic_remove_tiles (mosaic);
+      g_key_file_unref (mosaic->state);
+      mosaic->state = g_key_file_new ();
+      g_key_file_set_double (mosaic->state, "mosaic", "resolution", mosaic->resolution);
+    }
+  else if (g_key_file_has_group (mosaic->state, "origin"))
+    {
+      mosaic_set_origin (mosaic,
+                         g_key_file_get_double (mosaic->state, "origin", "lat", NULL),
+                         g_key_file_get_double (mosaic->state, "origin", "lon", NULL));
+    }
+
+  mosaic->tracks = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) mosaic_track_free);
+  mosaic->tiles = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) mosaic_tile_free);
+  g_queue_init (&mosaic->lru);
+  g_mutex_init (&mosaic->lock);
+  g_mutex_init (&mosaic->task_lock);
+  g_cond_init (&mosaic->task_cond);
+
+  mosaic->pool = g_thread_pool_new ((GFunc) mosaic_task_run, mosaic, g_get_num_processors (), FALSE, NULL);
+
+  return mosaic;
+}
+
+gboolean
+mosaic_update (Mosaic *mosaic)
+{
+  GHashTable *buckets;
+  GHashTable *dirty;
+  GHashTableIter iter;
+  gpointer value;
+  gboolean more = FALSE;
+  guint level;
+
+  mosaic_update_tracks (mosaic);
+
+  buckets = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, (GDestroyNotify) g_array_unref);
+
+  g_hash_table_iter_init (&iter, mosaic->tracks);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    more |= mosaic_track_process (mosaic, value, buckets);
+
+  if (g_hash_table_size (buckets) > 0)
+    {
+      dirty = mosaic_apply_splats (mosaic, buckets);
+
+      for (level = 1; level < MOSAIC_N_LEVELS; level++)
+        {
+          GHashTable *parents = mosaic_build_level (mosaic, level, dirty);
+
+          g_hash_table_unref (dirty);
+          dirty = parents;
+        }
+
+      g_hash_table_unref (dirty);
+    }
+
+  g_hash_table_unref (buckets);
+
+  mosaic_save (mosaic);
+
+  return more;
+}
+
+gboolean
+mosaic_get_tile (Mosaic *mosaic,
+                 guint   level,
+                 gint    x,
+                 gint    y,
+                 gfloat *values)
+{
+  MosaicTile *tile;
+  guint i;
+
+  if (level >= MOSAIC_N_LEVELS)
+    return FALSE;
+
+  g_mutex_lock (&mosaic->lock);
+
+  tile = mosaic_tile_get (mosaic, level, x, y, FALSE);
+  if (tile != NULL)
+    {
+      for (i = 0; i < MOSAIC_TILE_POINTS; i++)
+        values[i] = (tile->weight[i] > 0.0f) ? tile->sum[i] / tile->weight[i] : NAN;
+
+      mosaic_trim (mosaic);
+    }
+
+  g_mutex_unlock (&mosaic->lock);
+
+  return (tile != NULL);
+}
+
+void
+mosaic_free (Mosaic *mosaic)
+{
+  g_thread_pool_free (mosaic->pool, TRUE, TRUE);
+
+  mosaic_save (mosaic);
+
+  g_queue_clear (&mosaic->lru);
+  g_hash_table_unref (mosaic->tiles);
+  g_hash_table_unref (mosaic->tracks);
+  g_mutex_clear (&mosaic->lock);
+  g_mutex_clear (&mosaic->task_lock);
+  g_cond_clear (&mosaic->task_cond);
+
+  g_key_file_unref (mosaic->state);
+  g_free (mosaic->state_file);
+  g_free (mosaic->path);
+  g_free (mosaic->project_name);
+  g_object_unref (mosaic->db);
+  g_free (mosaic);
+}
@@ -0,0 +1,46 @@
+#ifndef __MOSAIC_H__
+#define __MOSAIC_H__
+
+#include <hyscan-db.h>
+
+#define MOSAIC_TILE_SIZE               256             /* Размер стороны тайла, точки. */
+#define MOSAIC_N_LEVELS                8               /* Число уровней детализации. */
+
+/* Мозаика гидролокационных изображений проекта. Каждая строка данных
+ * бортов привязывается к местности по навигационным данным галса и
+ * местоположению антенны и накапливается в растре, разбитом на тайлы.
+ * Каждый следующий уровень детализации имеет вдвое меньшее разрешение.
+ * Тайлы хранятся в файлах каталога мозаики, в памяти находится ограниченное
+ * число последних использованных тайлов. Растр строится в местной
+ * прямоугольной системе координат с началом в первой навигационной отметке
+ * проекта, север направлен вверх. */
+typedef struct _Mosaic Mosaic;
+
+/* Функция создаёт мозаику проекта в каталоге path. Если каталог содержит
+ * ранее построенную мозаику, её построение продолжается. Разрешение
+ * resolution задаётся для нулевого уровня в метрах на точку. */
+Mosaic        *mosaic_new              (HyScanDB                      *db,
+                                        const gchar                   *project_name,
+                                        const gchar                   *path,
+                                        gdouble                        resolution,
+                                        guint                          nav_channel,
+                                        gdouble                        sound_velocity);
+
+/* Функция добавляет в мозаику новые данные всех галсов проекта. Тайлы
+ * обрабатываются параллельно. Возвращает TRUE, если остались
+ * необработанные данные. */
+gboolean       mosaic_update           (Mosaic                        *mosaic);
+
+/* Функция копирует значения тайла в массив values размером
+ * MOSAIC_TILE_SIZE * MOSAIC_TILE_SIZE. Точки без данных имеют значение NAN.
+ * Возвращает FALSE, если тайл не содержит данных. */
+gboolean       mosaic_get_tile         (Mosaic                        *mosaic,
+                                        guint                          level,
+                                        gint                           x,
+                                        gint                           y,
+                                        gfloat                        *values);
+
+/* Функция освобождает мозаику. */
+void           mosaic_free             (Mosaic                        *mosaic);
+
+#endif /* __MOSAIC_H__ */
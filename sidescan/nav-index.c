@@ -0,0 +1,480 @@
+#include "nav-index.h"
+
+#include <hyscan-core-types.h>
+#include <string.h>
+#include <math.h>
+
+#define NAV_INDEX_BUFFER_SIZE          4096            /* Размер буфера для чтения записи. */
+#define NMEA_MAX_FIELDS                16              /* Максимальное число полей строки NMEA. */
+#define NMEA_KNOTS_TO_MS               (1852.0 / 3600.0)
+#define NAV_INDEX_MAX_GAP              10000000        /* Интервал между отметками, после которого путь не накапливается, мкс. */
+#define NAV_INDEX_MIN_DURATION         10000000        /* Минимальная длительность для средней скорости, мкс. */
+#define NAV_INDEX_FILE_MAGIC           0x53534E56      /* Сигнатура файла индекса "SSNV". */
+#define NAV_INDEX_FILE_VERSION         2               /* Версия формата файла индекса. */
+
+/* Заголовок файла индекса. */
+typedef struct
+{
+  guint32                      magic;
+  guint32                      version;
+  guint32                      next_index;
+  guint32                      n_points;
+} NavIndexFileHeader;
+
+struct _NavIndex
+{
+  HyScanDB                    *db;
+  gint32                       project_id;
+  gint32                       track_id;
+  gint32                       channel_id;
+  gchar                       *channel_name;
+
+  guint32                      next_index;     /* Индекс следующей необработанной записи. */
+  gchar                        buffer[NAV_INDEX_BUFFER_SIZE];
+
+  GMutex                       lock;
+  GArray                      *points;         /* Навигационные отметки NavPoint, упорядоченные по времени. */
+};
+
+/* Функция проверяет контрольную сумму строки NMEA. */
+static gboolean
+nmea_check (const gchar *sentence,
+            gsize        size)
+{
+  guint8 checksum = 0;
+  gint high, low;
+  gsize i;
+
+  if ((size < 4) || (sentence[0] != '$'))
+    return FALSE;
+
+  for (i = 1; (i < size) && (sentence[i] != '*'); i++)
+    checksum ^= sentence[i];
+
+  if (i + 2 >= size)
+    return FALSE;
+
+  high = g_ascii_xdigit_value (sentence[i + 1]);
+  low = g_ascii_xdigit_value (sentence[i + 2]);
+  if ((high < 0) || (low < 0))
+    return FALSE;
+
+  return ((high << 4) | low) == checksum;
+}
+
+/* Функция преобразует координату в формате NMEA (ddmm.mmmm) в градусы. */
+static gdouble
+nmea_parse_coord (const gchar *value,
+                  const gchar *hemisphere)
+{
+  gdouble raw = g_ascii_strtod (value, NULL);
+  gdouble degrees = floor (raw / 100.0);
+
+  degrees += (raw - 100.0 * degrees) / 60.0;
+  if ((hemisphere[0] == 'S') || (hemisphere[0] == 'W'))
+    degrees = -degrees;
+
+  return degrees;
+}
+
+/* Функция разбирает строку NMEA RMC. Разделители полей заменяются
+ * в исходном буфере на нули, поэтому копирования строки не требуется. */
+static gboolean
+nmea_parse_rmc (gchar    *sentence,
+                gsize     size,
+                gdouble   prev_heading,
+                NavPoint *point)
+{
+  gchar *fields[NMEA_MAX_FIELDS];
+  guint n_fields = 0;
+  gsize i;
+
+  if (!nmea_check (sentence, size))
+    return FALSE;
+
+  if ((size < 7) || (strncmp (sentence + 3, "RMC,", 4) != 0))
+    return FALSE;
+
+  fields[n_fields++] = sentence;
+  for (i = 0; sentence[i] != '*'; i++)
+    {
+      if (sentence[i] != ',')
+        continue;
+
+      sentence[i] = '\0';
+      if (n_fields < NMEA_MAX_FIELDS)
+        fields[n_fields++] = sentence + i + 1;
+    }
+  sentence[i] = '\0';
+
+  /* Время, статус, широта, долгота, скорость и путевой угол. */
+  if (n_fields < 9)
+    return FALSE;
+  if (fields[2][0] != 'A')
+    return FALSE;
+  if ((fields[3][0] == '\0') || (fields[5][0] == '\0'))
+    return FALSE;
+
+  point->lat = nmea_parse_coord (fields[3], fields[4]);
+  point->lon = nmea_parse_coord (fields[5], fields[6]);
+  point->speed = g_ascii_strtod (fields[7], NULL) * NMEA_KNOTS_TO_MS;
+  point->heading = (fields[8][0] != '\0') ? g_ascii_strtod (fields[8], NULL) : prev_heading;
+
+  return TRUE;
+}
+
+/* Функция разбирает запись канала данных, которая может содержать
+ * несколько строк NMEA, и добавляет навигационные отметки в индекс. */
+static guint
+nav_index_add_record (NavIndex *index,
+                      gchar    *data,
+                      gsize     size,
+                      gint64    time)
+{
+  gchar *end = data + size;
+  gchar *cur = data;
+  guint n_points = 0;
+
+  while (cur < end)
+    {
+      gdouble prev_heading = 0.0;
+      gchar *line_end;
+      NavPoint point;
+
+      cur = memchr (cur, '$', end - cur);
+      if (cur == NULL)
+        break;
+
+      for (line_end = cur + 1; line_end < end; line_end++)
+        if ((*line_end == '\r') || (*line_end == '\n') || (*line_end == '$'))
+          break;
+
+      if (index->points->len > 0)
+        prev_heading = g_array_index (index->points, NavPoint, index->points->len - 1).heading;
+
+      if (nmea_parse_rmc (cur, line_end - cur, prev_heading, &point))
+        {
+          point.time = time;
+
+          point.distance = 0.0;
+
+          /* Индекс упорядочен по времени, повторы и отметки из прошлого пропускаются. */
+          if ((index->points->len == 0) ||
+              (g_array_index (index->points, NavPoint, index->points->len - 1).time < time))
+            {
+              /* Путь - интеграл скорости методом трапеций. На длинных
+               * перерывах в навигации путь не накапливается. */
+              if (index->points->len > 0)
+                {
+                  NavPoint *prev = &g_array_index (index->points, NavPoint, index->points->len - 1);
+                  gint64 dt = time - prev->time;
+
+                  point.distance = prev->distance;
+                  if (dt < NAV_INDEX_MAX_GAP)
+                    point.distance += 0.5 * (prev->speed + point.speed) * (dt / 1e6);
+                }
+
+              g_mutex_lock (&index->lock);
+              g_array_append_val (index->points, point);
+              g_mutex_unlock (&index->lock);
+
+              n_points += 1;
+            }
+        }
+
+      cur = line_end;
+    }
+
+  return n_points;
+}
+
+NavIndex *
+nav_index_new (HyScanDB    *db,
+               const gchar *project_name,
+               const gchar *track_name,
+               guint        channel)
+{
+  NavIndex *index;
+
+  index = g_new0 (NavIndex, 1);
+  index->db = g_object_ref (db);
+  index->project_id = -1;
+  index->track_id = -1;
+  index->channel_id = -1;
+  index->channel_name = g_strdup (hyscan_channel_get_name_by_types (HYSCAN_SOURCE_NMEA_RMC, TRUE, channel));
+  index->points = g_array_new (FALSE, FALSE, sizeof (NavPoint));
+  g_mutex_init (&index->lock);
+
+  index->project_id = hyscan_db_project_open (db, project_name);
+  if (index->project_id >= 0)
+    index->track_id = hyscan_db_track_open (db, index->project_id, track_name);
+
+  return index;
+}
+
+guint
+nav_index_update (NavIndex *index,
+                  guint32   max_reads)
+{
+  guint32 first_index;
+  guint32 last_index;
+  guint n_points = 0;
+  guint32 i;
+
+  if (index->track_id < 0)
+    return 0;
+
+  /* Во время записи канал навигации может появиться не сразу. */
+  if (index->channel_id < 0)
+    {
+      index->channel_id = hyscan_db_channel_open (index->db, index->track_id, index->channel_name);
+      if (index->channel_id < 0)
+        return 0;
+    }
+
+  if (!hyscan_db_channel_get_data_range (index->db, index->channel_id, &first_index, &last_index))
+    return 0;
+
+  if (index->next_index < first_index)
+    index->next_index = first_index;
+
+  if (index->next_index > last_index)
+    return 0;
+
+  if ((max_reads > 0) && (last_index - index->next_index >= max_reads))
+    last_index = index->next_index + max_reads - 1;
+
+  for (i = index->next_index; i <= last_index; i++)
+    {
+      guint32 size = sizeof (index->buffer);
+      gint64 time;
+
+      if (!hyscan_db_channel_get_data (index->db, index->channel_id, i, index->buffer, &size, &time))
+        continue;
+
+      n_points += nav_index_add_record (index, index->buffer, MIN (size, sizeof (index->buffer)), time);
+    }
+
+  index->next_index = last_index + 1;
+
+  return n_points;
+}
+
+guint
+nav_index_get_n_points (NavIndex *index)
+{
+  guint n_points;
+
+  g_mutex_lock (&index->lock);
+  n_points = index->points->len;
+  g_mutex_unlock (&index->lock);
+
+  return n_points;
+}
+
+gboolean
+nav_index_get_point (NavIndex *index,
+                     guint     n,
+                     NavPoint *point)
+{
+  gboolean status = FALSE;
+
+  g_mutex_lock (&index->lock);
+  if (n < index->points->len)
+    {
+      *point = g_array_index (index->points, NavPoint, n);
+      status = TRUE;
+    }
+  g_mutex_unlock (&index->lock);
+
+  return status;
+}
+
+gboolean
+nav_index_get_position (NavIndex *index,
+                        gint64    time,
+                        NavPoint *point)
+{
+  NavPoint *points;
+  NavPoint *p0, *p1;
+  gboolean status = FALSE;
+  guint low, high;
+  gdouble k, delta;
+
+  g_mutex_lock (&index->lock);
+
+  points = (NavPoint *) index->points->data;
+  if ((index->points->len == 0) ||
+      (time < points[0].time) ||
+      (time > points[index->points->len - 1].time))
+    {
+      goto exit;
+    }
+
+  /* Последняя отметка с временем не больше заданного. */
+  low = 0;
+  high = index->points->len - 1;
+  while (low < high)
+    {
+      guint mid = low + (high - low + 1) / 2;
+
+      if (points[mid].time <= time)
+        low = mid;
+      else
+        high = mid - 1;
+    }
+
+  p0 = &points[low];
+  if (p0->time == time)
+    {
+      *point = *p0;
+      status = TRUE;
+      goto exit;
+    }
+
+  /* Линейная интерполяция, углы - с учётом перехода через 360 градусов. */
+  p1 = &points[low + 1];
+  k = (gdouble) (time - p0->time) / (gdouble) (p1->time - p0->time);
+
+  point->time = time;
+  point->lat = p0->lat + k * (p1->lat - p0->lat);
+  point->speed = p0->speed + k * (p1->speed - p0->speed);
+  point->distance = p0->distance + k * (p1->distance - p0->distance);
+
+  delta = p1->lon - p0->lon;
+  if (delta > 180.0)
+    delta -= 360.0;
+  else if (delta < -180.0)
+    delta += 360.0;
+  point->lon = p0->lon + k * delta;
+  if (point->lon > 180.0)
+    point->lon -= 360.0;
+  else if (point->lon < -180.0)
+    point->lon += 360.0;
+
+  delta = p1->heading - p0->heading;
+  if (delta > 180.0)
+    delta -= 360.0;
+  else if (delta < -180.0)
+    delta += 360.0;
+  point->heading = fmod (p0->heading + k * delta + 360.0, 360.0);
+
+  status = TRUE;
+
+exit:
+  g_mutex_unlock (&index->lock);
+
+  return status;
+}
+
+gboolean
+nav_index_get_mean_speed (NavIndex *index,
+                          gdouble  *speed)
+{
+  NavPoint *first, *last;
+  gboolean status = FALSE;
+
+  g_mutex_lock (&index->lock);
+
+  if (index->points->len > 1)
+    {
+      first = &g_array_index (index->points, NavPoint, 0);
+      last = &g_array_index (index->points, NavPoint, index->points->len - 1);
+      if ((last->time - first->time >= NAV_INDEX_MIN_DURATION) && (last->distance > first->distance))
+        {
+          *speed = (last->distance - first->distance) / ((last->time - first->time) / 1e6);
+          status = TRUE;
+        }
+    }
+
+  g_mutex_unlock (&index->lock);
+
+  return status;
+}
+
+gboolean
+nav_index_save (NavIndex    *index,
+                const gchar *path)
+{
+  NavIndexFileHeader header;
+  GError *error = NULL;
+  gchar *data;
+  gsize size;
+  gboolean status;
+
+  g_mutex_lock (&index->lock);
+
+  header.magic = NAV_INDEX_FILE_MAGIC;
+  header.version = NAV_INDEX_FILE_VERSION;
+  header.next_index = index->next_index;
+  header.n_points = index->points->len;
+
+  size = sizeof (header) + header.n_points * sizeof (NavPoint);
+  data = g_malloc (size);
+  memcpy (data, &header, sizeof (header));
+  memcpy (data + sizeof (header), index->points->data, header.n_points * sizeof (NavPoint));
+
+  g_mutex_unlock (&index->lock);
+
+  status = g_file_set_contents (path, data, size, &error);
+  if (!status)
+    {
+      g_message ("can't save navigation index: %s", error->message);
+      g_error_free (error);
+    }
+
+  g_free (data);
+
+  return status;
+}
+
+gboolean
+nav_index_load (NavIndex    *index,
+                const gchar *path)
+{
+  NavIndexFileHeader header;
+  gchar *data;
+  gsize size;
+
+  if (!g_file_get_contents (path, &data, &size, NULL))
+    return FALSE;
+
+  if (size >= sizeof (header))
+    memcpy (&header, data, sizeof (header));
+
+  if ((size < sizeof (header)) ||
+      (header.magic != NAV_INDEX_FILE_MAGIC) ||
+      (header.version != NAV_INDEX_FILE_VERSION) ||
+      (size != sizeof (header) + header.n_points * sizeof (NavPoint)))
+    {
+      g_free (data);
+      return FALSE;
+    }
+
+  g_mutex_lock (&index->lock);
+  g_array_set_size (index->points, 0);
+  g_array_append_vals (index->points, data + sizeof (header), header.n_points);
+  index->next_index = header.next_index;
+  g_mutex_unlock (&index->lock);
+
+  g_free (data);
+
+  return TRUE;
+}
+
+void
+nav_index_free (NavIndex *index)
+{
+  if (index->channel_id >= 0)
+    hyscan_db_close (index->db, index->channel_id);
+  if (index->track_id >= 0)
+    hyscan_db_close (index->db, index->track_id);
+  if (index->project_id >= 0)
+    hyscan_db_close (index->db, index->project_id);
+
+  g_object_unref (index->db);
+  g_array_unref (index->points);
+  g_mutex_clear (&index->lock);
+  g_free (index->channel_name);
+  g_free (index);
+}
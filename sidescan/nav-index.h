@@ -0,0 +1,70 @@
+#ifndef __NAV_INDEX_H__
+#define __NAV_INDEX_H__
+
+#include <hyscan-db.h>
+
+/* Навигационная отметка. */
+typedef struct
+{
+  gint64                       time;           /* Время приёма данных, мкс. */
+  gdouble                      lat;            /* Широта, градусы. */
+  gdouble                      lon;            /* Долгота, градусы. */
+  gdouble                      heading;        /* Путевой угол, градусы. */
+  gdouble                      speed;          /* Скорость относительно грунта, м/с. */
+  gdouble                      distance;       /* Путь от начала галса, м. */
+} NavPoint;
+
+/* Навигационный индекс галса. Строки NMEA RMC из канала данных галса
+ * разбираются один раз при поступлении и хранятся в компактном виде,
+ * упорядоченном по времени. Для каждой отметки вычисляется путь от начала
+ * галса интегрированием скорости относительно грунта. */
+typedef struct _NavIndex NavIndex;
+
+/* Функция создаёт навигационный индекс для канала NMEA RMC галса. */
+NavIndex      *nav_index_new           (HyScanDB                      *db,
+                                        const gchar                   *project_name,
+                                        const gchar                   *track_name,
+                                        guint                          channel);
+
+/* Функция разбирает записи, добавленные в канал данных с момента
+ * последнего вызова, но не более max_reads записей (0 - без ограничения).
+ * Оставшиеся записи разбираются при следующих вызовах. Возвращает число
+ * новых навигационных отметок. */
+guint          nav_index_update        (NavIndex                      *index,
+                                        guint32                        max_reads);
+
+/* Функция возвращает число навигационных отметок. */
+guint          nav_index_get_n_points  (NavIndex                      *index);
+
+/* Функция возвращает навигационную отметку с указанным номером. */
+gboolean       nav_index_get_point     (NavIndex                      *index,
+                                        guint                          n,
+                                        NavPoint                      *point);
+
+/* Функция определяет местоположение на указанный момент времени
+ * интерполяцией между ближайшими отметками. Поиск отметок выполняется
+ * двоичным поиском. Возвращает FALSE, если время вне диапазона данных. */
+gboolean       nav_index_get_position  (NavIndex                      *index,
+                                        gint64                         time,
+                                        NavPoint                      *point);
+
+/* Функция возвращает среднюю скорость на галсе - путь, делённый на время
+ * между первой и последней отметками. Возвращает FALSE, если отметок
+ * недостаточно. */
+gboolean       nav_index_get_mean_speed (NavIndex                     *index,
+                                        gdouble                       *speed);
+
+/* Функция сохраняет навигационные отметки в файл. */
+gboolean       nav_index_save          (NavIndex                      *index,
+                                        const gchar                   *path);
+
+/* Функция загружает навигационные отметки, сохранённые функцией
+ * nav_index_save. Следующий вызов nav_index_update разбирает только
+ * записи, добавленные после сохранения. */
+gboolean       nav_index_load          (NavIndex                      *index,
+                                        const gchar                   *path);
+
+/* Функция освобождает навигационный индекс. */
+void           nav_index_free          (NavIndex                      *index);
+
+#endif /* __NAV_INDEX_H__ */
@@ -0,0 +1,192 @@
+/* Программа формирует при сборке исходный текст таблиц встроенных палитр.
+ * Запуск: palette-gen <выходной файл>. */
+
+#include <stdio.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI                           3.14159265358979323846
+#endif
+
+typedef void (*PaletteGenFunc) (double  l,
+                                double *rgb);
+
+/* Описание встроенной палитры. */
+typedef struct
+{
+  const char                  *id;             /* Идентификатор таблицы. */
+  const char                  *name;           /* Название палитры. */
+  unsigned int                 n_colors;       /* Число цветов. */
+  PaletteGenFunc               func;           /* Функция цвета от яркости 0..1. */
+} PaletteGen;
+
+static void
+gen_white (double  l,
+           double *rgb)
+{
+  rgb[0] = rgb[1] = rgb[2] = l;
+}
+
+static void
+gen_yellow (double  l,
+            double *rgb)
+{
+  rgb[0] = rgb[1] = l;
+  rgb[2] = 0.0;
+}
+
+static void
+gen_green (double  l,
+           double *rgb)
+{
+  rgb[0] = rgb[2] = 0.0;
+  rgb[1] = l;
+}
+
+/* Полиномиальное приближение палитры по коэффициентам c[7][3]. */
+static void
+gen_polynomial (const double  c[7][3],
+                double        l,
+                double       *rgb)
+{
+  int i, j;
+
+  for (j = 0; j < 3; j++)
+    {
+      rgb[j] = c[6][j];
+      for (i = 5; i >= 0; i--)
+        rgb[j] = rgb[j] * l + c[i][j];
+    }
+}
+
+/* Перцептивно равномерная палитра viridis. */
+static void
+gen_viridis (double  l,
+             double *rgb)
+{
+  static const double c[7][3] =
+    {
+      {  0.2777273272234177,  0.005407344544966578,  0.3340998053353061 },
+      {  0.1050930431085774,  1.404613529898575,     1.384590162594685 },
+      { -0.3308618287255563,  0.214847559468213,     0.09509516302823659 },
+      { -4.634230498983486,  -5.799100973351585,   -19.33244095627987 },
+      {  6.228269936347081,  14.17993336680509,     56.69055260068105 },
+      {  4.776384997670288, -13.74514537774601,    -65.35303263337234 },
+      { -5.435455855934631,   4.645852612178535,    26.3124352495832 }
+    };
+
+  gen_polynomial (c, l, rgb);
+}
+
+/* Перцептивно равномерная палитра inferno. */
+static void
+gen_inferno (double  l,
+             double *rgb)
+{
+  static const double c[7][3] =
+    {
+      {   0.0002189403691192265,  0.001651004631001012,  -0.01948089843709184 },
+      {   0.1065134194856116,     0.5639564367884091,     3.932712388889277 },
+      {  11.60249308247187,      -3.972853965665698,    -15.9423941062914 },
+      { -41.70399613139459,      17.43639888205313,      44.35414519872813 },
+      {  77.162935699427,       -33.40235894210092,     -81.80730925738993 },
+      { -71.31942824499214,      32.62606426397723,      73.20951985803202 },
+      {  25.13112622477341,     -12.24266895238567,     -23.07032500287172 }
+    };
+
+  gen_polynomial (c, l, rgb);
+}
+
+/* Палитра cubehelix (D. A. Green, 2011) с монотонно растущей яркостью. */
+static void
+gen_cubehelix (double  l,
+               double *rgb)
+{
+  const double start = 0.5;
+  const double rotations = -1.5;
+  const double hue = 1.0;
+  double phi = 2.0 * M_PI * (start / 3.0 + rotations * l);
+  double a = hue * l * (1.0 - l) / 2.0;
+
+  rgb[0] = l + a * (-0.14861 * cos (phi) + 1.78277 * sin (phi));
+  rgb[1] = l + a * (-0.29227 * cos (phi) - 0.90649 * sin (phi));
+  rgb[2] = l + a * (1.97294 * cos (phi));
+}
+
+static const PaletteGen palettes[] =
+{
+  { "white",         "БЕЛАЯ",         256,  gen_white },
+  { "yellow",        "ЖЁЛТАЯ",        256,  gen_yellow },
+  { "green",         "ЗЕЛЁНАЯ",       256,  gen_green },
+  { "viridis",       "VIRIDIS",       256,  gen_viridis },
+  { "inferno",       "INFERNO",       256,  gen_inferno },
+  { "cubehelix",     "CUBEHELIX",     256,  gen_cubehelix },
+  { "white_hdr",     "БЕЛАЯ HDR",     1024, gen_white },
+  { "cubehelix_hdr", "CUBEHELIX HDR", 1024, gen_cubehelix }
+};
+
+static unsigned int
+color_component (double value)
+{
+  if (value < 0.0)
+    value = 0.0;
+  if (value > 1.0)
+    value = 1.0;
+
+  return (unsigned int) (value * 255.0 + 0.5);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  FILE *output;
+  unsigned int i, j;
+
+  if (argc != 2)
+    {
+      fprintf (stderr, "usage: palette-gen <output>\n");
+      return 1;
+    }
+
+  output = fopen (argv[1], "w");
+  if (output == NULL)
+    {
+      fprintf (stderr, "can't create '%s'\n", argv[1]);
+      return 1;
+    }
+
+  fprintf (output, "/* Файл сформирован программой palette-gen. */\n\n");
+  fprintf (output, "#include \"palette.h\"\n");
+
+  for (i = 0; i < sizeof (palettes) / sizeof (palettes[0]); i++)
+    {
+      fprintf (output, "\nstatic const PALETTE_ALIGNED guint32 palette_%s[%u] =\n{", palettes[i].id, palettes[i].n_colors);
+
+      for (j = 0; j < palettes[i].n_colors; j++)
+        {
+          double rgb[3];
+
+          palettes[i].func ((double) j / (palettes[i].n_colors - 1), rgb);
+          fprintf (output, "%s0xff%02x%02x%02x%s",
+                   (j % 8 == 0) ? "\n  " : " ",
+                   color_component (rgb[0]), color_component (rgb[1]), color_component (rgb[2]),
+                   (j + 1 < palettes[i].n_colors) ? "," : "");
+        }
+
+      fprintf (output, "\n};\n");
+    }
+
+  fprintf (output, "\nconst Palette palette_builtin[] =\n{\n");
+  for (i = 0; i < sizeof (palettes) / sizeof (palettes[0]); i++)
+    fprintf (output, "  { \"%s\", palette_%s, %u },\n", palettes[i].name, palettes[i].id, palettes[i].n_colors);
+  fprintf (output, "};\n\nconst guint palette_n_builtin = G_N_ELEMENTS (palette_builtin);\n");
+
+  if (fclose (output) != 0)
+    {
+      fprintf (stderr, "can't write '%s'\n", argv[1]);
+      return 1;
+    }
+
+  return 0;
+}
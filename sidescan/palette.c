@@ -0,0 +1,175 @@
+#include "palette.h"
+
+#include <string.h>
+
+#define PALETTE_GROUP_PREFIX           "palette:"      /* Префикс группы палитры в конфигурации. */
+#define PALETTE_DEFAULT_SIZE           256             /* Число цветов палитры по умолчанию. */
+#define PALETTE_MAX_SIZE               65536           /* Максимальное число цветов палитры. */
+
+struct _PaletteList
+{
+  GArray                      *palettes;       /* Палитры Palette. */
+  GPtrArray                   *data;           /* Названия и таблицы палитр конфигурации. */
+};
+
+/* Функция разбирает цвет в формате "#rrggbb". */
+static gboolean
+palette_parse_color (gchar       *text,
+                     gdouble     *rgb)
+{
+  guint i;
+
+  text = g_strstrip (text);
+  if ((strlen (text) != 7) || (text[0] != '#'))
+    return FALSE;
+
+  for (i = 0; i < 3; i++)
+    {
+      gint high = g_ascii_xdigit_value (text[1 + 2 * i]);
+      gint low = g_ascii_xdigit_value (text[2 + 2 * i]);
+
+      if ((high < 0) || (low < 0))
+        return FALSE;
+
+      rgb[i] = ((high << 4) | low) / 255.0;
+    }
+
+  return TRUE;
+}
+
+/* Функция вычисляет таблицу палитры линейной интерполяцией
+ * между опорными цветами. */
+static guint32 *
+palette_interpolate (const gdouble *stops,
+                     guint          n_stops,
+                     guint          n_colors)
+{
+  guint32 *colors = g_new (guint32, n_colors);
+  guint i, j;
+
+  for (i = 0; i < n_colors; i++)
+    {
+      gdouble position = (n_colors > 1) ? (gdouble) i * (n_stops - 1) / (n_colors - 1) : 0.0;
+      guint stop = MIN ((guint) position, n_stops - 2);
+      gdouble part = position - stop;
+      guint32 color = 0xff000000;
+
+      for (j = 0; j < 3; j++)
+        {
+          gdouble value = stops[3 * stop + j] * (1.0 - part) + stops[3 * (stop + 1) + j] * part;
+
+          color |= (guint32) (CLAMP (value, 0.0, 1.0) * 255.0 + 0.5) << (16 - 8 * j);
+        }
+
+      colors[i] = color;
+    }
+
+  return colors;
+}
+
+/* Функция добавляет палитру из группы конфигурации. */
+static void
+palette_list_load (PaletteList *list,
+                   GKeyFile    *config,
+                   const gchar *group)
+{
+  Palette palette;
+  gchar **stops_text;
+  gdouble *stops;
+  gsize n_stops, i;
+  gint n_colors = PALETTE_DEFAULT_SIZE;
+
+  stops_text = g_key_file_get_string_list (config, group, "colors", &n_stops, NULL);
+  if ((stops_text == NULL) || (n_stops < 2))
+    {
+      g_message ("palette '%s': at least two colors required", group);
+      g_strfreev (stops_text);
+      return;
+    }
+
+  if (g_key_file_has_key (config, group, "size", NULL))
+    n_colors = g_key_file_get_integer (config, group, "size", NULL);
+  if ((n_colors < 2) || (n_colors > PALETTE_MAX_SIZE))
+    {
+      g_message ("palette '%s': incorrect size", group);
+      g_strfreev (stops_text);
+      return;
+    }
+
+  stops = g_new (gdouble, 3 * n_stops);
+  for (i = 0; i < n_stops; i++)
+    {
+      if (!palette_parse_color (stops_text[i], &stops[3 * i]))
+        {
+          g_message ("palette '%s': incorrect color '%s'", group, stops_text[i]);
+          g_strfreev (stops_text);
+          g_free (stops);
+          return;
+        }
+    }
+
+  palette.name = g_strdup (group + strlen (PALETTE_GROUP_PREFIX));
+  palette.colors = palette_interpolate (stops, n_stops, n_colors);
+  palette.n_colors = n_colors;
+  g_ptr_array_add (list->data, (gpointer) palette.name);
+  g_ptr_array_add (list->data, (gpointer) palette.colors);
+  g_array_append_val (list->palettes, palette);
+
+  g_strfreev (stops_text);
+  g_free (stops);
+}
+
+PaletteList *
+palette_list_new (GKeyFile *config)
+{
+  PaletteList *list;
+  guint i;
+
+  list = g_new0 (PaletteList, 1);
+  list->palettes = g_array_new (FALSE, FALSE, sizeof (Palette));
+  list->data = g_ptr_array_new_with_free_func (g_free);
+
+  g_array_append_vals (list->palettes, palette_builtin, palette_n_builtin);
+
+  if (config != NULL)
+    {
+      gchar **groups = g_key_file_get_groups (config, NULL);
+
+      for (i = 0; groups[i] != NULL; i++)
+        {
+          if (g_str_has_prefix (groups[i], PALETTE_GROUP_PREFIX) &&
+              (groups[i][strlen (PALETTE_GROUP_PREFIX)] != '\0'))
+            {
+              palette_list_load (list, config, groups[i]);
+            }
+        }
+
+      g_strfreev (groups);
+    }
+
+  return list;
+}
+
+guint
+palette_list_get_n (PaletteList *list)
+{
+  return list->palettes->len;
+}
+
+const Palette *
+palette_list_get (PaletteList *list,
+                  guint        n)
+{
+  if (n >= list->palettes->len)
+    return NULL;
+
+  return &g_array_index (list->palettes, Palette, n);
+}
+
+void
+palette_list_free (PaletteList *list)
+{
+  g_array_unref (list->palettes);
+  g_ptr_array_unref (list->data);
+  g_free (list);
+}
@@ -0,0 +1,47 @@
+#ifndef __PALETTE_H__
+#define __PALETTE_H__
+
+#include <glib.h>
+
+/* Выравнивание таблиц палитр по границе строки кэша. */
+#if defined (__GNUC__)
+#define PALETTE_ALIGNED                __attribute__ ((aligned (64)))
+#elif defined (_MSC_VER)
+#define PALETTE_ALIGNED                __declspec (align (64))
+#else
+#define PALETTE_ALIGNED
+#endif
+
+/* Палитра. Цвета задаются в формате ARGB32. */
+typedef struct
+{
+  const gchar                 *name;           /* Название палитры. */
+  const guint32               *colors;         /* Таблица цветов. */
+  guint                        n_colors;       /* Число цветов. */
+} Palette;
+
+/* Встроенные палитры, таблицы которых формируются при сборке. */
+extern const Palette           palette_builtin[];
+extern const guint             palette_n_builtin;
+
+/* Список палитр: встроенные палитры и палитры из файла конфигурации.
+ * Палитра конфигурации задаётся группой "palette:<название>" с ключами
+ * colors - список опорных цветов "#rrggbb" через ";", равномерно
+ * распределённых по палитре, и size - число цветов палитры (по умолчанию 256).
+ * Таблицы палитр конфигурации вычисляются один раз при загрузке. */
+typedef struct _PaletteList PaletteList;
+
+/* Функция создаёт список палитр. Конфигурация config может быть NULL. */
+PaletteList   *palette_list_new        (GKeyFile                      *config);
+
+/* Функция возвращает число палитр. */
+guint          palette_list_get_n      (PaletteList                   *list);
+
+/* Функция возвращает палитру с номером n или NULL. */
+const Palette *palette_list_get        (PaletteList                   *list,
+                                        guint                          n);
+
+/* Функция освобождает список палитр. */
+void           palette_list_free       (PaletteList                   *list);
+
+#endif /* __PALETTE_H__ */
@@ -15,11 +15,65 @@
 #include <hyscan-db-info.h>
 #include <hyscan-cached.h>
 
+#include <string.h>
+#include <math.h>
+
 #include "sonar-configure.h"
+#include "nav-index.h"
+#include "mark-index.h"
+#include "mark-transfer.h"
+#include "mosaic.h"
+#include "coverage.h"
+#include "track-prefetch.h"
+#include "line-monitor.h"
+#include "track-archive.h"
+#include "track-index.h"
+#include "palette.h"
+#include "tone-map.h"
+#include "auto-levels.h"
+#include "detector.h"
+#include "line-stream.h"
+#include "memory-budget.h"
+#include "alloc-track.h"
 
 #define SIDE_SCAN_MAX_DISTANCE         150.0
-#define MAX_COLOR_MAPS                 3
+#define AUTO_TVG_MAX_CPU               25.0            /* Доля процессора для автоматической ВАРУ по умолчанию, %. */
+#define AUTO_TVG_MIN_CPU               5.0             /* Минимальная доля процессора для автоматической ВАРУ, %. */
+#define AUTO_TVG_CPU_STEP              5.0             /* Шаг изменения доли процессора, %. */
+#define AUTO_TVG_CHECK_PERIOD          1000            /* Период проверки загрузки, мс. */
+#define AUTO_TVG_LAG_HIGH              100000          /* Задержка главного цикла, при которой бюджет уменьшается, мкс. */
+#define AUTO_TVG_LAG_LOW               20000           /* Задержка главного цикла, при которой бюджет увеличивается, мкс. */
+#define N_BOARDS                       2
 #define DRY_TRACK_SUFFIX "-dry"
+#define NAV_UPDATE_PERIOD              1000
+#define NAV_MAX_READS                  2000            /* Число записей навигации, разбираемых за одно обновление. */
+#define SYNC_VIEW_PERIOD               100
+#define REPLAY_PERIOD                  40              /* Период обновления при воспроизведении, мс. */
+#define PREFETCH_PERIOD                100             /* Период проверки области просмотра для упреждающего чтения, мс. */
+#define LINES_UPDATE_PERIOD            1000            /* Период контроля записи строк, мс. */
+#define TRACK_INDEX_UPDATE_PERIOD      2000            /* Период проверки результатов индексатора галсов, мс. */
+#define TRACK_INDEX_MAX_TOOLTIP_GAPS   5               /* Число разрывов в подсказке галса. */
+#define TONE_MAP_SIZE                  4096            /* Число цветов палитры сжатия диапазона. */
+#define TONE_MAP_UPDATE_PERIOD         500             /* Период проверки готовности сжатия диапазона, мс. */
+#define AUTO_LEVELS_PERIOD             200             /* Период обновления автоматической яркости, мс. */
+#define TRACK_SPEED_THRESHOLD          0.05            /* Относительное изменение скорости галса для обновления масштаба. */
+#define DETECTOR_UPDATE_PERIOD         1000            /* Период добавления обнаруженных целей в список меток, мс. */
+#define DETECTOR_OPERATOR              "Автоматическое обнаружение"
+#define LINE_SERVER_CHECK_PERIOD       1000            /* Период проверки подключений к серверу строк, мс. */
+#define MEMORY_CHECK_PERIOD            2000            /* Период проверки памяти, мс. */
+#define MEMORY_LOG_PERIOD              300000          /* Период записи памяти подсистем в журнал, мс. */
+#define MEMORY_MIN_CACHE               32              /* Минимальный размер кэша при нехватке памяти, Мб. */
+#define MAX_CHUNK_SIZE                 (G_MAXINT32 / (1024 * 1024)) /* Максимальный размер части файлов данных, Мб. */
+#define TRACK_LIST_ROW_SIZE            256             /* Оценка памяти строки списка галсов, байт. */
+#define SOAK_PERIOD                    500             /* Период обновлений при длительном прогоне, мс. */
+#define SOAK_TRACK_STEP                10              /* Число обновлений между переключениями галса. */
+#define ALLOC_TRACK_PERIOD             600000          /* Период записи выделений памяти в журнал, мс. */
+#define ALLOC_TRACK_N_SITES            20              /* Число мест вызова в журнале. */
+#define MOSAIC_UPDATE_PERIOD           5000000         /* Период обновления мозаики, мкс. */
+#define MOSAIC_STOP_CHECK_PERIOD       100000          /* Период проверки завершения работы, мкс. */
+
+/* Скорости воспроизведения галса относительно скорости судна. */
+static const guint replay_speeds[] = { 1, 2, 5, 10, 20, 50 };
 
 enum
 {
@@ -27,31 +81,79 @@ enum
   TRACK_COLUMN,
   DATE_COLUMN,
   HAS_RAW_DATA_COLUMN,
+  INFO_COLUMN,
   N_COLUMNS
 };
 
+/* Борт гидролокатора. */
+typedef struct
+{
+  HyScanSourceType                     source;
+  const gchar                         *name;
+
+  HyScanDataSchemaEnumValue          **signals;
+  guint                                n_signals;
+} Board;
+
 typedef struct
 {
   HyScanDB                            *db;
   HyScanDBInfo                        *db_info;
+  const gchar                         *db_uri;
+  TrackPrefetch                       *prefetch;
+  LineMonitor                         *lines;
+  TrackIndex                          *track_index;
 
   gchar                               *project_name;
+  GtkComboBoxText                     *project_switch;
+  gint                                 n_tracks;       /* Число галсов проекта, -1 - не определено. */
   gchar                               *track_prefix;
   gchar                               *track_name;
+  gboolean                             track_raw;
   gboolean                             new_track;
 
+  NavIndex                            *nav;
+  guint                                nav_channel;
+
+  Coverage                            *coverage;
+  gdouble                              altitude;
+
+  Mosaic                              *mosaic;
+  GThread                             *mosaic_thread;
+  gint                                 mosaic_stop;
+
   gboolean                             power;
 
   HyScanCache                         *cache;
+  gint                                 cache_size;     /* Размер кэша, Мб. */
+  MemoryBudget                        *memory;
+  GtkLabel                            *memory_value;
+
+  gint64                               soak_end;       /* Время окончания длительного прогона. */
+  guint                                soak_step;
 
   gboolean                             full_screen;
 
-  GArray                              *color_maps[MAX_COLOR_MAPS];
+  PaletteList                         *palettes;
   guint                                cur_color_map;
   gdouble                              cur_brightness;
 
+  ToneMap                             *tone_map;
+  gboolean                             tone_applied;
+
+  AutoLevels                          *auto_levels;
+  gboolean                             auto_applied;
+
+  Detector                            *detector;
+  guint                                n_detected;
+
+  LineServer                          *line_server;
+  guint                                n_line_clients;
+  LineClient                          *line_client;
+
   struct
   {
+    HyScanParam                       *param;
     HyScanSonarControl                *sonar;
     HyScanTVGControl                  *tvg;
     HyScanGeneratorControl            *gen;
@@ -61,18 +163,20 @@ typedef struct
     gdouble                            cur_tvg_level;
     gdouble                            cur_tvg_sensitivity;
 
-    struct
-    {
-      HyScanDataSchemaEnumValue      **signals;
-      guint                            n_signals;
-    } starboard;
-    struct
-    {
-      HyScanDataSchemaEnumValue      **signals;
-      guint                            n_signals;
-    } port;
+    gdouble                            cur_tvg_cpu;
+    gdouble                            min_tvg_cpu;
+    gdouble                            max_tvg_cpu;
+    gint64                             tvg_cpu_check;
+
+    Board                              boards[N_BOARDS];
+
+    SonarProfile                      *profile;
+    gboolean                           profile_failed; /* Профиль применён с ошибкой. */
   } sonar;
 
+  const gchar                         *config_file;
+  GFileMonitor                        *config_monitor;
+
   GtkLabel                            *brightness_value;
   GtkLabel                            *color_map_value;
   GtkLabel                            *scale_value;
@@ -81,8 +185,13 @@ typedef struct
   GtkLabel                            *tvg_level_value;
   GtkLabel                            *tvg_sensitivity_value;
   GtkLabel                            *signal_value;
+  GtkLabel                            *tvg_cpu_value;
+  GtkLabel                            *lines_value;
+  GtkLabel                            *coverage_value;
+  GtkWidget                           *coverage_area;
 
   GtkWidget                           *window;
+  GtkWidget                           *header;
   GtkTreeView                         *track_view;
   GtkTreeModel                        *track_list;
   GtkAdjustment                       *track_range;
@@ -94,17 +203,81 @@ typedef struct
   HyScanGtkWaterfallMark              *wf_mark;
   HyScanGtkWaterfallMeter             *wf_meter;
   GtkSwitch                           *live_view;
+  GtkSwitch                           *tone;
+  GtkSwitch                           *auto_brightness;
+  GtkSwitch                           *detector_switch;
+  GtkLabel                            *detector_value;
+
+  HyScanGtkWaterfall                  *wf_compare;
+  HyScanGtkWaterfallState             *wf_compare_state;
+  GtkWidget                           *wf_compare_overlay;
+  gchar                               *compare_track;
+  GtkSwitch                           *compare;
+  GtkSwitch                           *sync_view;
+  gdouble                              sync_main[4];
+  gdouble                              sync_compare[4];
+
+  struct
+  {
+    guint                              speed;          /* Индекс скорости в replay_speeds. */
+    gdouble                            position;       /* Начало области просмотра вдоль галса, м. */
+    gint64                             last_tick;      /* Время предыдущего обновления, мкс. */
+    guint                              timer;          /* Идентификатор таймера воспроизведения. */
+    gboolean                           update;         /* Признак обновления положения из программы. */
+
+    gint64                             start_time;     /* Время начала воспроизведения, мкс. */
+    gdouble                            start_position; /* Положение в начале воспроизведения, м. */
+    guint                              n_ticks;        /* Число обновлений. */
+    guint                              n_late;         /* Число обновлений с задержкой более периода. */
+  } replay;
+
+  gdouble                              ship_speed;     /* Скорость судна по умолчанию, м/с. */
+  gdouble                              track_speed;    /* Скорость для масштаба вдоль галса, м/с. */
+  GtkSwitch                           *replay_switch;
+  GtkLabel                            *replay_speed_value;
+  GtkAdjustment                       *replay_position;
 
   GtkSwitch                           *start_stop;
   GtkSwitch                           *start_stop_dry;
 
   HyScanMarkManager                   *mman;
+  MarkIndex                           *marks;
   GtkWidget                           *mlist;
   GtkWidget                           *meditor;
 
 } Global;
 
+/* Операция над одним бортом. */
+typedef gboolean (*BoardFunc) (Global     *global,
+                               Board      *board,
+                               gpointer    data);
+
+/* Изменение профиля конфигурации. */
+typedef struct
+{
+  SonarProfile                        *profile;
+  SonarProfile                        *prev;
+} ProfileChange;
+
 static gboolean scale_set (Global *global);
+static void tone_track_set (Global *global);
+
+/* Функция выполняет операцию для всех бортов по очереди. Операция
+ * выполняется для каждого борта, даже если для предыдущего она
+ * завершилась ошибкой. Возвращает TRUE, если операция успешна для всех бортов. */
+static gboolean
+boards_run (Global    *global,
+            BoardFunc  func,
+            gpointer   data)
+{
+  gboolean status = TRUE;
+  guint i;
+
+  for (i = 0; i < N_BOARDS; i++)
+    status = func (global, &global->sonar.boards[i], data) && status;
+
+  return status;
+}
 
 /* Функция изменяет режим окна full screen. */
 static gboolean
@@ -125,6 +298,16 @@ key_press (GtkWidget   *widget,
   return FALSE;
 }
 
+/* Функция проверяет, идёт ли запись галса. */
+static gboolean
+recording (Global *global)
+{
+  if (global->sonar.sonar == NULL)
+    return FALSE;
+
+  return gtk_switch_get_state (global->start_stop) || gtk_switch_get_state (global->start_stop_dry);
+}
+
 /* Функция вызывается при изменении списка проектов. */
 static void
 projects_changed (HyScanDBInfo *db_info,
@@ -132,13 +315,122 @@ projects_changed (HyScanDBInfo *db_info,
 {
   GHashTable *projects = hyscan_db_info_get_projects (db_info);
 
-  /* Если рабочий проект есть в списке, мониторим его. */
+  /* Список проектов для переключения. */
+  if (global->project_switch != NULL)
+    {
+      GList *names, *link;
+
+      g_signal_handlers_block_matched (global->project_switch, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, global);
+      gtk_combo_box_text_remove_all (global->project_switch);
+
+      names = g_list_sort (g_hash_table_get_keys (projects), (GCompareFunc) g_strcmp0);
+      for (link = names; link != NULL; link = link->next)
+        gtk_combo_box_text_append (global->project_switch, link->data, link->data);
+      g_list_free (names);
+
+      gtk_combo_box_set_active_id (GTK_COMBO_BOX (global->project_switch), global->project_name);
+      g_signal_handlers_unblock_matched (global->project_switch, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, global);
+    }
+
+  /* Если рабочий проект есть в списке, мониторим его
+   * и индексируем его галсы в фоне. */
   if (g_hash_table_lookup (projects, global->project_name))
-    hyscan_db_info_set_project (db_info, global->project_name);
+    {
+      hyscan_db_info_set_project (db_info, global->project_name);
+
+      if (global->track_index == NULL)
+        global->track_index = track_index_new (global->db, global->db_uri, global->project_name, global->nav_channel);
+    }
 
   g_hash_table_unref (projects);
 }
 
+/* Функция формирует описание данных галса по результатам индексатора. */
+static gchar *
+track_info_text (Global      *global,
+                 const gchar *track_name)
+{
+  TrackIndexInfo info;
+  GString *text;
+  guint n_lines = 0, n_gaps = 0, n_dropped = 0, n_truncated = 0;
+  gint64 period = 0;
+  guint i, j;
+
+  if ((global->track_index == NULL) || !track_index_get_info (global->track_index, track_name, &info))
+    return NULL;
+
+  for (i = 0; i < TRACK_INDEX_N_BOARDS; i++)
+    {
+      n_lines += info.boards[i].n_lines;
+      n_gaps += info.boards[i].n_gaps;
+      n_dropped += info.boards[i].n_dropped;
+      n_truncated += info.boards[i].n_truncated;
+      period = MAX (period, info.boards[i].period);
+    }
+
+  text = g_string_new (NULL);
+  g_string_append_printf (text, "Строк: %u, период %.0f мс", n_lines, period / 1000.0);
+  g_string_append_printf (text, "\nРазрывов: %u, пропущено строк: %u", n_gaps, n_dropped);
+  if (n_truncated > 0)
+    g_string_append_printf (text, "\nНеполных записей: %u", n_truncated);
+
+  for (i = 0; i < TRACK_INDEX_N_BOARDS; i++)
+    {
+      for (j = 0; j < MIN (info.boards[i].n_gaps, TRACK_INDEX_MAX_TOOLTIP_GAPS); j++)
+        {
+          TrackIndexGap *gap = &info.boards[i].gaps[j];
+          GDateTime *time = g_date_time_new_from_unix_local (gap->time / G_USEC_PER_SEC);
+          gchar *time_text = g_date_time_format (time, "%H:%M:%S");
+
+          g_string_append_printf (text, "\n%s %s: %u", (i == 0) ? "ПрБ" : "ЛБ", time_text, gap->n_dropped);
+
+          g_free (time_text);
+          g_date_time_unref (time);
+        }
+    }
+
+  return g_string_free (text, FALSE);
+}
+
+/* Функция обновляет описания галсов, проиндексированных в фоне.
+ * Изменяются только строки галсов, сведения о которых изменились. */
+static gboolean
+track_index_update (Global *global)
+{
+  GHashTable *changed;
+  GtkTreeIter iter;
+  gboolean valid;
+
+  if (global->track_index == NULL)
+    return G_SOURCE_CONTINUE;
+
+  changed = track_index_take_changed (global->track_index);
+  if (changed == NULL)
+    return G_SOURCE_CONTINUE;
+
+  for (valid = gtk_tree_model_get_iter_first (global->track_list, &iter);
+       valid;
+       valid = gtk_tree_model_iter_next (global->track_list, &iter))
+    {
+      gchar *track_name;
+      gchar *info;
+
+      gtk_tree_model_get (global->track_list, &iter, TRACK_COLUMN, &track_name, -1);
+      if (g_hash_table_contains (changed, track_name))
+        {
+          info = track_info_text (global, track_name);
+          gtk_list_store_set (GTK_LIST_STORE (global->track_list), &iter, INFO_COLUMN, info, -1);
+          g_free (info);
+        }
+
+      g_free (track_name);
+    }
+
+  g_hash_table_unref (changed);
+
+  return G_SOURCE_CONTINUE;
+}
+
 /* Функция вызывается при изменении списка галсов. */
 static void
 tracks_changed (HyScanDBInfo *db_info,
@@ -164,32 +456,49 @@ tracks_changed (HyScanDBInfo *db_info,
   while (g_hash_table_iter_next (&hash_iter, &key, &value))
     {
       HyScanTrackInfo *track_info;
-      HyScanSourceInfo *starboard_info;
-      HyScanSourceInfo *port_info;
-      gboolean has_computed_data;
-      gboolean has_raw_data;
+      gchar *info;
+      gchar *date;
+      gboolean has_computed_data = TRUE;
+      gboolean has_raw_data = TRUE;
+      guint i;
 
-      /* Проверяем что галс содержит данные ГБО. */
+      /* Проверяем что галс содержит данные ГБО по всем бортам
+       * и наличие обработанных и сырых данных. */
       track_info = value;
-      starboard_info = g_hash_table_lookup (track_info->sources, GINT_TO_POINTER (HYSCAN_SOURCE_SIDE_SCAN_STARBOARD));
-      port_info = g_hash_table_lookup (track_info->sources, GINT_TO_POINTER (HYSCAN_SOURCE_SIDE_SCAN_PORT));
-      if (!starboard_info || !port_info)
-        continue;
+      for (i = 0; i < N_BOARDS; i++)
+        {
+          HyScanSourceInfo *source_info;
+
+          source_info = g_hash_table_lookup (track_info->sources,
+                                             GINT_TO_POINTER (global->sonar.boards[i].source));
+          if (source_info == NULL)
+            {
+              has_computed_data = has_raw_data = FALSE;
+              break;
+            }
+
+          has_computed_data = has_computed_data && source_info->computed;
+          has_raw_data = has_raw_data && source_info->raw;
+        }
 
-      /* Проверяем наличие обработанных и сырых данных. */
-      has_computed_data = starboard_info->computed && port_info->computed;
-      has_raw_data = starboard_info->raw && port_info->raw;
       if (!has_computed_data && !has_raw_data)
         continue;
 
       /* Добавляем в список галсов. */
+      /* Список копирует строки, поэтому они передаются без копирования. */
+      date = g_date_time_format (track_info->ctime, "%d/%m/%Y %H:%M");
       gtk_list_store_append (GTK_LIST_STORE (global->track_list), &tree_iter);
       gtk_list_store_set (GTK_LIST_STORE (global->track_list), &tree_iter,
                           DATE_SORT_COLUMN, g_date_time_to_unix (track_info->ctime),
-                          TRACK_COLUMN, g_strdup (track_info->name),
-                          DATE_COLUMN, g_date_time_format (track_info->ctime, "%d/%m/%Y %H:%M"),
+                          TRACK_COLUMN, track_info->name,
+                          DATE_COLUMN, date,
                           HAS_RAW_DATA_COLUMN, has_raw_data,
                           -1);
+      g_free (date);
+
+      info = track_info_text (global, track_info->name);
+      gtk_list_store_set (GTK_LIST_STORE (global->track_list), &tree_iter, INFO_COLUMN, info, -1);
+      g_free (info);
 
       /* Подсвечиваем текущий галс. */
       if (g_strcmp0 (cur_track_name, track_info->name) == 0)
@@ -202,6 +511,10 @@ tracks_changed (HyScanDBInfo *db_info,
 
   g_hash_table_unref (tracks);
   g_free (cur_track_name);
+
+  /* Новые галсы индексируются в фоне, записываемый галс - после окончания записи. */
+  if (global->track_index != NULL)
+    track_index_scan (global->track_index, recording (global) ? global->track_name : NULL);
 }
 
 /* Функция прокручивает список галсов. */
@@ -224,6 +537,135 @@ track_scroll (GtkWidget *widget,
   return TRUE;
 }
 
+/* Функция добавляет в карту покрытия навигационные отметки
+ * с номерами от first до последней. */
+static void
+coverage_update (Global *global,
+                 guint   first)
+{
+  gdouble area, overlap;
+  NavPoint point;
+  gchar *text;
+  guint i;
+
+  for (i = first; nav_index_get_point (global->nav, i, &point); i++)
+    coverage_add_fix (global->coverage, &point, global->sonar.cur_distance, global->altitude);
+
+  coverage_get_stats (global->coverage, &area, &overlap);
+  text = g_strdup_printf ("<small><b>%.3f km², %.0f%%</b></small>", area / 1e6, overlap);
+  gtk_label_set_markup (global->coverage_value, text);
+  g_free (text);
+
+  gtk_widget_queue_draw (global->coverage_area);
+}
+
+/* Обработчик рисования карты покрытия. */
+static gboolean
+coverage_area_draw (GtkWidget *widget,
+                    cairo_t   *cairo,
+                    Global    *global)
+{
+  coverage_draw (global->coverage, cairo,
+                 gtk_widget_get_allocated_width (widget),
+                 gtk_widget_get_allocated_height (widget));
+
+  return TRUE;
+}
+
+/* Функция устанавливает масштаб вдоль галса по средней скорости
+ * относительно грунта из навигационных данных. Если навигационных данных
+ * нет, используется скорость судна по умолчанию. Масштаб изменяется,
+ * только если скорость изменилась заметно, чтобы не перестраивать
+ * изображение при каждой новой отметке. */
+static void
+track_speed_update (Global *global)
+{
+  gdouble speed;
+
+  if ((global->nav == NULL) || !nav_index_get_mean_speed (global->nav, &speed))
+    speed = global->ship_speed;
+
+  if (fabs (speed - global->track_speed) <= TRACK_SPEED_THRESHOLD * global->track_speed)
+    return;
+
+  global->track_speed = speed;
+  hyscan_gtk_waterfall_state_set_ship_speed (global->wf_state, speed);
+}
+
+/* Функция разбирает новые навигационные данные текущего галса
+ * и отображает последнее местоположение в заголовке окна. Во время
+ * записи галса новые отметки добавляются в карту покрытия. Данные
+ * непроиндексированного галса разбираются частями по NAV_MAX_READS
+ * записей, чтобы не блокировать главный цикл. */
+static gboolean
+nav_update (Global *global)
+{
+  NavPoint point;
+  gchar *text;
+  guint n_points;
+  guint n_new;
+
+  if (global->nav == NULL)
+    return G_SOURCE_CONTINUE;
+
+  if ((n_new = nav_index_update (global->nav, NAV_MAX_READS)) == 0)
+    return G_SOURCE_CONTINUE;
+
+  n_points = nav_index_get_n_points (global->nav);
+  if (!nav_index_get_point (global->nav, n_points - 1, &point))
+    return G_SOURCE_CONTINUE;
+
+  if ((global->coverage != NULL) && recording (global))
+    coverage_update (global, n_points - n_new);
+
+  track_speed_update (global);
+
+  text = g_strdup_printf ("%.6f° %.6f°, %.1f уз, %.0f м",
+                          point.lat, point.lon, point.speed * 3600.0 / 1852.0, point.distance);
+  gtk_header_bar_set_subtitle (GTK_HEADER_BAR (global->header), text);
+  g_free (text);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Поток построения мозаики. Пока есть необработанные данные, мозаика
+ * обновляется непрерывно, иначе - с периодом MOSAIC_UPDATE_PERIOD. */
+static gpointer
+mosaic_thread (Global *global)
+{
+  while (!g_atomic_int_get (&global->mosaic_stop))
+    {
+      gint64 wait;
+
+      if (mosaic_update (global->mosaic))
+        continue;
+
+      for (wait = 0; wait < MOSAIC_UPDATE_PERIOD; wait += MOSAIC_STOP_CHECK_PERIOD)
+        {
+          if (g_atomic_int_get (&global->mosaic_stop))
+            break;
+          g_usleep (MOSAIC_STOP_CHECK_PERIOD);
+        }
+    }
+
+  return NULL;
+}
+
+/* Функция запускает обнаружение целей на текущем галсе, если оно включено. */
+static void
+detector_track_set (Global *global)
+{
+  g_clear_pointer (&global->detector, detector_free);
+  global->n_detected = 0;
+  gtk_label_set_markup (global->detector_value, "<small><b>0</b></small>");
+
+  if (gtk_switch_get_state (global->detector_switch) && (global->track_name != NULL))
+    {
+      global->detector = detector_new (global->db, global->project_name, global->track_name,
+                                       global->track_raw, recording (global));
+    }
+}
+
 /* Обработчик изменения галса. */
 static void
 track_changed (GtkTreeView *list,
@@ -252,14 +694,80 @@ track_changed (GtkTreeView *list,
   track_name = g_value_dup_string (&value);
   g_value_unset (&value);
 
+  /* В режиме сравнения выбранный галс открывается во второй панели. */
+  if (!global->new_track && gtk_switch_get_state (global->compare))
+    {
+      if (g_strcmp0 (global->compare_track, track_name) != 0)
+        {
+          g_free (global->compare_track);
+          global->compare_track = track_name;
+          hyscan_gtk_waterfall_state_set_track (global->wf_compare_state, global->db, global->project_name,
+                                                global->compare_track, has_raw_data);
+        }
+      else
+        {
+          g_free (track_name);
+        }
+
+      return;
+    }
+
   /* Если создан новый галс или названия текущего и выбранного галса не совпадают, открываем этот галс. */
   if (global->new_track || (g_strcmp0 (global->track_name, track_name) != 0))
     {
       g_clear_pointer(&global->track_name, g_free);
       global->track_name = track_name;
+      gtk_switch_set_active (global->replay_switch, FALSE);
+
+      /* Упреждающее чтение каналов водопада записанного галса из локальной базы данных. */
+      g_clear_pointer (&global->prefetch, track_prefetch_free);
+      if (!global->new_track)
+        {
+          const gchar *channels[N_BOARDS + 1];
+          guint i;
+
+          for (i = 0; i < N_BOARDS; i++)
+            channels[i] = hyscan_channel_get_name_by_types (global->sonar.boards[i].source, has_raw_data, 1);
+          channels[N_BOARDS] = NULL;
+
+          global->prefetch = track_prefetch_new (global->db_uri, global->project_name, global->track_name, channels);
+        }
+
+      /* Записываемый галс - новый проход для карты покрытия. */
+      if (global->new_track && (global->coverage != NULL))
+        coverage_begin_pass (global->coverage);
+
+      /* Контроль записи строк нового галса. */
+      if (global->new_track)
+        {
+          g_clear_pointer (&global->lines, line_monitor_free);
+          global->lines = line_monitor_new (global->db, global->project_name, global->track_name);
+          gtk_label_set_markup (global->lines_value, "<small><b>0 / 0</b></small>");
+
+          /* Строки записываемого галса передаются рабочим местам просмотра. */
+          if (global->line_server != NULL)
+            line_server_set_track (global->line_server, global->project_name, global->track_name, has_raw_data);
+        }
       global->new_track = FALSE;
+      global->track_raw = has_raw_data;
 
       hyscan_gtk_waterfall_state_set_track (global->wf_state, global->db, global->project_name, global->track_name, has_raw_data);
+
+      /* Автоматическая яркость и сжатие диапазона по данным нового галса. */
+      g_clear_pointer (&global->auto_levels, auto_levels_free);
+      if (gtk_switch_get_state (global->auto_brightness))
+        global->auto_levels = auto_levels_new (global->db, global->project_name, global->track_name, has_raw_data);
+      tone_track_set (global);
+      detector_track_set (global);
+
+      /* Навигационные данные галса. */
+      g_clear_pointer (&global->nav, nav_index_free);
+      global->nav = nav_index_new (global->db, global->project_name, global->track_name, global->nav_channel);
+      if (global->track_index != NULL)
+        track_index_load_nav (global->track_index, global->track_name, global->nav);
+      track_speed_update (global);
+      gtk_header_bar_set_subtitle (GTK_HEADER_BAR (global->header), NULL);
+      nav_update (global);
       hyscan_gtk_waterfall_automove (global->wf, TRUE);
       scale_set (global);
     }
@@ -269,22 +777,70 @@ track_changed (GtkTreeView *list,
     }
 }
 
+/* Обработчик выбора проекта. Соединение с базой данных, монитор базы
+ * данных, кэш, панели водопада и настройки гидролокатора сохраняются,
+ * заменяются только объекты, относящиеся к галсам проекта. Во время
+ * записи проект не переключается. */
+static void
+project_changed (GtkComboBox *combo,
+                 Global      *global)
+{
+  const gchar *project_name = gtk_combo_box_get_active_id (combo);
+
+  if ((project_name == NULL) || (g_strcmp0 (project_name, global->project_name) == 0))
+    return;
+
+  if (recording (global))
+    {
+      gtk_combo_box_set_active_id (combo, global->project_name);
+      return;
+    }
+
+  /* Закрываем галсы текущего проекта. */
+  gtk_switch_set_active (global->replay_switch, FALSE);
+  gtk_switch_set_active (global->compare, FALSE);
+  hyscan_gtk_waterfall_state_set_track (global->wf_state, NULL, NULL, NULL, FALSE);
+  gtk_list_store_clear (GTK_LIST_STORE (global->track_list));
+  gtk_header_bar_set_subtitle (GTK_HEADER_BAR (global->header), NULL);
+
+  g_clear_pointer (&global->track_name, g_free);
+  g_clear_pointer (&global->nav, nav_index_free);
+  g_clear_pointer (&global->prefetch, track_prefetch_free);
+  g_clear_pointer (&global->lines, line_monitor_free);
+  g_clear_pointer (&global->auto_levels, auto_levels_free);
+  g_clear_pointer (&global->track_index, track_index_free);
+  tone_track_set (global);
+  detector_track_set (global);
+
+  g_free (global->project_name);
+  global->project_name = g_strdup (project_name);
+  global->n_tracks = -1;
+
+  /* Новые галсы записываются в выбранный проект. */
+  if ((global->sonar.sonar != NULL) &&
+      !hyscan_data_writer_set_project (HYSCAN_DATA_WRITER (global->sonar.sonar), global->project_name))
+    {
+      g_message ("can't set working project");
+    }
+
+  hyscan_mark_manager_set_project (global->mman, global->db, global->project_name);
+  projects_changed (global->db_info, global);
+}
 
 static void
 active_mark_changed (HyScanGtkProjectViewer *marks_viewer,
                      Global                 *global)
 {
   const gchar *mark_id;
-  GHashTable *marks;
-  HyScanMarkManagerMarkLoc *mark;
+  const HyScanMarkManagerMarkLoc *mark;
 
   mark_id = hyscan_gtk_project_viewer_get_selected_item (marks_viewer);
   // hyscan_db_model_set_mark (priv->db_model, mark_id);
 
-  if ((marks = hyscan_mark_manager_get_w_coords (global->mman)) == NULL)
+  if (global->marks == NULL)
     return;
 
-  if ((mark = g_hash_table_lookup (marks, mark_id)) != NULL)
+  if ((mark = mark_index_lookup (global->marks, mark_id)) != NULL)
     {
       hyscan_gtk_mark_editor_set_mark (HYSCAN_GTK_MARK_EDITOR (global->meditor),
                                        mark_id,
@@ -294,90 +850,200 @@ active_mark_changed (HyScanGtkProjectViewer *marks_viewer,
                                        mark->lat,
                                        mark->lon);
     }
+}
 
-  g_hash_table_unref (marks);
+/* Функция заполняет строку списка меток. */
+static void
+mark_list_set (GtkListStore                   *ls,
+               GtkTreeIter                    *tree_iter,
+               const gchar                    *mark_id,
+               const HyScanMarkManagerMarkLoc *mark)
+{
+  GDateTime *mtime;
+  gchar *mtime_str;
+
+  mtime = g_date_time_new_from_unix_local (mark->mark->modification_time / 1e6);
+  mtime_str =  g_date_time_format (mtime, "%d.%m %H:%M");
+
+  gtk_list_store_set (ls, tree_iter,
+                      0, mark_id,
+                      1, mark->mark->name,
+                      2, mtime_str,
+                      3, mark->mark->modification_time,
+                      -1);
+
+  g_free (mtime_str);
+  g_date_time_unref (mtime);
 }
 
+/* Обработчик изменения меток. Список меток не перестраивается целиком:
+ * удаляются строки исчезнувших меток, обновляются строки изменившихся
+ * и добавляются новые. */
 static void
 mark_manager_changed (HyScanMarkManager *mark_manager,
                       Global            *global)
 {
   GtkTreeIter tree_iter;
+  GtkTreeModel *model;
   GHashTable *marks;
+  GHashTable *listed;
   GHashTableIter marks_iter;
   gpointer key, value;
-  const gchar *mark_id;
+  MarkIndex *index;
   GtkListStore *ls;
-
-  hyscan_gtk_project_viewer_clear (HYSCAN_GTK_PROJECT_VIEWER (global->mlist));
+  gboolean valid;
 
   if ((marks = hyscan_mark_manager_get_w_coords (mark_manager)) == NULL)
-    return;
+    {
+      hyscan_gtk_project_viewer_clear (HYSCAN_GTK_PROJECT_VIEWER (global->mlist));
+      g_clear_pointer (&global->marks, mark_index_free);
+      return;
+    }
+
+  index = mark_index_new (marks);
+  g_hash_table_unref (marks);
 
   ls = hyscan_gtk_project_viewer_get_liststore (HYSCAN_GTK_PROJECT_VIEWER (global->mlist));
+  model = GTK_TREE_MODEL (ls);
+  listed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
-  g_hash_table_iter_init (&marks_iter, marks);
-  while (g_hash_table_iter_next (&marks_iter, &key, &value))
+  /* Существующие строки списка. */
+  valid = gtk_tree_model_get_iter_first (model, &tree_iter);
+  while (valid)
     {
-      mark_id = key;
-      HyScanMarkManagerMarkLoc *mark = value;
-      GDateTime *mtime;
-      gchar *mtime_str;
+      const HyScanMarkManagerMarkLoc *mark;
+      const HyScanMarkManagerMarkLoc *prev;
+      gchar *mark_id;
 
-      mtime = g_date_time_new_from_unix_local (mark->mark->modification_time / 1e6);
-      mtime_str =  g_date_time_format (mtime, "%d.%m %H:%M");
+      gtk_tree_model_get (model, &tree_iter, 0, &mark_id, -1);
 
-      gtk_list_store_append (ls, &tree_iter);
-      gtk_list_store_set (ls, &tree_iter,
-                          0, mark_id,
-                          1, mark->mark->name,
-                          2, mtime_str,
-                          3, mark->mark->modification_time,
-                          -1);
+      mark = mark_index_lookup (index, mark_id);
+      if (mark == NULL)
+        {
+          g_free (mark_id);
+          valid = gtk_list_store_remove (ls, &tree_iter);
+          continue;
+        }
+
+      prev = (global->marks != NULL) ? mark_index_lookup (global->marks, mark_id) : NULL;
+      if ((prev == NULL) ||
+          (prev->mark->modification_time != mark->mark->modification_time) ||
+          (g_strcmp0 (prev->mark->name, mark->mark->name) != 0))
+        {
+          mark_list_set (ls, &tree_iter, mark_id, mark);
+        }
 
-      g_free (mtime_str);
-      g_date_time_unref (mtime);
+      g_hash_table_add (listed, mark_id);
+      valid = gtk_tree_model_iter_next (model, &tree_iter);
     }
 
-  g_hash_table_unref (marks);
+  /* Новые метки. */
+  g_hash_table_iter_init (&marks_iter, mark_index_get_marks (index));
+  while (g_hash_table_iter_next (&marks_iter, &key, &value))
+    {
+      if (g_hash_table_contains (listed, key))
+        continue;
+
+      gtk_list_store_append (ls, &tree_iter);
+      mark_list_set (ls, &tree_iter, key, value);
+    }
+
+  g_hash_table_unref (listed);
+
+  /* Индекс меток для поиска без копирования всей таблицы. */
+  g_clear_pointer (&global->marks, mark_index_free);
+  global->marks = index;
 
   // if ((mark_id = hyscan_db_model_get_mark (priv->db_model)) != NULL)
     // hyscan_gtk_project_viewer_set_selected_item (HYSCAN_GTK_PROJECT_VIEWER (global->mlist), mark_id);
 }
 
+/* Обработчик изменения метки в редакторе. В менеджер меток передаётся
+ * метка, в которой заменены только изменившиеся поля, без глубокого
+ * копирования. Если поля не изменились, метка не записывается. */
 static void
 mark_modified (HyScanGtkMarkEditor *med,
                Global              *global)
 {
+  const HyScanMarkManagerMarkLoc *mark;
+  HyScanWaterfallMark patch;
   gchar *mark_id = NULL;
-  GHashTable *marks;
-  HyScanWaterfallMark *mark;
+  gchar *name = NULL;
+  gchar *operator_name = NULL;
+  gchar *description = NULL;
+  gboolean changed = FALSE;
 
-  hyscan_gtk_mark_editor_get_mark (med, &mark_id, NULL, NULL, NULL);
-
-  if ((marks = hyscan_mark_manager_get (global->mman)) == NULL)
+  if (global->marks == NULL)
     return;
 
-  if ((mark = g_hash_table_lookup (marks, mark_id)) != NULL)
-    {
-      HyScanWaterfallMark *modified_mark = hyscan_waterfall_mark_copy (mark);
-      g_clear_pointer (&modified_mark->name, g_free);
-      g_clear_pointer (&modified_mark->operator_name, g_free);
-      g_clear_pointer (&modified_mark->description, g_free);
+  hyscan_gtk_mark_editor_get_mark (med, &mark_id, &name, &operator_name, &description);
 
-      hyscan_gtk_mark_editor_get_mark (med,
-                                       NULL,
-                                       &modified_mark->name,
-                                       &modified_mark->operator_name,
-                                       &modified_mark->description);
+  if ((mark = mark_index_lookup (global->marks, mark_id)) == NULL)
+    goto exit;
 
-      hyscan_mark_manager_modify_mark (global->mman, mark_id, modified_mark);
+  patch = *mark->mark;
 
-      hyscan_waterfall_mark_free (modified_mark);
+  if (g_strcmp0 (name, patch.name) != 0)
+    {
+      patch.name = name;
+      changed = TRUE;
+    }
+  if (g_strcmp0 (operator_name, patch.operator_name) != 0)
+    {
+      patch.operator_name = operator_name;
+      changed = TRUE;
+    }
+  if (g_strcmp0 (description, patch.description) != 0)
+    {
+      patch.description = description;
+      changed = TRUE;
     }
 
+  if (changed)
+    hyscan_mark_manager_modify_mark (global->mman, mark_id, &patch);
+
+exit:
   g_free (mark_id);
-  g_hash_table_unref (marks);
+  g_free (name);
+  g_free (operator_name);
+  g_free (description);
+}
+
+/* Функция устанавливает в основной панели палитру сжатия диапазона,
+ * построенную по гистограмме галса. Яркость определяет долю амплитуд,
+ * отображаемых полной шкалой палитры. Возвращает FALSE, если сжатие
+ * выключено или гистограмма ещё не построена. */
+static gboolean
+tone_apply (Global  *global,
+            gdouble  cur_brightness,
+            guint    cur_color_map)
+{
+  const Palette *palette;
+  guint32 *colors;
+  gdouble white;
+
+  if (global->tone_map == NULL)
+    return FALSE;
+
+  palette = palette_list_get (global->palettes, cur_color_map);
+  white = tone_map_get_white (global->tone_map);
+  if ((palette == NULL) || (white <= 0.0))
+    return FALSE;
+
+  white *= 1.0 - 0.9 * (cur_brightness / 100.0);
+
+  colors = g_new (guint32, TONE_MAP_SIZE);
+  if (!tone_map_build (global->tone_map, palette, white, colors, TONE_MAP_SIZE))
+    {
+      g_free (colors);
+      return FALSE;
+    }
+
+  hyscan_gtk_waterfall_set_colormap_for_all (global->wf, colors, TONE_MAP_SIZE, 0xff000000);
+  hyscan_gtk_waterfall_set_levels_for_all (global->wf, 0.0, 1.0, white);
+  g_free (colors);
+
+  return TRUE;
 }
 
 /* Функция устанавливает яркость отображения. */
@@ -399,7 +1065,9 @@ brightness_set (Global  *global,
   gamma = 1.25 - 0.5 * (cur_brightness / 100.0);
   white = 1.0 - (cur_brightness / 100.0) * 0.99;
 
-  hyscan_gtk_waterfall_set_levels_for_all (global->wf, black, gamma, white);
+  if (!tone_apply (global, cur_brightness, global->cur_color_map) && (global->auto_levels == NULL))
+    hyscan_gtk_waterfall_set_levels_for_all (global->wf, black, gamma, white);
+  hyscan_gtk_waterfall_set_levels_for_all (global->wf_compare, black, gamma, white);
 
   text = g_strdup_printf ("<small><b>%.0f%%</b></small>", cur_brightness);
   gtk_label_set_markup (global->brightness_value, text);
@@ -413,109 +1081,175 @@ static gboolean
 color_map_set (Global *global,
                guint   cur_color_map)
 {
+  const Palette *palette;
   gchar *text;
-  const gchar *color_map_name;
 
-  if (cur_color_map >= MAX_COLOR_MAPS)
+  palette = palette_list_get (global->palettes, cur_color_map);
+  if (palette == NULL)
     return FALSE;
 
-  switch (cur_color_map)
-    {
-    case 0:
-      color_map_name = "БЕЛАЯ";
-      break;
-
-    case 1:
-      color_map_name = "ЖЁЛТАЯ";
-      break;
-
-    case 2:
-      color_map_name = "ЗЕЛЁНАЯ";
-      break;
-
-    default:
-      return FALSE;
-    }
-
-  hyscan_gtk_waterfall_set_colormap_for_all (global->wf,
-                                             (guint32*)global->color_maps[cur_color_map]->data,
-                                             global->color_maps[cur_color_map]->len,
+  if (!tone_apply (global, global->cur_brightness, cur_color_map))
+    hyscan_gtk_waterfall_set_colormap_for_all (global->wf,
+                                               (guint32*)palette->colors,
+                                               palette->n_colors,
+                                               0xff000000);
+  hyscan_gtk_waterfall_set_colormap_for_all (global->wf_compare,
+                                             (guint32*)palette->colors,
+                                             palette->n_colors,
                                              0xff000000);
 
-  text = g_strdup_printf ("<small><b>%s</b></small>", color_map_name);
+  text = g_markup_printf_escaped ("<small><b>%s</b></small>", palette->name);
   gtk_label_set_markup (global->color_map_value, text);
   g_free (text);
 
   return TRUE;
 }
 
-/* Функция устанавливает масштаб отображения. */
-static gboolean
-scale_set (Global *global)
+/* Функция создаёт объект сжатия диапазона для текущего галса, если
+ * сжатие включено. До построения гистограммы галса основная панель
+ * отображается с обычными яркостью и палитрой. */
+static void
+tone_track_set (Global *global)
 {
-  const gdouble *scales;
-  gint n_scales;
-  gint i_scale;
-  gchar *text;
+  g_clear_pointer (&global->tone_map, tone_map_free);
+  global->tone_applied = FALSE;
+  global->auto_applied = FALSE;
 
-  i_scale = hyscan_gtk_waterfall_get_scale (global->wf, &scales, &n_scales);
+  if (gtk_switch_get_state (global->tone) && (global->track_name != NULL))
+    {
+      global->tone_map = tone_map_new (global->db, global->cache, global->project_name,
+                                       global->track_name, global->track_raw);
+    }
 
-  text = g_strdup_printf ("<small><b>1:%.0f</b></small>", scales[i_scale]);
+  brightness_set (global, global->cur_brightness);
+  color_map_set (global, global->cur_color_map);
+}
+
+/* Функция применяет сжатие диапазона после построения гистограммы галса. */
+static gboolean
+tone_update (Global *global)
+{
+  if ((global->tone_map != NULL) && !global->tone_applied)
+    global->tone_applied = tone_apply (global, global->cur_brightness, global->cur_color_map);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Функция обновляет уровни автоматической яркости основной панели
+ * для текущей области просмотра. При сжатии диапазона уровни
+ * определяются гистограммой всего галса. */
+static gboolean
+auto_levels_update_view (Global *global)
+{
+  gdouble from_x, to_x, from_y, to_y;
+  gdouble min_x, max_x, min_y, max_y;
+  gdouble black, gamma, white;
+  gboolean changed;
+
+  if ((global->auto_levels == NULL) || global->tone_applied)
+    return G_SOURCE_CONTINUE;
+
+  gtk_cifro_area_get_view (GTK_CIFRO_AREA (global->wf), &from_x, &to_x, &from_y, &to_y);
+  gtk_cifro_area_get_limits (GTK_CIFRO_AREA (global->wf), &min_x, &max_x, &min_y, &max_y);
+  if (max_y <= min_y)
+    return G_SOURCE_CONTINUE;
+
+  changed = auto_levels_update (global->auto_levels,
+                                (from_y - min_y) / (max_y - min_y),
+                                (to_y - min_y) / (max_y - min_y));
+
+  if ((changed || !global->auto_applied) && auto_levels_get (global->auto_levels, &black, &gamma, &white))
+    {
+      hyscan_gtk_waterfall_set_levels_for_all (global->wf, black, gamma, white);
+      global->auto_applied = TRUE;
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Функция устанавливает масштаб отображения. */
+static gboolean
+scale_set (Global *global)
+{
+  const gdouble *scales;
+  gint n_scales;
+  gint i_scale;
+  gchar *text;
+
+  i_scale = hyscan_gtk_waterfall_get_scale (global->wf, &scales, &n_scales);
+
+  text = g_strdup_printf ("<small><b>1:%.0f</b></small>", scales[i_scale]);
   gtk_label_set_markup (global->scale_value, text);
   g_free (text);
 
   return TRUE;
 }
 
+/* Функция устанавливает излучаемый сигнал для борта. */
+static gboolean
+board_signal_set (Global   *global,
+                  Board    *board,
+                  gpointer  data)
+{
+  guint cur_signal = *(guint*)data;
+
+  return hyscan_generator_control_set_preset (global->sonar.gen, board->source,
+                                              board->signals[cur_signal]->value);
+}
+
 /* Функция устанавливает излучаемый сигнал. */
 static gboolean
 signal_set (Global *global,
             guint   cur_signal)
 {
-  gchar *text;
-  gint is_equal;
-  gboolean status;
+  GString *text;
+  gboolean is_equal = TRUE;
+  guint i;
 
   if (cur_signal == 0)
     return FALSE;
-  if (cur_signal >= global->sonar.starboard.n_signals)
-    return FALSE;
-  if (cur_signal >= global->sonar.port.n_signals)
-    return FALSE;
-
-  status = hyscan_generator_control_set_preset (global->sonar.gen,
-                                                HYSCAN_SOURCE_SIDE_SCAN_STARBOARD,
-                                                global->sonar.starboard.signals[cur_signal]->value);
-  if (!status)
-    return FALSE;
+  for (i = 0; i < N_BOARDS; i++)
+    if (cur_signal >= global->sonar.boards[i].n_signals)
+      return FALSE;
 
-  status = hyscan_generator_control_set_preset (global->sonar.gen,
-                                                HYSCAN_SOURCE_SIDE_SCAN_PORT,
-                                                global->sonar.port.signals[cur_signal]->value);
-  if (!status)
+  if (!boards_run (global, board_signal_set, &cur_signal))
     return FALSE;
 
-  is_equal = g_strcmp0 (global->sonar.starboard.signals[cur_signal]->name,
-                        global->sonar.port.signals[cur_signal]->name);
-
-  if (is_equal == 0)
+  for (i = 1; i < N_BOARDS; i++)
     {
-      text = g_strdup_printf ("<small><b>%s</b></small>",
-                              global->sonar.starboard.signals[cur_signal]->name);
+      if (g_strcmp0 (global->sonar.boards[0].signals[cur_signal]->name,
+                     global->sonar.boards[i].signals[cur_signal]->name) != 0)
+        {
+          is_equal = FALSE;
+        }
     }
-  else
+
+  text = g_string_new ("<small><b>");
+  for (i = 0; i < (is_equal ? 1 : N_BOARDS); i++)
     {
-      text = g_strdup_printf ("<small><b>%s, %s</b></small>",
-                              global->sonar.starboard.signals[cur_signal]->name,
-                              global->sonar.port.signals[cur_signal]->name);
+      if (i > 0)
+        g_string_append (text, ", ");
+      g_string_append (text, global->sonar.boards[i].signals[cur_signal]->name);
     }
+  g_string_append (text, "</b></small>");
 
-  gtk_label_set_markup (global->signal_value, text);
-  g_free (text);
+  gtk_label_set_markup (global->signal_value, text->str);
+  g_string_free (text, TRUE);
 
   return TRUE;
 }
 
+/* Функция устанавливает параметры ВАРУ для борта. */
+static gboolean
+board_tvg_set (Global   *global,
+               Board    *board,
+               gpointer  data)
+{
+  gdouble *params = data;
+
+  return hyscan_tvg_control_set_auto (global->sonar.tvg, board->source, params[0], params[1]);
+}
+
 /* Функция устанавливает параметры ВАРУ. */
 static gboolean
 tvg_set (Global  *global,
@@ -523,29 +1257,14 @@ tvg_set (Global  *global,
          gdouble  sensitivity)
 {
   gchar *text;
-  gboolean status;
-  gdouble min_gain;
-  gdouble max_gain;
+  gdouble params[2];
 
   if ((level < 0.0) || (level > 1.0) || (sensitivity < 0.0) || (sensitivity > 1.0))
     return FALSE;
 
-  hyscan_tvg_control_get_gain_range (global->sonar.tvg, HYSCAN_SOURCE_SIDE_SCAN_STARBOARD,
-                                     &min_gain, &max_gain);
-
-  status = hyscan_tvg_control_set_auto (global->sonar.tvg,
-                                        HYSCAN_SOURCE_SIDE_SCAN_STARBOARD,
-                                        level, sensitivity);
-  if (!status)
-    return FALSE;
-
-  hyscan_tvg_control_get_gain_range (global->sonar.tvg, HYSCAN_SOURCE_SIDE_SCAN_PORT,
-                                     &min_gain, &max_gain);
-
-  status = hyscan_tvg_control_set_auto (global->sonar.tvg,
-                                        HYSCAN_SOURCE_SIDE_SCAN_PORT,
-                                        level, sensitivity);
-  if (!status)
+  params[0] = level;
+  params[1] = sensitivity;
+  if (!boards_run (global, board_tvg_set, params))
     return FALSE;
 
   text = g_strdup_printf ("<small><b>%.1f</b></small>", level);
@@ -558,29 +1277,79 @@ tvg_set (Global  *global,
   return TRUE;
 }
 
+/* Функция устанавливает долю процессора для автоматической ВАРУ. */
+static gboolean
+tvg_cpu_set (Global  *global,
+             gdouble  cur_tvg_cpu)
+{
+  gchar *text;
+
+  if ((cur_tvg_cpu <= 0.0) || (cur_tvg_cpu > 100.0))
+    return FALSE;
+
+  if (!hyscan_param_set_double (global->sonar.param, "/parameters/auto-tvg-max-cpu", cur_tvg_cpu))
+    return FALSE;
+
+  text = g_strdup_printf ("<small><b>%.0f%%</b></small>", cur_tvg_cpu);
+  gtk_label_set_markup (global->tvg_cpu_value, text);
+  g_free (text);
+
+  return TRUE;
+}
+
+/* Функция подстраивает долю процессора для автоматической ВАРУ под загрузку.
+ * Если главный цикл опаздывает с обработкой таймера, отрисовка водопада не
+ * успевает за данными и бюджет ВАРУ уменьшается. При наличии запаса бюджет
+ * постепенно возвращается к максимальному. */
+static gboolean
+tvg_cpu_control (Global *global)
+{
+  gdouble cur_tvg_cpu = global->sonar.cur_tvg_cpu;
+  gint64 cur_time = g_get_monotonic_time ();
+  gint64 lag;
+
+  lag = cur_time - global->sonar.tvg_cpu_check - 1000 * AUTO_TVG_CHECK_PERIOD;
+  global->sonar.tvg_cpu_check = cur_time;
+
+  if (lag > AUTO_TVG_LAG_HIGH)
+    cur_tvg_cpu -= AUTO_TVG_CPU_STEP;
+  else if (lag < AUTO_TVG_LAG_LOW)
+    cur_tvg_cpu += AUTO_TVG_CPU_STEP;
+
+  cur_tvg_cpu = CLAMP (cur_tvg_cpu, global->sonar.min_tvg_cpu, global->sonar.max_tvg_cpu);
+
+  if ((cur_tvg_cpu != global->sonar.cur_tvg_cpu) && tvg_cpu_set (global, cur_tvg_cpu))
+    global->sonar.cur_tvg_cpu = cur_tvg_cpu;
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Функция устанавливает время приёма для борта. */
+static gboolean
+board_distance_set (Global   *global,
+                    Board    *board,
+                    gpointer  data)
+{
+  gdouble receive_time = *(gdouble*)data;
+
+  return hyscan_sonar_control_set_receive_time (global->sonar.sonar, board->source, receive_time);
+}
+
 /* Функция устанавливает рабочую дистанцию. */
 static gboolean
 distance_set (Global  *global,
               gdouble  cur_distance)
 {
   gchar *text;
-  gboolean status;
+  gdouble receive_time;
 
   if (cur_distance < 1.0)
     return FALSE;
   if (cur_distance > SIDE_SCAN_MAX_DISTANCE)
     return FALSE;
 
-  status = hyscan_sonar_control_set_receive_time (global->sonar.sonar,
-                                                  HYSCAN_SOURCE_SIDE_SCAN_STARBOARD,
-                                                  cur_distance / 750.0);
-  if (!status)
-    return FALSE;
-
-  status = hyscan_sonar_control_set_receive_time (global->sonar.sonar,
-                                                  HYSCAN_SOURCE_SIDE_SCAN_PORT,
-                                                  cur_distance / 750.0);
-  if (!status)
+  receive_time = cur_distance / 750.0;
+  if (!boards_run (global, board_distance_set, &receive_time))
     return FALSE;
 
   text = g_strdup_printf ("<small><b>%.0f m</b></small>", cur_distance);
@@ -608,79 +1377,693 @@ brightness_up (GtkWidget *widget,
 }
 
 static void
-brightness_down (GtkWidget *widget,
-                 Global    *global)
+brightness_down (GtkWidget *widget,
+                 Global    *global)
+{
+  gdouble cur_brightness;
+
+  if (global->cur_brightness > 90.0)
+    cur_brightness = global->cur_brightness - 1.0;
+  else if (global->cur_brightness > 50.0)
+    cur_brightness = global->cur_brightness - 5.0;
+  else
+    cur_brightness = global->cur_brightness - 10.0;
+
+  if (brightness_set (global, cur_brightness))
+    global->cur_brightness = cur_brightness;
+}
+
+static void
+color_map_up (GtkWidget *widget,
+              Global    *global)
+{
+  guint cur_color_map = global->cur_color_map + 1;
+
+  if (color_map_set (global, cur_color_map))
+    global->cur_color_map = cur_color_map;
+}
+
+static void
+color_map_down (GtkWidget *widget,
+                Global    *global)
+{
+  guint cur_color_map = global->cur_color_map - 1;
+
+  if (color_map_set (global, cur_color_map))
+    global->cur_color_map = cur_color_map;
+}
+
+static void
+scale_up (GtkWidget *widget,
+          Global    *global)
+{
+  hyscan_gtk_waterfall_control_zoom (global->wf_control, TRUE);
+  scale_set (global);
+}
+
+static void
+scale_down (GtkWidget *widget,
+            Global    *global)
+{
+  hyscan_gtk_waterfall_control_zoom (global->wf_control, FALSE);
+  scale_set (global);
+}
+
+static gboolean
+live_view (GtkWidget  *widget,
+           gboolean    state,
+           Global     *global)
+{
+  if (state)
+    {
+      if (!gtk_switch_get_state (global->live_view))
+        hyscan_gtk_waterfall_automove (global->wf, state);
+
+      gtk_switch_set_state (global->live_view, TRUE);
+    }
+  else
+    {
+      if (gtk_switch_get_state (global->live_view))
+        hyscan_gtk_waterfall_automove (global->wf, state);
+
+      gtk_switch_set_state (global->live_view, FALSE);
+    }
+
+  return TRUE;
+}
+
+/* Функция возвращает ограничение памяти кэша. Фактически занятая кэшем
+ * память не определяется и входит в неучтённую память процесса. */
+static gsize
+memory_cache_usage (Global *global)
+{
+  return (gsize) global->cache_size * 1024 * 1024;
+}
+
+/* Функция уменьшает кэш вдвое. Кэш заменяется новым кэшем меньшего
+ * размера, память старого кэша освобождается вместе с последней ссылкой.
+ * Уменьшенный размер сохраняется до перезапуска программы. */
+static gboolean
+memory_cache_shrink (Global *global)
+{
+  if (global->cache_size <= MEMORY_MIN_CACHE)
+    return FALSE;
+
+  global->cache_size = MAX (global->cache_size / 2, MEMORY_MIN_CACHE);
+  g_object_unref (global->cache);
+  global->cache = HYSCAN_CACHE (hyscan_cached_new (global->cache_size));
+
+  hyscan_gtk_waterfall_state_set_cache (global->wf_state, global->cache, global->cache, NULL);
+  hyscan_gtk_waterfall_state_set_cache (global->wf_compare_state, global->cache, global->cache, NULL);
+  if (global->tone_map != NULL)
+    tone_track_set (global);
+
+  g_message ("cache size reduced to %d Mb", global->cache_size);
+
+  return TRUE;
+}
+
+/* Функция возвращает оценку памяти изображений водопадов: буферов
+ * отображаемых панелей. */
+static gsize
+memory_tiles_usage (Global *global)
+{
+  GtkWidget *panels[] = { GTK_WIDGET (global->wf), GTK_WIDGET (global->wf_compare) };
+  gsize size = 0;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (panels); i++)
+    {
+      if (gtk_widget_get_mapped (panels[i]))
+        size += 2 * 4 * (gsize) gtk_widget_get_allocated_width (panels[i]) * gtk_widget_get_allocated_height (panels[i]);
+    }
+
+  return size;
+}
+
+/* Функция возвращает память таблиц цветовых палитр. */
+static gsize
+memory_palettes_usage (Global *global)
+{
+  gsize size = TONE_MAP_SIZE * sizeof (guint32);
+  guint i;
+
+  for (i = 0; i < palette_list_get_n (global->palettes); i++)
+    size += palette_list_get (global->palettes, i)->n_colors * sizeof (guint32);
+
+  return size;
+}
+
+/* Функция возвращает память таблицы и индекса меток. */
+static gsize
+memory_marks_usage (Global *global)
+{
+  return (global->marks != NULL) ? mark_index_get_memory (global->marks) : 0;
+}
+
+/* Функция возвращает оценку памяти списка галсов и навигационных
+ * данных текущего галса. */
+static gsize
+memory_tracks_usage (Global *global)
+{
+  gsize size;
+
+  size = TRACK_LIST_ROW_SIZE * gtk_tree_model_iter_n_children (global->track_list, NULL);
+  if (global->nav != NULL)
+    size += sizeof (NavPoint) * nav_index_get_n_points (global->nav);
+
+  return size;
+}
+
+/* Функция проверяет память процесса и отображает память подсистем. */
+static gboolean
+memory_update (Global *global)
+{
+  gchar *report, *text;
+
+  memory_budget_check (global->memory);
+
+  if (global->memory_value != NULL)
+    {
+      report = memory_budget_report (global->memory, "\n");
+      text = g_markup_printf_escaped ("<small>%s</small>", report);
+      gtk_label_set_markup (global->memory_value, text);
+      g_free (report);
+      g_free (text);
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Функция записывает память подсистем в журнал. */
+static gboolean
+memory_log (Global *global)
+{
+  gchar *report = memory_budget_report (global->memory, ", ");
+
+  g_message ("memory: %s", report);
+  g_free (report);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Функция длительного прогона. Списки галсов и меток перестраиваются
+ * так же, как при их изменении в базе данных, и периодически
+ * открывается следующий галс. Память при этом не должна расти. */
+static gboolean
+soak_update (Global *global)
+{
+  gint n_tracks;
+
+  if (g_get_monotonic_time () > global->soak_end)
+    {
+      g_message ("soak run finished");
+      gtk_main_quit ();
+      return G_SOURCE_REMOVE;
+    }
+
+  tracks_changed (global->db_info, global);
+  mark_manager_changed (global->mman, global);
+
+  n_tracks = gtk_tree_model_iter_n_children (global->track_list, NULL);
+  if ((n_tracks > 0) && !recording (global) && ((++global->soak_step % SOAK_TRACK_STEP) == 0))
+    {
+      GtkTreePath *path;
+
+      path = gtk_tree_path_new_from_indices ((global->soak_step / SOAK_TRACK_STEP) % n_tracks, -1);
+      gtk_tree_view_set_cursor (global->track_view, path, NULL, FALSE);
+      gtk_tree_path_free (path);
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+#ifdef SIDESCAN_TRACK_ALLOC
+/* Функция записывает в журнал места вызова с наибольшей неосвобождённой памятью. */
+static gboolean
+alloc_track_update (Global *global)
+{
+  alloc_track_report (ALLOC_TRACK_N_SITES);
+
+  return G_SOURCE_CONTINUE;
+}
+#endif
+
+/* Функция сообщает об изменении числа рабочих мест, принимающих строки. */
+static gboolean
+line_server_check (Global *global)
+{
+  guint n_clients = line_server_get_n_clients (global->line_server);
+
+  if (n_clients != global->n_line_clients)
+    g_message ("line server: %u viewer(s) connected", n_clients);
+  global->n_line_clients = n_clients;
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Функция проверяет, пересекаются ли области двух целей. */
+static gboolean
+detector_targets_overlap (const DetectorTarget *a,
+                          const DetectorTarget *b)
+{
+  guint64 index_distance = (a->index > b->index) ? a->index - b->index : b->index - a->index;
+  guint64 count_distance = (a->count > b->count) ? a->count - b->count : b->count - a->count;
+
+  return (a->source == b->source) &&
+         (index_distance <= (guint64) a->height + b->height) &&
+         (count_distance <= (guint64) a->width + b->width);
+}
+
+/* Функция добавляет цели, найденные обнаружителем, в список меток как
+ * предварительные метки. Цели, накопленные за период обновления, по одной
+ * добавляются в базу данных. Цель, пересекающаяся с меткой галса или с
+ * уже добавленной при этом обновлении целью, не добавляется: таблица меток
+ * global->marks обновится только после того, как менеджер меток сообщит
+ * об изменении. Оператор подтверждает метку, изменяя её в редакторе,
+ * или удаляет её. */
+static gboolean
+detector_update (Global *global)
+{
+  GArray *targets;
+  GArray *accepted;
+  GDateTime *now;
+  gchar *time_text;
+  gchar *text;
+  guint i, j;
+
+  if ((global->detector == NULL) || (global->mman == NULL))
+    return G_SOURCE_CONTINUE;
+
+  if ((targets = detector_take_targets (global->detector)) == NULL)
+    return G_SOURCE_CONTINUE;
+
+  accepted = g_array_new (FALSE, FALSE, sizeof (DetectorTarget));
+
+  /* Название метки содержит галс и время обнаружения, чтобы не совпадать
+   * с метками других галсов и предыдущих запусков. */
+  now = g_date_time_new_now_local ();
+  time_text = g_date_time_format (now, "%H:%M:%S");
+  g_date_time_unref (now);
+
+  for (i = 0; i < targets->len; i++)
+    {
+      DetectorTarget *target = &g_array_index (targets, DetectorTarget, i);
+      HyScanWaterfallMark mark;
+      gchar *name;
+      gchar *description;
+
+      for (j = 0; j < accepted->len; j++)
+        if (detector_targets_overlap (target, &g_array_index (accepted, DetectorTarget, j)))
+          break;
+
+      if (j < accepted->len)
+        continue;
+
+      if (global->marks != NULL)
+        {
+          GPtrArray *ids;
+          guint n_ids;
+
+          ids = mark_index_query_track (global->marks, global->track_name, target->source,
+                                        target->index - MIN (target->index, target->height),
+                                        target->index + target->height,
+                                        target->count - MIN (target->count, target->width),
+                                        target->count + target->width);
+          n_ids = ids->len;
+          g_ptr_array_unref (ids);
+
+          if (n_ids > 0)
+            continue;
+        }
+
+      g_array_append_val (accepted, *target);
+
+      global->n_detected += 1;
+      name = g_strdup_printf ("? Цель %u (%s, %s)", global->n_detected, global->track_name, time_text);
+      description = g_strdup_printf ("Превышение над фоном %.1f дБ", target->snr);
+
+      memset (&mark, 0, sizeof (mark));
+      mark.track = global->track_name;
+      mark.name = name;
+      mark.description = description;
+      mark.operator_name = DETECTOR_OPERATOR;
+      mark.creation_time = mark.modification_time = g_get_real_time ();
+      mark.source0 = target->source;
+      mark.index0 = target->index;
+      mark.count0 = target->count;
+      mark.width = target->width;
+      mark.height = target->height;
+
+      hyscan_mark_manager_add_mark (global->mman, &mark);
+
+      g_free (name);
+      g_free (description);
+    }
+
+  g_free (time_text);
+  g_array_unref (accepted);
+  g_array_unref (targets);
+
+  text = g_strdup_printf ("<small><b>%u</b></small>", global->n_detected);
+  gtk_label_set_markup (global->detector_value, text);
+  g_free (text);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Обработчик включения обнаружения целей. */
+static gboolean
+detector_view (GtkWidget  *widget,
+               gboolean    state,
+               Global     *global)
+{
+  gtk_switch_set_state (GTK_SWITCH (widget), state);
+  detector_track_set (global);
+
+  return TRUE;
+}
+
+/* Обработчик включения автоматической яркости. */
+static gboolean
+auto_brightness_view (GtkWidget  *widget,
+                      gboolean    state,
+                      Global     *global)
+{
+  g_clear_pointer (&global->auto_levels, auto_levels_free);
+  if (state && (global->track_name != NULL))
+    {
+      global->auto_levels = auto_levels_new (global->db, global->project_name,
+                                             global->track_name, global->track_raw);
+    }
+
+  global->auto_applied = FALSE;
+  brightness_set (global, global->cur_brightness);
+  gtk_switch_set_state (GTK_SWITCH (widget), state);
+
+  return TRUE;
+}
+
+/* Обработчик включения сжатия динамического диапазона. */
+static gboolean
+tone_view (GtkWidget  *widget,
+           gboolean    state,
+           Global     *global)
+{
+  gtk_switch_set_state (GTK_SWITCH (widget), state);
+  tone_track_set (global);
+
+  return TRUE;
+}
+
+/* Обработчик включения режима сравнения галсов. */
+static gboolean
+compare_view (GtkWidget  *widget,
+              gboolean    state,
+              Global     *global)
+{
+  if (state)
+    {
+      gtk_widget_show_all (global->wf_compare_overlay);
+    }
+  else
+    {
+      hyscan_gtk_waterfall_state_set_track (global->wf_compare_state, NULL, NULL, NULL, FALSE);
+      g_clear_pointer (&global->compare_track, g_free);
+      gtk_widget_hide (global->wf_compare_overlay);
+      gtk_switch_set_active (global->sync_view, FALSE);
+    }
+
+  gtk_widget_set_sensitive (GTK_WIDGET (global->sync_view), state);
+  gtk_switch_set_state (GTK_SWITCH (widget), state);
+
+  return TRUE;
+}
+
+/* Обработчик включения синхронного просмотра. */
+static gboolean
+sync_view (GtkWidget  *widget,
+           gboolean    state,
+           Global     *global)
+{
+  /* Вторая панель сразу переходит к области просмотра основной. */
+  memset (global->sync_main, 0, sizeof (global->sync_main));
+  memset (global->sync_compare, 0, sizeof (global->sync_compare));
+
+  gtk_switch_set_state (GTK_SWITCH (widget), state);
+
+  return TRUE;
+}
+
+/* Функция синхронизирует области просмотра панелей. Область панели,
+ * которую переместил пользователь, переносится в другую панель. */
+static gboolean
+views_sync (Global *global)
+{
+  gdouble view_main[4];
+  gdouble view_compare[4];
+
+  if (!gtk_switch_get_state (global->sync_view) || (global->compare_track == NULL))
+    return G_SOURCE_CONTINUE;
+
+  gtk_cifro_area_get_view (GTK_CIFRO_AREA (global->wf),
+                           &view_main[0], &view_main[1], &view_main[2], &view_main[3]);
+  gtk_cifro_area_get_view (GTK_CIFRO_AREA (global->wf_compare),
+                           &view_compare[0], &view_compare[1], &view_compare[2], &view_compare[3]);
+
+  if (memcmp (view_main, global->sync_main, sizeof (view_main)) != 0)
+    {
+      gtk_cifro_area_set_view (GTK_CIFRO_AREA (global->wf_compare),
+                               view_main[0], view_main[1], view_main[2], view_main[3]);
+      memcpy (view_compare, view_main, sizeof (view_main));
+    }
+  else if (memcmp (view_compare, global->sync_compare, sizeof (view_compare)) != 0)
+    {
+      gtk_cifro_area_set_view (GTK_CIFRO_AREA (global->wf),
+                               view_compare[0], view_compare[1], view_compare[2], view_compare[3]);
+      memcpy (view_main, view_compare, sizeof (view_compare));
+    }
+
+  memcpy (global->sync_main, view_main, sizeof (view_main));
+  memcpy (global->sync_compare, view_compare, sizeof (view_compare));
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Функция устанавливает начало области просмотра водопада вдоль галса
+ * и отображает положение на шкале воспроизведения. */
+static void
+replay_move (Global  *global,
+             gdouble  position)
+{
+  gdouble from_x, to_x, from_y, to_y;
+  gdouble min_x, max_x, min_y, max_y;
+  gdouble height;
+
+  gtk_cifro_area_get_view (GTK_CIFRO_AREA (global->wf), &from_x, &to_x, &from_y, &to_y);
+  gtk_cifro_area_get_limits (GTK_CIFRO_AREA (global->wf), &min_x, &max_x, &min_y, &max_y);
+
+  height = to_y - from_y;
+  position = CLAMP (position, min_y, MAX (min_y, max_y - height));
+  gtk_cifro_area_set_view (GTK_CIFRO_AREA (global->wf), from_x, to_x, position, position + height);
+  global->replay.position = position;
+
+  global->replay.update = TRUE;
+  if (max_y - height > min_y)
+    gtk_adjustment_set_value (global->replay_position, 100.0 * (position - min_y) / (max_y - height - min_y));
+  global->replay.update = FALSE;
+}
+
+/* Функция воспроизведения галса. Область просмотра сдвигается вдоль галса
+ * со скоростью судна, умноженной на выбранный коэффициент. */
+static gboolean
+replay_tick (Global *global)
+{
+  gdouble from_x, to_x, from_y, to_y;
+  gdouble min_x, max_x, min_y, max_y;
+  gdouble speed;
+  gint64 now;
+  gdouble dt;
+
+  now = g_get_monotonic_time ();
+  dt = (now - global->replay.last_tick) / 1e6;
+  global->replay.last_tick = now;
+
+  global->replay.n_ticks += 1;
+  if (dt > 2.0 * REPLAY_PERIOD / 1000.0)
+    global->replay.n_late += 1;
+
+  speed = global->track_speed * replay_speeds[global->replay.speed];
+  replay_move (global, global->replay.position + speed * dt);
+
+  /* Конец галса. */
+  gtk_cifro_area_get_view (GTK_CIFRO_AREA (global->wf), &from_x, &to_x, &from_y, &to_y);
+  gtk_cifro_area_get_limits (GTK_CIFRO_AREA (global->wf), &min_x, &max_x, &min_y, &max_y);
+  if (to_y >= max_y)
+    {
+      global->replay.timer = 0;
+      gtk_switch_set_active (global->replay_switch, FALSE);
+
+      return G_SOURCE_REMOVE;
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Обработчик включения воспроизведения галса. Выключение
+ * воспроизведения приостанавливает его в текущем положении. */
+static gboolean
+replay (GtkWidget  *widget,
+        gboolean    state,
+        Global     *global)
+{
+  if (state)
+    {
+      gdouble from_x, to_x, from_y, to_y;
+
+      if ((global->track_name == NULL) || recording (global))
+        {
+          gtk_switch_set_active (GTK_SWITCH (widget), FALSE);
+          return TRUE;
+        }
+
+      gtk_switch_set_active (global->live_view, FALSE);
+
+      gtk_cifro_area_get_view (GTK_CIFRO_AREA (global->wf), &from_x, &to_x, &from_y, &to_y);
+      global->replay.position = from_y;
+      global->replay.last_tick = g_get_monotonic_time ();
+      global->replay.start_time = global->replay.last_tick;
+      global->replay.start_position = from_y;
+      global->replay.n_ticks = 0;
+      global->replay.n_late = 0;
+
+      if (global->replay.timer == 0)
+        global->replay.timer = g_timeout_add (REPLAY_PERIOD, (GSourceFunc) replay_tick, global);
+    }
+  else
+    {
+      if (global->replay.timer != 0)
+        {
+          g_source_remove (global->replay.timer);
+          global->replay.timer = 0;
+        }
+
+      /* Скорость воспроизведения фактическая и заданная, число задержек обновления. */
+      if (gtk_switch_get_state (GTK_SWITCH (widget)) && (global->replay.n_ticks > 0))
+        {
+          gdouble elapsed = (g_get_monotonic_time () - global->replay.start_time) / 1e6;
+
+          g_message ("replay: %.1f m/s of %.1f m/s, %u of %u updates late",
+                     (global->replay.position - global->replay.start_position) / elapsed,
+                     global->track_speed * replay_speeds[global->replay.speed],
+                     global->replay.n_late, global->replay.n_ticks);
+        }
+    }
+
+  gtk_switch_set_state (GTK_SWITCH (widget), state);
+
+  return TRUE;
+}
+
+/* Функция отображает скорость воспроизведения. */
+static void
+replay_speed_set (Global *global)
 {
-  gdouble cur_brightness;
-
-  if (global->cur_brightness > 90.0)
-    cur_brightness = global->cur_brightness - 1.0;
-  else if (global->cur_brightness > 50.0)
-    cur_brightness = global->cur_brightness - 5.0;
-  else
-    cur_brightness = global->cur_brightness - 10.0;
+  gchar *text;
 
-  if (brightness_set (global, cur_brightness))
-    global->cur_brightness = cur_brightness;
+  text = g_strdup_printf ("<small><b>%ux</b></small>", replay_speeds[global->replay.speed]);
+  gtk_label_set_markup (global->replay_speed_value, text);
+  g_free (text);
 }
 
 static void
-color_map_up (GtkWidget *widget,
-              Global    *global)
+replay_speed_up (GtkWidget *widget,
+                 Global    *global)
 {
-  guint cur_color_map = global->cur_color_map + 1;
+  if (global->replay.speed + 1 < G_N_ELEMENTS (replay_speeds))
+    global->replay.speed += 1;
 
-  if (color_map_set (global, cur_color_map))
-    global->cur_color_map = cur_color_map;
+  replay_speed_set (global);
 }
 
 static void
-color_map_down (GtkWidget *widget,
-                Global    *global)
+replay_speed_down (GtkWidget *widget,
+                   Global    *global)
 {
-  guint cur_color_map = global->cur_color_map - 1;
+  if (global->replay.speed > 0)
+    global->replay.speed -= 1;
 
-  if (color_map_set (global, cur_color_map))
-    global->cur_color_map = cur_color_map;
+  replay_speed_set (global);
 }
 
+/* Обработчик перемещения по шкале воспроизведения. */
 static void
-scale_up (GtkWidget *widget,
-          Global    *global)
+replay_seek (GtkRange *range,
+             Global   *global)
 {
-  hyscan_gtk_waterfall_control_zoom (global->wf_control, TRUE);
-  scale_set (global);
+  gdouble from_x, to_x, from_y, to_y;
+  gdouble min_x, max_x, min_y, max_y;
+  gdouble value;
+
+  if (global->replay.update || (global->track_name == NULL))
+    return;
+
+  gtk_switch_set_active (global->live_view, FALSE);
+
+  gtk_cifro_area_get_view (GTK_CIFRO_AREA (global->wf), &from_x, &to_x, &from_y, &to_y);
+  gtk_cifro_area_get_limits (GTK_CIFRO_AREA (global->wf), &min_x, &max_x, &min_y, &max_y);
+
+  value = gtk_range_get_value (range) / 100.0;
+  replay_move (global, min_y + value * (max_y - (to_y - from_y) - min_y));
 }
 
-static void
-scale_down (GtkWidget *widget,
-            Global    *global)
+/* Функция отображает число записанных и пропущенных строк
+ * записываемого галса. */
+static gboolean
+lines_update (Global *global)
 {
-  hyscan_gtk_waterfall_control_zoom (global->wf_control, FALSE);
-  scale_set (global);
+  guint64 n_lines, n_dropped;
+  gchar *text;
+
+  if ((global->lines == NULL) || !recording (global))
+    return G_SOURCE_CONTINUE;
+
+  if (line_monitor_update (global->lines) == 0)
+    return G_SOURCE_CONTINUE;
+
+  line_monitor_get_stats (global->lines, &n_lines, &n_dropped);
+  if (n_dropped > 0)
+    text = g_strdup_printf ("<small><b><span foreground=\"red\">%" G_GUINT64_FORMAT "</span> / %" G_GUINT64_FORMAT "</b></small>",
+                            n_dropped, n_lines + n_dropped);
+  else
+    text = g_strdup_printf ("<small><b>0 / %" G_GUINT64_FORMAT "</b></small>", n_lines);
+  gtk_label_set_markup (global->lines_value, text);
+  g_free (text);
+
+  return G_SOURCE_CONTINUE;
 }
 
+/* Функция запрашивает упреждающее чтение данных галса
+ * для текущей области просмотра водопада. */
 static gboolean
-live_view (GtkWidget  *widget,
-           gboolean    state,
-           Global     *global)
+prefetch_update (Global *global)
 {
-  if (state)
-    {
-      if (!gtk_switch_get_state (global->live_view))
-        hyscan_gtk_waterfall_automove (global->wf, state);
+  gdouble from_x, to_x, from_y, to_y;
+  gdouble min_x, max_x, min_y, max_y;
 
-      gtk_switch_set_state (global->live_view, TRUE);
-    }
-  else
-    {
-      if (gtk_switch_get_state (global->live_view))
-        hyscan_gtk_waterfall_automove (global->wf, state);
+  if (global->prefetch == NULL)
+    return G_SOURCE_CONTINUE;
 
-      gtk_switch_set_state (global->live_view, FALSE);
-    }
+  gtk_cifro_area_get_view (GTK_CIFRO_AREA (global->wf), &from_x, &to_x, &from_y, &to_y);
+  gtk_cifro_area_get_limits (GTK_CIFRO_AREA (global->wf), &min_x, &max_x, &min_y, &max_y);
+  if (max_y <= min_y)
+    return G_SOURCE_CONTINUE;
 
-  return TRUE;
+  track_prefetch_view (global->prefetch,
+                       (from_y - min_y) / (max_y - min_y),
+                       (to_y - min_y) / (max_y - min_y));
+
+  return G_SOURCE_CONTINUE;
 }
 
 static void
@@ -804,10 +2187,10 @@ start_stop (GtkWidget  *widget,
 {
   if (state)
     {
-      static gint n_tracks = -1;
       gboolean status;
 
       /* Закрываем текущий открытый галс. */
+      gtk_switch_set_active (global->replay_switch, FALSE);
       hyscan_gtk_waterfall_state_set_track (global->wf_state, NULL, NULL, NULL, FALSE);
       g_clear_pointer(&global->track_name, g_free);
 
@@ -825,21 +2208,21 @@ start_stop (GtkWidget  *widget,
         }
 
       /* Число галсов в проекте. */
-      if (n_tracks < 0)
+      if (global->n_tracks < 0)
         {
           gint32 project_id;
           gchar **tracks;
 
           project_id = hyscan_db_project_open (global->db, global->project_name);
           tracks = hyscan_db_track_list (global->db, project_id);
-          n_tracks = (tracks == NULL) ? 0 : g_strv_length (tracks);
+          global->n_tracks = (tracks == NULL) ? 0 : g_strv_length (tracks);
 
           hyscan_db_close (global->db, project_id);
           g_free (tracks);
         }
 
       /* Включаем запись нового галса. */
-      global->track_name = g_strdup_printf ("%s%d%s", global->track_prefix, ++n_tracks + 1, global->power ? "" : DRY_TRACK_SUFFIX);
+      global->track_name = g_strdup_printf ("%s%d%s", global->track_prefix, ++global->n_tracks + 1, global->power ? "" : DRY_TRACK_SUFFIX);
       status = hyscan_sonar_control_start (global->sonar.sonar, global->track_name, HYSCAN_TRACK_SURVEY);
 
       /* Если локатор включён, открываем галс и переходим в режим онлайн. */
@@ -871,6 +2254,163 @@ start_stop (GtkWidget  *widget,
   return TRUE;
 }
 
+/* Функция включает/выключает генератор борта. */
+static gboolean
+board_generator_enable (Global   *global,
+                        Board    *board,
+                        gpointer  data)
+{
+  return hyscan_generator_control_set_enable (global->sonar.gen, board->source, *(gboolean*)data);
+}
+
+/* Функция проверяет возможности и включает генератор и ВАРУ борта,
+ * а также загружает список сигналов зондирования. */
+static gboolean
+board_setup (Global   *global,
+             Board    *board,
+             gpointer  data)
+{
+  HyScanGeneratorModeType gen_cap;
+  HyScanTVGModeType tvg_cap;
+  guint i;
+
+  /* Параметры генератора. */
+  gen_cap = hyscan_generator_control_get_capabilities (global->sonar.gen, board->source);
+  if (!(gen_cap & HYSCAN_GENERATOR_MODE_PRESET))
+    {
+      g_message ("%s: unsupported generator mode", board->name);
+      return FALSE;
+    }
+
+  if (!hyscan_generator_control_set_enable (global->sonar.gen, board->source, TRUE))
+    {
+      g_message ("%s: can't enable generator", board->name);
+      return FALSE;
+    }
+
+  /* Параметры ВАРУ. */
+  tvg_cap = hyscan_tvg_control_get_capabilities (global->sonar.tvg, board->source);
+  if (!(tvg_cap & HYSCAN_TVG_MODE_AUTO))
+    {
+      g_message ("%s: unsupported tvg mode", board->name);
+      return FALSE;
+    }
+
+  if (!hyscan_tvg_control_set_enable (global->sonar.tvg, board->source, TRUE))
+    {
+      g_message ("%s: can't enable tvg", board->name);
+      return FALSE;
+    }
+
+  /* Сигналы зондирования. */
+  board->signals = hyscan_generator_control_list_presets (global->sonar.gen, board->source);
+  if (board->signals == NULL)
+    {
+      g_message ("%s: can't load signal presets", board->name);
+      return FALSE;
+    }
+
+  for (i = 0; board->signals[i] != NULL; i++);
+  board->n_signals = i;
+
+  return TRUE;
+}
+
+/* Функция настраивает местоположение антенны борта. */
+static gboolean
+board_antenna_setup (Global   *global,
+                     Board    *board,
+                     gpointer  data)
+{
+  ProfileChange *change = data;
+
+  return sonar_profile_apply_antenna (global->sonar.sonar, change->profile, change->prev, board->source);
+}
+
+/* Функция компилирует профиль конфигурации датчиков и антенн бортов. */
+static SonarProfile *
+profile_new (Global   *global,
+             GKeyFile *config)
+{
+  HyScanSourceType sources[N_BOARDS];
+  guint i;
+
+  for (i = 0; i < N_BOARDS; i++)
+    sources[i] = global->sonar.boards[i].source;
+
+  return sonar_profile_new (global->sonar.sonar, config, sources, N_BOARDS);
+}
+
+/* Функция настраивает датчики и антенны бортов по профилю. Если указан
+ * предыдущий профиль, настраиваются только изменившиеся порты и антенны. */
+static gboolean
+profile_apply (Global       *global,
+               SonarProfile *profile,
+               SonarProfile *prev)
+{
+  ProfileChange change;
+
+  change.profile = profile;
+  change.prev = prev;
+
+  return sonar_profile_apply_sensors (global->sonar.sonar, profile, prev) &&
+         boards_run (global, board_antenna_setup, &change);
+}
+
+/* Функция вызывается при изменении файла конфигурации и применяет
+ * к гидролокатору только изменившиеся параметры. */
+static void
+config_changed (GFileMonitor      *monitor,
+                GFile             *file,
+                GFile             *other_file,
+                GFileMonitorEvent  event,
+                Global            *global)
+{
+  GKeyFile *config;
+  SonarProfile *profile;
+
+  if (event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+    return;
+
+  config = g_key_file_new ();
+  if (!g_key_file_load_from_file (config, global->config_file, G_KEY_FILE_NONE, NULL))
+    {
+      g_message ("can't load configuration '%s'", global->config_file);
+      g_key_file_unref (config);
+      return;
+    }
+
+  profile = profile_new (global, config);
+  g_key_file_unref (config);
+
+  if (profile == NULL)
+    {
+      g_message ("configuration '%s' is incorrect, keeping current one", global->config_file);
+      return;
+    }
+
+  if (!global->sonar.profile_failed &&
+      (g_strcmp0 (sonar_profile_get_hash (profile), sonar_profile_get_hash (global->sonar.profile)) == 0))
+    {
+      sonar_profile_free (profile);
+      return;
+    }
+
+  /* При ошибке состояние гидролокатора неизвестно, поэтому профиль не
+   * заменяется, а при следующем изменении настраивается всё. */
+  if (!profile_apply (global, profile, global->sonar.profile_failed ? NULL : global->sonar.profile))
+    {
+      g_message ("can't apply configuration '%s'", global->config_file);
+      global->sonar.profile_failed = TRUE;
+      sonar_profile_free (profile);
+      return;
+    }
+
+  global->sonar.profile_failed = FALSE;
+  sonar_profile_free (global->sonar.profile);
+  global->sonar.profile = profile;
+}
+
 /* Функция включает/выключает сухую поверку. */
 static gboolean
 start_stop_dry (GtkWidget *widget,
@@ -880,10 +2420,7 @@ start_stop_dry (GtkWidget *widget,
   global->power = !state;
 
   if (global->sonar.gen != NULL)
-    {
-      hyscan_generator_control_set_enable (global->sonar.gen, HYSCAN_SOURCE_SIDE_SCAN_STARBOARD, global->power);
-      hyscan_generator_control_set_enable (global->sonar.gen, HYSCAN_SOURCE_SIDE_SCAN_PORT, global->power);
-    }
+    boards_run (global, board_generator_enable, &global->power);
 
   start_stop (widget, state, global);
 
@@ -946,14 +2483,23 @@ make_overlay (HyScanGtkWaterfall          *wf,
   gtk_widget_set_valign (lay_box, GTK_ALIGN_END);
   gtk_widget_set_margin_bottom (lay_box, 12);
 
+  /* Слои, не возвращённые вызывающему, освобождаются вместе с панелью. */
   if (_grid != NULL)
     *_grid = grid;
+  else
+    g_object_set_data_full (G_OBJECT (overlay), "grid", grid, g_object_unref);
   if (_ctrl != NULL)
     *_ctrl = ctrl;
+  else
+    g_object_set_data_full (G_OBJECT (overlay), "control", ctrl, g_object_unref);
   if (_mark != NULL)
     *_mark = mark;
+  else
+    g_object_set_data_full (G_OBJECT (overlay), "mark", mark, g_object_unref);
   if (_meter != NULL)
     *_meter = meter;
+  else
+    g_object_set_data_full (G_OBJECT (overlay), "meter", meter, g_object_unref);
 
   return overlay;
 }
@@ -973,6 +2519,25 @@ main (int    argc,
   gdouble              ship_speed = 1.8;         /* Скорость движения судна. */
   gboolean             full_screen = FALSE;      /* Признак полноэкранного режима. */
   gchar               *config_file = NULL;       /* Название файла конфигурации. */
+  gint                 nav_channel = 1;          /* Номер канала навигационных данных. */
+  gchar               *import_marks = NULL;      /* Файл для импорта меток. */
+  gchar               *export_marks = NULL;      /* Файл для экспорта меток. */
+  gchar               *archive_track = NULL;     /* Галс для упаковки в архив. */
+  gchar               *restore_track = NULL;     /* Галс для восстановления из архива. */
+  gchar               *mosaic_dir = NULL;        /* Каталог мозаики. */
+  gdouble              mosaic_resolution = 0.5;  /* Разрешение мозаики. */
+  gdouble              altitude = 0.0;           /* Высота гидролокатора над дном. */
+  gdouble              coverage_cell = 5.0;      /* Размер ячейки карты покрытия. */
+  gdouble              tvg_max_cpu = -1.0;       /* Максимальная доля процессора для ВАРУ. */
+  gdouble              tvg_min_cpu = -1.0;       /* Минимальная доля процессора для ВАРУ. */
+  gint                 tvg_threads = -1;         /* Число потоков ВАРУ. */
+  gint                 chunk_size = 0;           /* Размер части файлов данных. */
+  gint                 memory_limit = 0;         /* Ограничение памяти процесса. */
+  gboolean             memory_debug = FALSE;     /* Признак отображения памяти подсистем. */
+  gdouble              soak_hours = 0.0;         /* Длительность прогона. */
+  gint                 serve_port = 0;           /* Порт сервера строк. */
+  gchar               *connect_address = NULL;   /* Адрес сервера строк. */
+  GKeyFile            *config = NULL;            /* Конфигурация. */
 
   HyScanSonarDriver   *driver = NULL;            /* Драйвер гидролокатора. */
   HyScanParam         *sonar = NULL;             /* Интерфейс управления локатором. */
@@ -986,6 +2551,9 @@ main (int    argc,
   GtkWidget           *view_control = NULL;
   GtkWidget           *sonar_control = NULL;
   GtkWidget           *track_control = NULL;
+  GtkWidget           *panes = NULL;
+
+  guint                i;
 
   gtk_init (&argc, &argv);
 
@@ -1006,7 +2574,25 @@ main (int    argc,
         { "track-prefix", 't', 0, G_OPTION_ARG_STRING, &track_prefix, "Track name prefix", NULL },
         { "sound-velocity", 'v', 0, G_OPTION_ARG_DOUBLE, &sound_velocity, "Sound velocity, m/s", NULL },
         { "ship-speed", 'e', 0, G_OPTION_ARG_DOUBLE, &ship_speed, "Ship speed, m/s", NULL },
+        { "nav-channel", 0, 0, G_OPTION_ARG_INT, &nav_channel, "NMEA RMC channel number", NULL },
+        { "import-marks", 0, 0, G_OPTION_ARG_FILENAME, &import_marks, "Import marks from file (.csv or binary) and exit", NULL },
+        { "export-marks", 0, 0, G_OPTION_ARG_FILENAME, &export_marks, "Export marks to file (.csv or binary) and exit", NULL },
+        { "archive-track", 0, 0, G_OPTION_ARG_STRING, &archive_track, "Pack track into compressed archive and exit", NULL },
+        { "restore-track", 0, 0, G_OPTION_ARG_STRING, &restore_track, "Restore track from compressed archive and exit", NULL },
+        { "mosaic-dir", 0, 0, G_OPTION_ARG_FILENAME, &mosaic_dir, "Build project mosaic in directory", NULL },
+        { "mosaic-resolution", 0, 0, G_OPTION_ARG_DOUBLE, &mosaic_resolution, "Mosaic resolution, m/pixel", NULL },
+        { "altitude", 0, 0, G_OPTION_ARG_DOUBLE, &altitude, "Sonar altitude above the bottom for coverage map, m", NULL },
+        { "coverage-cell", 0, 0, G_OPTION_ARG_DOUBLE, &coverage_cell, "Coverage map cell size, m", NULL },
         { "full-screen", 'f', 0, G_OPTION_ARG_NONE, &full_screen, "Full screen mode", NULL },
+        { "tvg-max-cpu", 0, 0, G_OPTION_ARG_DOUBLE, &tvg_max_cpu, "Auto TVG maximum CPU usage, %", NULL },
+        { "tvg-min-cpu", 0, 0, G_OPTION_ARG_DOUBLE, &tvg_min_cpu, "Auto TVG minimum CPU usage under load, %", NULL },
+        { "tvg-threads", 0, 0, G_OPTION_ARG_INT, &tvg_threads, "Auto TVG threads number", NULL },
+        { "chunk-size", 0, 0, G_OPTION_ARG_INT, &chunk_size, "Recorded data file chunk size, Mb", NULL },
+        { "memory-limit", 0, 0, G_OPTION_ARG_INT, &memory_limit, "Process memory limit, Mb", NULL },
+        { "memory-debug", 0, 0, G_OPTION_ARG_NONE, &memory_debug, "Show memory usage of subsystems", NULL },
+        { "soak-hours", 0, 0, G_OPTION_ARG_DOUBLE, &soak_hours, "Refresh tracks and marks continuously and exit after hours", NULL },
+        { "serve-lines", 0, 0, G_OPTION_ARG_INT, &serve_port, "Stream recorded lines to viewers on port", NULL },
+        { "connect", 0, 0, G_OPTION_ARG_STRING, &connect_address, "Receive lines from recording station host[:port]", NULL },
         { NULL }
       };
 
@@ -1032,6 +2618,13 @@ main (int    argc,
         return 0;
       }
 
+    /* Размер части задаётся в байтах числом gint32. */
+    if ((chunk_size < 0) || (chunk_size > MAX_CHUNK_SIZE))
+      {
+        g_print ("chunk size must not exceed %d Mb\n", MAX_CHUNK_SIZE);
+        return -1;
+      }
+
     if (args[1] != NULL)
       config_file = g_strdup (args[1]);
 
@@ -1047,14 +2640,32 @@ main (int    argc,
   if (track_prefix == NULL)
     track_prefix = g_strdup ("SS");
 
+  /* Борта гидролокатора. */
+  global.sonar.boards[0].source = HYSCAN_SOURCE_SIDE_SCAN_STARBOARD;
+  global.sonar.boards[0].name = "starboard";
+  global.sonar.boards[1].source = HYSCAN_SOURCE_SIDE_SCAN_PORT;
+  global.sonar.boards[1].name = "port";
+
   /* Конфигурация. */
   global.full_screen = full_screen;
-  global.project_name = project_name;
+  global.db_uri = db_uri;
+  global.project_name = g_strdup (project_name);
+  global.n_tracks = -1;
   global.track_prefix = track_prefix;
+  global.nav_channel = (nav_channel > 0) ? nav_channel : 1;
 
   /* Кэш. */
   if (cache_size <= 0)
     cache_size = 256;
+
+  /* Кэш занимает не более половины памяти, отведённой процессу. */
+  if ((memory_limit > 0) && (cache_size > memory_limit / 2))
+    {
+      cache_size = MAX (memory_limit / 2, MEMORY_MIN_CACHE);
+      g_message ("cache size limited to %d Mb", cache_size);
+    }
+
+  global.cache_size = cache_size;
   global.cache = HYSCAN_CACHE (hyscan_cached_new (cache_size));
 
   /* Подключение к базе данных. */
@@ -1065,18 +2676,57 @@ main (int    argc,
       goto exit;
     }
 
+  /* Импорт и экспорт меток без запуска интерфейса. */
+  if ((import_marks != NULL) || (export_marks != NULL))
+    {
+      if (import_marks != NULL)
+        mark_transfer_import (global.db, project_name, import_marks);
+      if (export_marks != NULL)
+        mark_transfer_export (global.db, project_name, export_marks);
+
+      goto exit;
+    }
+
+  /* Упаковка и восстановление галсов без запуска интерфейса. */
+  if ((archive_track != NULL) || (restore_track != NULL))
+    {
+      if (archive_track != NULL)
+        track_archive_pack (global.db, db_uri, project_name, archive_track);
+      if (restore_track != NULL)
+        track_archive_unpack (db_uri, project_name, restore_track);
+
+      goto exit;
+    }
+
   /* Монитор базы данных. */
   global.db_info = hyscan_db_info_new (global.db);
 
+  /* Передача строк между станцией записи и рабочими местами просмотра. */
+  if (serve_port > 0)
+    global.line_server = line_server_new (global.db, serve_port);
+  if (connect_address != NULL)
+    global.line_client = line_client_new (global.db, project_name, connect_address);
+
+  /* Построение мозаики проекта. */
+  if (mosaic_dir != NULL)
+    {
+      global.mosaic = mosaic_new (global.db, project_name, mosaic_dir, mosaic_resolution,
+                                  global.nav_channel, sound_velocity);
+      if (global.mosaic != NULL)
+        global.mosaic_thread = g_thread_new ("mosaic", (GThreadFunc) mosaic_thread, &global);
+    }
+
   /* Подключение к гидролокатору. */
   if (sonar_uri != NULL)
     {
-      HyScanGeneratorModeType gen_cap;
-      HyScanTVGModeType tvg_cap;
       HyScanSonarClient *client;
-      GKeyFile *config;
-      gboolean status;
-      guint i;
+
+      /* Файл конфигурации. */
+      if (config_file != NULL)
+        {
+          config = g_key_file_new ();
+          g_key_file_load_from_file (config, config_file, G_KEY_FILE_NONE, NULL);
+        }
 
       /* Подключение к гидролокатору с помощью HyScanSonarClient */
       if (driver_name == NULL)
@@ -1125,127 +2775,80 @@ main (int    argc,
           goto exit;
         }
 
+      /* Крупные части файлов данных уменьшают число созданий файлов
+       * при записи с высокой частотой зондирования. */
+      if ((chunk_size > 0) &&
+          !hyscan_data_writer_set_chunk_size (HYSCAN_DATA_WRITER (global.sonar.sonar), chunk_size * 1024 * 1024))
+        {
+          g_message ("can't set chunk size");
+        }
+
+      global.sonar.param = sonar;
       global.sonar.gen = HYSCAN_GENERATOR_CONTROL (global.sonar.sonar);
       global.sonar.tvg = HYSCAN_TVG_CONTROL (global.sonar.sonar);
 
       /* Параметры локатора - только сырые данные. */
       hyscan_param_set_enum (HYSCAN_PARAM (sonar), "/parameters/data-type", 0);
-      hyscan_param_set_double (HYSCAN_PARAM (sonar), "/parameters/auto-tvg-max-cpu", 25.0);
-
-      /* Параметры генераторов. */
-      gen_cap = hyscan_generator_control_get_capabilities (global.sonar.gen,
-                                                           HYSCAN_SOURCE_SIDE_SCAN_STARBOARD);
-      if (!(gen_cap | HYSCAN_GENERATOR_MODE_PRESET))
-        {
-          g_message ("starboard: unsupported generator mode");
-          status = FALSE;
-          goto exit;
-        }
-
-      gen_cap = hyscan_generator_control_get_capabilities (global.sonar.gen,
-                                                           HYSCAN_SOURCE_SIDE_SCAN_PORT);
-      if (!(gen_cap | HYSCAN_GENERATOR_MODE_PRESET))
-        {
-          g_message ("port: unsupported generator mode");
-          status = FALSE;
-          goto exit;
-        }
-
-      status = hyscan_generator_control_set_enable (global.sonar.gen,
-                                                    HYSCAN_SOURCE_SIDE_SCAN_STARBOARD,
-                                                    TRUE);
-      if (!status)
-        {
-          g_message ("starboard: can't enable generator");
-          goto exit;
-        }
-
-      status = hyscan_generator_control_set_enable (global.sonar.gen,
-                                                    HYSCAN_SOURCE_SIDE_SCAN_PORT,
-                                                    TRUE);
-      global.power = TRUE;
-      if (!status)
-        {
-          g_message ("port: can't enable generator");
-          goto exit;
-        }
-
-      /* Параметры ВАРУ. */
-      tvg_cap = hyscan_tvg_control_get_capabilities (global.sonar.tvg,
-                                                     HYSCAN_SOURCE_SIDE_SCAN_STARBOARD);
-      if (!(tvg_cap | HYSCAN_TVG_MODE_AUTO))
-        {
-          g_message ("starboard: unsupported tvg mode");
-          status = FALSE;
-          goto exit;
-        }
-
-      tvg_cap = hyscan_tvg_control_get_capabilities (global.sonar.tvg,
-                                                     HYSCAN_SOURCE_SIDE_SCAN_PORT);
-      if (!(tvg_cap | HYSCAN_TVG_MODE_AUTO))
-        {
-          g_message ("port: unsupported tvg mode");
-          status = FALSE;
-          goto exit;
-        }
 
-      status = hyscan_tvg_control_set_enable (global.sonar.tvg,
-                                              HYSCAN_SOURCE_SIDE_SCAN_STARBOARD,
-                                              TRUE);
-      if (!status)
+      /* Ресурсы для автоматической ВАРУ. Параметры командной строки
+       * имеют приоритет над файлом конфигурации. */
+      if ((config != NULL) && g_key_file_has_group (config, "auto-tvg"))
         {
-          g_message ("starboard: can't enable tvg");
-          goto exit;
+          if ((tvg_max_cpu < 0.0) && g_key_file_has_key (config, "auto-tvg", "max-cpu", NULL))
+            tvg_max_cpu = g_key_file_get_double (config, "auto-tvg", "max-cpu", NULL);
+          if ((tvg_min_cpu < 0.0) && g_key_file_has_key (config, "auto-tvg", "min-cpu", NULL))
+            tvg_min_cpu = g_key_file_get_double (config, "auto-tvg", "min-cpu", NULL);
+          if ((tvg_threads < 0) && g_key_file_has_key (config, "auto-tvg", "threads", NULL))
+            tvg_threads = g_key_file_get_integer (config, "auto-tvg", "threads", NULL);
         }
 
-      status = hyscan_tvg_control_set_enable (global.sonar.tvg,
-                                              HYSCAN_SOURCE_SIDE_SCAN_PORT,
-                                              TRUE);
-      if (!status)
-        {
-          g_message ("port: can't enable tvg");
-          goto exit;
-        }
+      if ((tvg_max_cpu <= 0.0) || (tvg_max_cpu > 100.0))
+        tvg_max_cpu = AUTO_TVG_MAX_CPU;
+      if ((tvg_min_cpu <= 0.0) || (tvg_min_cpu > tvg_max_cpu))
+        tvg_min_cpu = MIN (AUTO_TVG_MIN_CPU, tvg_max_cpu);
 
-      /* Сигналы зондирования. */
-      global.sonar.starboard.signals = hyscan_generator_control_list_presets (global.sonar.gen,
-                                                                              HYSCAN_SOURCE_SIDE_SCAN_STARBOARD);
-      global.sonar.port.signals      = hyscan_generator_control_list_presets (global.sonar.gen,
-                                                                              HYSCAN_SOURCE_SIDE_SCAN_PORT);
+      global.sonar.max_tvg_cpu = tvg_max_cpu;
+      global.sonar.min_tvg_cpu = tvg_min_cpu;
+      global.sonar.cur_tvg_cpu = tvg_max_cpu;
 
-      if ((global.sonar.starboard.signals == NULL) || (global.sonar.port.signals == NULL))
+      if ((tvg_threads > 0) &&
+          !hyscan_param_set_integer (HYSCAN_PARAM (sonar), "/parameters/auto-tvg-threads", tvg_threads))
         {
-          g_message ("can't load signal presets");
-          goto exit;
+          g_message ("can't set auto tvg threads number");
         }
 
-      for (i = 0; global.sonar.starboard.signals[i] != NULL; i++);
-      global.sonar.starboard.n_signals = i;
+      /* Генераторы, ВАРУ и сигналы зондирования бортов. */
+      if (!boards_run (&global, board_setup, NULL))
+        goto exit;
 
-      for (i = 0; global.sonar.port.signals[i] != NULL; i++);
-      global.sonar.port.n_signals = i;
+      global.power = TRUE;
 
-      /* Настройка датчиков и антенн. */
-      if (config_file != NULL)
+      /* Настройка датчиков и антенн. Подключение к гидролокатору создаётся
+       * заново при каждом запуске, поэтому профиль применяется полностью.
+       * Профиль хранится для применения только изменившихся параметров
+       * при изменении файла конфигурации. */
+      if (config != NULL)
         {
-          config = g_key_file_new ();
-          g_key_file_load_from_file (config, config_file, G_KEY_FILE_NONE, NULL);
-
-          if (!setup_sensors (HYSCAN_SENSOR_CONTROL (global.sonar.sonar), config) ||
-              !setup_sonar_antenna (global.sonar.sonar, HYSCAN_SOURCE_SIDE_SCAN_STARBOARD, config) ||
-              !setup_sonar_antenna (global.sonar.sonar, HYSCAN_SOURCE_SIDE_SCAN_PORT, config))
-            {
-              status = FALSE;
-            }
-          else
-            {
-              status = TRUE;
-            }
-
-          g_key_file_unref (config);
+          global.sonar.profile = profile_new (&global, config);
+          if (global.sonar.profile == NULL)
+            goto exit;
 
-          if (!status)
+          if (!profile_apply (&global, global.sonar.profile, NULL))
             goto exit;
+
+          /* Отслеживаем изменения файла конфигурации. */
+          {
+            GFile *file = g_file_new_for_path (config_file);
+
+            global.config_file = config_file;
+            global.config_monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, NULL);
+            if (global.config_monitor != NULL)
+              {
+                g_signal_connect (global.config_monitor, "changed",
+                                  G_CALLBACK (config_changed), &global);
+              }
+            g_object_unref (file);
+          }
         }
 
       /* Рабочий проект. */
@@ -1271,10 +2874,28 @@ main (int    argc,
   global.scale_value = GTK_LABEL (gtk_builder_get_object (builder, "scale_value"));
   global.color_map_value = GTK_LABEL (gtk_builder_get_object (builder, "color_map_value"));
   global.live_view = GTK_SWITCH (gtk_builder_get_object (builder, "live_view"));
+  global.tone = GTK_SWITCH (gtk_builder_get_object (builder, "tone"));
+  global.auto_brightness = GTK_SWITCH (gtk_builder_get_object (builder, "auto_brightness"));
+  global.detector_switch = GTK_SWITCH (gtk_builder_get_object (builder, "detector"));
+  global.detector_value = GTK_LABEL (gtk_builder_get_object (builder, "detector_value"));
+  global.compare = GTK_SWITCH (gtk_builder_get_object (builder, "compare"));
+  global.sync_view = GTK_SWITCH (gtk_builder_get_object (builder, "sync_view"));
+  global.replay_switch = GTK_SWITCH (gtk_builder_get_object (builder, "replay"));
+  global.replay_speed_value = GTK_LABEL (gtk_builder_get_object (builder, "replay_speed_value"));
+  global.replay_position = GTK_ADJUSTMENT (gtk_builder_get_object (builder, "replay_position_range"));
   if ((global.brightness_value == NULL) ||
       (global.scale_value == NULL) ||
       (global.color_map_value == NULL) ||
-      (global.live_view == NULL))
+      (global.live_view == NULL) ||
+      (global.tone == NULL) ||
+      (global.auto_brightness == NULL) ||
+      (global.detector_switch == NULL) ||
+      (global.detector_value == NULL) ||
+      (global.compare == NULL) ||
+      (global.sync_view == NULL) ||
+      (global.replay_switch == NULL) ||
+      (global.replay_speed_value == NULL) ||
+      (global.replay_position == NULL))
     {
       g_message ("incorrect view control ui");
       goto exit;
@@ -1299,12 +2920,16 @@ main (int    argc,
       global.tvg_level_value = GTK_LABEL (gtk_builder_get_object (builder, "tvg_level_value"));
       global.tvg_sensitivity_value = GTK_LABEL (gtk_builder_get_object (builder, "tvg_sensitivity_value"));
       global.signal_value = GTK_LABEL (gtk_builder_get_object (builder, "signal_value"));
+      global.tvg_cpu_value = GTK_LABEL (gtk_builder_get_object (builder, "tvg_cpu_value"));
+      global.lines_value = GTK_LABEL (gtk_builder_get_object (builder, "lines_value"));
 
       if ((global.start_stop == NULL) ||
           (global.distance_value == NULL) ||
           (global.tvg_level_value == NULL) ||
           (global.tvg_sensitivity_value == NULL) ||
-          (global.signal_value == NULL))
+          (global.signal_value == NULL) ||
+          (global.tvg_cpu_value == NULL) ||
+          (global.lines_value == NULL))
         {
           g_message ("incorrect sonar control ui");
           goto exit;
@@ -1365,6 +2990,38 @@ main (int    argc,
   if (sonar != NULL)
     gtk_box_pack_end (GTK_BOX (control), sonar_control, FALSE, FALSE, 0);
 
+  /* Карта покрытия при записи галсов. */
+  if (sonar != NULL)
+    {
+      GtkWidget *coverage_label;
+
+      global.coverage = coverage_new (coverage_cell);
+      global.altitude = altitude;
+
+      coverage_label = gtk_label_new ("Покрытие");
+      global.coverage_value = GTK_LABEL (gtk_label_new (NULL));
+      global.coverage_area = gtk_drawing_area_new ();
+      gtk_widget_set_size_request (global.coverage_area, 200, 200);
+      g_signal_connect (global.coverage_area, "draw", G_CALLBACK (coverage_area_draw), &global);
+
+      gtk_box_pack_start (GTK_BOX (control), coverage_label, FALSE, FALSE, 6);
+      gtk_box_pack_start (GTK_BOX (control), global.coverage_area, FALSE, FALSE, 0);
+      gtk_box_pack_start (GTK_BOX (control), GTK_WIDGET (global.coverage_value), FALSE, FALSE, 6);
+    }
+
+  /* Память подсистем. */
+  if (memory_debug)
+    {
+      GtkWidget *memory_label;
+
+      memory_label = gtk_label_new ("Память");
+      global.memory_value = GTK_LABEL (gtk_label_new (NULL));
+      gtk_label_set_xalign (global.memory_value, 0.0);
+
+      gtk_box_pack_start (GTK_BOX (control), memory_label, FALSE, FALSE, 6);
+      gtk_box_pack_start (GTK_BOX (control), GTK_WIDGET (global.memory_value), FALSE, FALSE, 6);
+    }
+
   /* Основная раскладка окна. */
   container = hyscan_gtk_area_new ();
 
@@ -1384,13 +3041,34 @@ main (int    argc,
   gtk_widget_set_margin_top (GTK_WIDGET (global.wf), 12);
   gtk_widget_set_margin_bottom (GTK_WIDGET (global.wf), 12);
 
+  /* Водопад для сравнения галсов. Использует общий с основным водопадом
+   * кэш, поэтому тайлы одного и того же галса повторно не формируются. */
+  global.wf_compare = HYSCAN_GTK_WATERFALL (hyscan_gtk_waterfall_new ());
+  global.wf_compare_overlay = make_overlay (global.wf_compare, NULL, NULL, NULL, NULL);
+  global.wf_compare_state = HYSCAN_GTK_WATERFALL_STATE (global.wf_compare);
+
+  hyscan_gtk_waterfall_state_set_cache (global.wf_compare_state, global.cache, global.cache, NULL);
+  gtk_widget_set_hexpand (GTK_WIDGET (global.wf_compare), TRUE);
+  gtk_widget_set_vexpand (GTK_WIDGET (global.wf_compare), TRUE);
+  gtk_widget_set_margin_top (GTK_WIDGET (global.wf_compare), 12);
+  gtk_widget_set_margin_bottom (GTK_WIDGET (global.wf_compare), 12);
+  gtk_widget_set_no_show_all (global.wf_compare_overlay, TRUE);
+  gtk_widget_set_sensitive (GTK_WIDGET (global.sync_view), FALSE);
+
+  panes = gtk_paned_new (GTK_ORIENTATION_HORIZONTAL);
+  gtk_paned_pack1 (GTK_PANED (panes), overlay, TRUE, FALSE);
+  gtk_paned_pack2 (GTK_PANED (panes), global.wf_compare_overlay, TRUE, FALSE);
+
   /* Цвет подложки. */
   hyscan_gtk_waterfall_set_substrate (HYSCAN_GTK_WATERFALL (global.wf),
                                       hyscan_tile_color_converter_d2i (0.0, 0.0, 0.0, 1.0));
+  hyscan_gtk_waterfall_set_substrate (HYSCAN_GTK_WATERFALL (global.wf_compare),
+                                      hyscan_tile_color_converter_d2i (0.0, 0.0, 0.0, 1.0));
 
   /* Скорость обновления экрана. */
   hyscan_gtk_waterfall_set_automove_period (global.wf, 100000);
   hyscan_gtk_waterfall_set_regeneration_period (global.wf, 500000);
+  hyscan_gtk_waterfall_set_regeneration_period (global.wf_compare, 500000);
 
   /* Устанавливаем скорости движения судна и скорость звука в воде. */
   svp = g_array_new (FALSE, FALSE, sizeof (HyScanSoundVelocity));
@@ -1398,7 +3076,11 @@ main (int    argc,
   svp_val.velocity = sound_velocity;
   g_array_insert_val (svp, 0, svp_val);
   hyscan_gtk_waterfall_state_set_ship_speed (global.wf_state, ship_speed);
+  global.ship_speed = ship_speed;
+  global.track_speed = ship_speed;
   hyscan_gtk_waterfall_state_set_sound_velocity (global.wf_state, svp);
+  hyscan_gtk_waterfall_state_set_ship_speed (global.wf_compare_state, ship_speed);
+  hyscan_gtk_waterfall_state_set_sound_velocity (global.wf_compare_state, svp);
   g_array_unref (svp);
 
   /* Основное окно программы. */
@@ -1411,9 +3093,16 @@ main (int    argc,
   gtk_header_bar_set_show_close_button (GTK_HEADER_BAR (header), TRUE);
   gtk_header_bar_set_title (GTK_HEADER_BAR (header), "Боковой обзор");
   gtk_window_set_titlebar (GTK_WINDOW (global.window), header);
+  global.header = header;
+
+  /* Переключатель проектов. */
+  global.project_switch = GTK_COMBO_BOX_TEXT (gtk_combo_box_text_new ());
+  gtk_widget_set_tooltip_text (GTK_WIDGET (global.project_switch), "Проект");
+  gtk_header_bar_pack_start (GTK_HEADER_BAR (header), GTK_WIDGET (global.project_switch));
+  g_signal_connect (global.project_switch, "changed", G_CALLBACK (project_changed), &global);
 
   /* Разметка экрана. */
-  hyscan_gtk_area_set_central (HYSCAN_GTK_AREA (container), GTK_WIDGET (overlay));
+  hyscan_gtk_area_set_central (HYSCAN_GTK_AREA (container), panes);
   hyscan_gtk_area_set_left (HYSCAN_GTK_AREA (container), left_box);
   hyscan_gtk_area_set_right (HYSCAN_GTK_AREA (container), control);
   gtk_container_add (GTK_CONTAINER (global.window), container);
@@ -1425,6 +3114,38 @@ main (int    argc,
   g_signal_connect (G_OBJECT (global.db_info), "tracks-changed", G_CALLBACK (tracks_changed), &global);
   g_signal_connect (G_OBJECT (global.wf), "automove-state", G_CALLBACK (live_view_off), &global);
   g_signal_connect_swapped (G_OBJECT (global.wf), "waterfall-zoom", G_CALLBACK (scale_set), &global);
+  g_timeout_add (NAV_UPDATE_PERIOD, (GSourceFunc) nav_update, &global);
+  g_timeout_add (SYNC_VIEW_PERIOD, (GSourceFunc) views_sync, &global);
+  g_timeout_add (PREFETCH_PERIOD, (GSourceFunc) prefetch_update, &global);
+  g_timeout_add (TRACK_INDEX_UPDATE_PERIOD, (GSourceFunc) track_index_update, &global);
+  g_timeout_add (TONE_MAP_UPDATE_PERIOD, (GSourceFunc) tone_update, &global);
+  g_timeout_add (AUTO_LEVELS_PERIOD, (GSourceFunc) auto_levels_update_view, &global);
+  g_timeout_add (DETECTOR_UPDATE_PERIOD, (GSourceFunc) detector_update, &global);
+  if (global.line_server != NULL)
+    g_timeout_add (LINE_SERVER_CHECK_PERIOD, (GSourceFunc) line_server_check, &global);
+  if (global.lines_value != NULL)
+    g_timeout_add (LINES_UPDATE_PERIOD, (GSourceFunc) lines_update, &global);
+
+  /* Учёт памяти подсистем. */
+  global.memory = memory_budget_new ((gsize) MAX (memory_limit, 0) * 1024 * 1024);
+  memory_budget_add_limit (global.memory, "cache", (MemoryBudgetUsageFunc) memory_cache_usage,
+                           (MemoryBudgetShrinkFunc) memory_cache_shrink, &global);
+  memory_budget_add (global.memory, "tiles (estimate)", (MemoryBudgetUsageFunc) memory_tiles_usage, NULL, &global);
+  memory_budget_add (global.memory, "color maps", (MemoryBudgetUsageFunc) memory_palettes_usage, NULL, &global);
+  memory_budget_add (global.memory, "marks", (MemoryBudgetUsageFunc) memory_marks_usage, NULL, &global);
+  memory_budget_add (global.memory, "tracks", (MemoryBudgetUsageFunc) memory_tracks_usage, NULL, &global);
+  g_timeout_add (MEMORY_CHECK_PERIOD, (GSourceFunc) memory_update, &global);
+  g_timeout_add (MEMORY_LOG_PERIOD, (GSourceFunc) memory_log, &global);
+
+  /* Длительный прогон. */
+  if (soak_hours > 0.0)
+    {
+      global.soak_end = g_get_monotonic_time () + soak_hours * 3600.0 * G_USEC_PER_SEC;
+      g_timeout_add (SOAK_PERIOD, (GSourceFunc) soak_update, &global);
+    }
+#ifdef SIDESCAN_TRACK_ALLOC
+  g_timeout_add (ALLOC_TRACK_PERIOD, (GSourceFunc) alloc_track_update, &global);
+#endif
 
   gtk_builder_add_callback_symbol (builder, "track_scroll", G_CALLBACK (track_scroll));
   gtk_builder_add_callback_symbol (builder, "track_changed", G_CALLBACK (track_changed));
@@ -1436,6 +3157,15 @@ main (int    argc,
   gtk_builder_add_callback_symbol (builder, "scale_up", G_CALLBACK (scale_up));
   gtk_builder_add_callback_symbol (builder, "scale_down", G_CALLBACK (scale_down));
   gtk_builder_add_callback_symbol (builder, "live_view", G_CALLBACK (live_view));
+  gtk_builder_add_callback_symbol (builder, "auto_brightness_view", G_CALLBACK (auto_brightness_view));
+  gtk_builder_add_callback_symbol (builder, "tone_view", G_CALLBACK (tone_view));
+  gtk_builder_add_callback_symbol (builder, "detector_view", G_CALLBACK (detector_view));
+  gtk_builder_add_callback_symbol (builder, "compare_view", G_CALLBACK (compare_view));
+  gtk_builder_add_callback_symbol (builder, "sync_view", G_CALLBACK (sync_view));
+  gtk_builder_add_callback_symbol (builder, "replay", G_CALLBACK (replay));
+  gtk_builder_add_callback_symbol (builder, "replay_speed_up", G_CALLBACK (replay_speed_up));
+  gtk_builder_add_callback_symbol (builder, "replay_speed_down", G_CALLBACK (replay_speed_down));
+  gtk_builder_add_callback_symbol (builder, "replay_seek", G_CALLBACK (replay_seek));
 
   gtk_builder_add_callback_symbol (builder, "distance_up", G_CALLBACK (distance_up));
   gtk_builder_add_callback_symbol (builder, "distance_down", G_CALLBACK (distance_down));
@@ -1456,31 +3186,15 @@ main (int    argc,
   global.sonar.cur_tvg_sensitivity = 0.6;
   global.sonar.cur_distance = SIDE_SCAN_MAX_DISTANCE;
 
-  /* Цветовые палитры. */
-  {
-    guint i;
-
-    global.color_maps[0] = g_array_sized_new (FALSE, FALSE, sizeof (guint32), 256);
-    global.color_maps[1] = g_array_sized_new (FALSE, FALSE, sizeof (guint32), 256);
-    global.color_maps[2] = g_array_sized_new (FALSE, FALSE, sizeof (guint32), 256);
-
-    for (i = 0; i < 256; i++)
-      {
-        gdouble luminance = i / 255.0;
-        guint32 color;
-
-        color = hyscan_tile_color_converter_d2i (luminance, luminance, luminance, 1.0);
-        g_array_insert_val (global.color_maps[0], i, color);
-
-        color = hyscan_tile_color_converter_d2i (luminance, luminance, 0.0, 1.0);
-        g_array_insert_val (global.color_maps[1], i, color);
-
-        color = hyscan_tile_color_converter_d2i (0.0, luminance, 0.0, 1.0);
-        g_array_insert_val (global.color_maps[2], i, color);
-      }
+  /* Цветовые палитры: встроенные и из файла конфигурации. */
+  if ((config == NULL) && (config_file != NULL))
+    {
+      config = g_key_file_new ();
+      g_key_file_load_from_file (config, config_file, G_KEY_FILE_NONE, NULL);
+    }
 
-    global.cur_color_map = 0;
-  }
+  global.palettes = palette_list_new (config);
+  global.cur_color_map = 0;
 
   color_map_set (&global, global.cur_color_map);
   brightness_set (&global, global.cur_brightness);
@@ -1489,6 +3203,14 @@ main (int    argc,
       distance_set (&global, global.sonar.cur_distance);
       tvg_set (&global, global.sonar.cur_tvg_level, global.sonar.cur_tvg_sensitivity);
       signal_set (&global, global.sonar.cur_signal);
+      tvg_cpu_set (&global, global.sonar.cur_tvg_cpu);
+
+      /* Адаптация бюджета ВАРУ к загрузке. */
+      if (global.sonar.min_tvg_cpu < global.sonar.max_tvg_cpu)
+        {
+          global.sonar.tvg_cpu_check = g_get_monotonic_time ();
+          g_timeout_add (AUTO_TVG_CHECK_PERIOD, (GSourceFunc) tvg_cpu_control, &global);
+        }
     }
 
   if (full_screen)
@@ -1502,31 +3224,78 @@ main (int    argc,
     hyscan_sonar_control_stop (global.sonar.sonar);
 
 exit:
+  if (global.mosaic_thread != NULL)
+    {
+      g_atomic_int_set (&global.mosaic_stop, TRUE);
+      g_thread_join (global.mosaic_thread);
+    }
+  g_clear_pointer (&global.mosaic, mosaic_free);
+
   g_clear_object (&builder);
 
+  g_clear_pointer (&global.tone_map, tone_map_free);
+  g_clear_pointer (&global.auto_levels, auto_levels_free);
+  g_clear_pointer (&global.detector, detector_free);
+  g_clear_pointer (&global.line_server, line_server_free);
+  g_clear_pointer (&global.memory, memory_budget_free);
+  if (global.line_client != NULL)
+    {
+      guint64 n_lines, n_bytes;
+
+      line_client_get_stats (global.line_client, &n_lines, &n_bytes);
+      g_message ("line client: %" G_GUINT64_FORMAT " lines, %" G_GUINT64_FORMAT " bytes received",
+                 n_lines, n_bytes);
+      line_client_free (global.line_client);
+    }
   g_clear_object (&global.cache);
   g_clear_object (&global.db_info);
+  g_clear_pointer (&global.track_index, track_index_free);
   g_clear_object (&global.db);
 
   g_clear_object (&global.wf);
   g_clear_object (&global.wf_grid);
   g_clear_object (&global.wf_control);
-
-  g_clear_pointer (&global.sonar.starboard.signals, hyscan_data_schema_free_enum_values);
-  g_clear_pointer (&global.sonar.port.signals, hyscan_data_schema_free_enum_values);
+  g_clear_object (&global.wf_mark);
+  g_clear_object (&global.wf_meter);
+  g_clear_object (&global.mman);
+  g_clear_pointer (&global.palettes, palette_list_free);
+
+  for (i = 0; i < N_BOARDS; i++)
+    g_clear_pointer (&global.sonar.boards[i].signals, hyscan_data_schema_free_enum_values);
+  g_clear_object (&global.config_monitor);
+  g_clear_pointer (&global.sonar.profile, sonar_profile_free);
   g_clear_object (&global.sonar.sonar);
   g_clear_object (&sonar);
   g_clear_object (&driver);
 
+  g_clear_pointer (&global.nav, nav_index_free);
+  g_clear_pointer (&global.prefetch, track_prefetch_free);
+  g_clear_pointer (&global.lines, line_monitor_free);
+  g_clear_pointer (&global.coverage, coverage_free);
+  g_clear_pointer (&global.marks, mark_index_free);
   g_free (global.track_name);
+  g_free (global.compare_track);
 
   g_free (driver_path);
   g_free (driver_name);
   g_free (sonar_uri);
   g_free (db_uri);
   g_free (project_name);
+  g_free (global.project_name);
   g_free (track_prefix);
   g_free (config_file);
+  g_free (import_marks);
+  g_free (export_marks);
+  g_free (archive_track);
+  g_free (restore_track);
+  g_free (mosaic_dir);
+  g_free (connect_address);
+  g_clear_pointer (&config, g_key_file_unref);
+
+#ifdef SIDESCAN_TRACK_ALLOC
+  /* Память, не освобождённая к завершению работы. */
+  alloc_track_report (ALLOC_TRACK_N_SITES);
+#endif
 
   return 0;
 }
@@ -1,229 +1,628 @@
 #include "sonar-configure.h"
 
-gboolean
-setup_sensors (HyScanSensorControl *control,
-               GKeyFile            *config)
+#include <string.h>
+
+#define SENSORS_CACHE                  "sonar-configure-sensors-cache"
+
+/* Формат сериализованного профиля. */
+#define PORT_FORMAT                    "(sbuuxuuuu(dddddd))"
+#define ANTENNA_FORMAT                 "(u(dddddd))"
+#define PROFILE_FORMAT                 "(a" PORT_FORMAT "a" ANTENNA_FORMAT ")"
+
+/* Допустимые параметры порта для подключения датчика. */
+static const gchar *const sensor_port_keys[] =
+{
+  "channel", "time-offset",
+  "uart-device", "uart-mode",
+  "ip-address", "udp-port",
+  "position-x", "position-y", "position-z",
+  "position-psi", "position-gamma", "position-theta",
+  NULL
+};
+
+/* Информация о порте, полученная от гидролокатора. */
+typedef struct
+{
+  HyScanSensorPortType         type;
+  HyScanDataSchemaEnumValue  **uart_devices;
+  HyScanDataSchemaEnumValue  **uart_modes;
+  HyScanDataSchemaEnumValue  **ip_addresses;
+} SensorPortInfo;
+
+/* Местоположение антенны источника данных. */
+typedef struct
+{
+  HyScanSourceType             source;
+  HyScanAntennaPosition        position;
+} SonarAntennaConfig;
+
+struct _SonarProfile
+{
+  GPtrArray                   *ports;
+  GArray                      *antennas;
+  gchar                       *hash;
+};
+
+/* Кэш информации о портах гидролокатора. */
+typedef struct
+{
+  gchar                      **ports;
+  GHashTable                  *info;
+} SensorsCache;
+
+static void
+sensor_port_info_free (gpointer data)
+{
+  SensorPortInfo *info = data;
+
+  g_clear_pointer (&info->uart_devices, hyscan_data_schema_free_enum_values);
+  g_clear_pointer (&info->uart_modes, hyscan_data_schema_free_enum_values);
+  g_clear_pointer (&info->ip_addresses, hyscan_data_schema_free_enum_values);
+  g_free (info);
+}
+
+static void
+sensors_cache_free (gpointer data)
+{
+  SensorsCache *cache = data;
+
+  g_strfreev (cache->ports);
+  g_hash_table_unref (cache->info);
+  g_free (cache);
+}
+
+/* Функция возвращает кэш информации о портах гидролокатора. Кэш
+ * создаётся при первом обращении и живёт вместе с объектом управления. */
+static SensorsCache *
+sensors_cache_get (HyScanSensorControl *control)
+{
+  SensorsCache *cache;
+
+  cache = g_object_get_data (G_OBJECT (control), SENSORS_CACHE);
+  if (cache != NULL)
+    return cache;
+
+  cache = g_new0 (SensorsCache, 1);
+  cache->ports = hyscan_sensor_control_list_ports (control);
+  cache->info = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, sensor_port_info_free);
+  g_object_set_data_full (G_OBJECT (control), SENSORS_CACHE, cache, sensors_cache_free);
+
+  return cache;
+}
+
+/* Функция возвращает информацию о порте. Списки UART устройств, режимов и
+ * IP адресов запрашиваются только для портов соответствующего типа. */
+static SensorPortInfo *
+sensor_port_info_get (HyScanSensorControl *control,
+                      SensorsCache        *cache,
+                      const gchar         *port)
+{
+  SensorPortInfo *info;
+
+  info = g_hash_table_lookup (cache->info, port);
+  if (info != NULL)
+    return info;
+
+  info = g_new0 (SensorPortInfo, 1);
+  info->type = hyscan_sensor_control_get_port_type (control, port);
+
+  if (info->type == HYSCAN_SENSOR_PORT_UART)
+    {
+      info->uart_devices = hyscan_sensor_control_list_uart_devices (control, port);
+      info->uart_modes = hyscan_sensor_control_list_uart_modes (control, port);
+    }
+  else if (info->type == HYSCAN_SENSOR_PORT_UDP_IP)
+    {
+      info->ip_addresses = hyscan_sensor_control_list_ip_addresses (control, port);
+    }
+
+  g_hash_table_insert (cache->info, g_strdup (port), info);
+
+  return info;
+}
+
+/* Функция ищет идентификатор значения по его названию. */
+static guint
+enum_value_find (HyScanDataSchemaEnumValue **values,
+                 const gchar                *name)
 {
-  gboolean status = FALSE;
-  gchar **ports = NULL;
-  guint i, j;
+  guint i;
+
+  for (i = 0; values[i] != NULL; i++)
+    if (g_strcmp0 (name, values[i]->name) == 0)
+      return values[i]->value;
 
-  if (config == NULL)
+  return 0;
+}
+
+/* Функции считывают значение параметра. Отсутствующий параметр
+ * считается нулевым, некорректное значение - ошибкой. */
+static gboolean
+config_check_error (GError      *error,
+                    const gchar *group,
+                    const gchar *key)
+{
+  gboolean status;
+
+  if (error == NULL)
     return TRUE;
 
-  /* Настраиваем порты для подключения датчиков. */
-  ports = hyscan_sensor_control_list_ports (control);
-  if (ports != NULL)
+  status = (error->code == G_KEY_FILE_ERROR_KEY_NOT_FOUND);
+  if (!status)
+    g_message ("invalid value of '%s' for '%s'", key, group);
+
+  g_error_free (error);
+
+  return status;
+}
+
+static gboolean
+config_get_integer (GKeyFile    *config,
+                    const gchar *group,
+                    const gchar *key,
+                    gint        *value)
+{
+  GError *error = NULL;
+
+  *value = g_key_file_get_integer (config, group, key, &error);
+
+  return config_check_error (error, group, key);
+}
+
+static gboolean
+config_get_int64 (GKeyFile    *config,
+                  const gchar *group,
+                  const gchar *key,
+                  gint64      *value)
+{
+  GError *error = NULL;
+
+  *value = g_key_file_get_int64 (config, group, key, &error);
+
+  return config_check_error (error, group, key);
+}
+
+static gboolean
+config_get_double (GKeyFile    *config,
+                   const gchar *group,
+                   const gchar *key,
+                   gdouble     *value)
+{
+  GError *error = NULL;
+
+  *value = g_key_file_get_double (config, group, key, &error);
+
+  return config_check_error (error, group, key);
+}
+
+/* Функция считывает параметры используемого порта. */
+static gboolean
+sensor_port_config_parse (HyScanSensorControl *control,
+                          SensorsCache        *cache,
+                          GKeyFile            *config,
+                          SensorPortConfig    *port)
+{
+  const gchar *name = port->name;
+  HyScanAntennaPosition *position = &port->position;
+  SensorPortInfo *info;
+  gchar **keys;
+  gint channel;
+  gint udp_port;
+  guint i;
+
+  /* Проверяем, что в описании порта нет неизвестных параметров. */
+  keys = g_key_file_get_keys (config, name, NULL, NULL);
+  for (i = 0; (keys != NULL) && (keys[i] != NULL); i++)
     {
-      for (i = 0; ports[i] != NULL; i++)
+      if (!g_strv_contains (sensor_port_keys, keys[i]))
         {
-          HyScanSensorPortType port_type;
-          gint64 time_offset;
-          guint channel;
-
-          HyScanDataSchemaEnumValue **uart_devices;
-          HyScanDataSchemaEnumValue **uart_modes;
-          HyScanDataSchemaEnumValue **ip_addresses;
-
-          HyScanAntennaPosition position;
-
-          /* Порт не используется. */
-          if (!g_key_file_has_group (config, ports[i]))
-            {
-              hyscan_sensor_control_set_enable (control, ports[i], FALSE);
-              continue;
-            }
-
-          /* Включение порта. */
-          if (!hyscan_sensor_control_set_enable (control, ports[i], TRUE))
-            {
-              g_message ("can't enable sensor port '%s'", ports[i]);
-              goto exit;
-            }
-
-          /* Параметры порта. */
-          channel = g_key_file_get_integer (config, ports[i], "channel", NULL);
-          time_offset = g_key_file_get_int64 (config, ports[i], "time-offset", NULL);
-
-          if (channel == 0)
-            channel = 1;
-
-          port_type = hyscan_sensor_control_get_port_type (control, ports[i]);
-          uart_devices = hyscan_sensor_control_list_uart_devices (control, ports[i]);
-          uart_modes = hyscan_sensor_control_list_uart_modes (control, ports[i]);
-          ip_addresses = hyscan_sensor_control_list_ip_addresses (control, ports[i]);
-
-          if (port_type == HYSCAN_SENSOR_PORT_VIRTUAL)
-            {
-              gboolean status;
-
-              status = hyscan_sensor_control_set_virtual_port_param (control, ports[i],
-                                                                     channel, time_offset);
-              if (!status)
-                {
-                  g_message ("can't set sensor port '%s' parameters", ports[i]);
-                  goto exit;
-                }
-            }
-
-          else if ((port_type == HYSCAN_SENSOR_PORT_UART) && (uart_devices != NULL) && (uart_modes != NULL))
-            {
-              gchar *uart_device;
-              gchar *uart_mode;
-              guint uart_device_id;
-              guint uart_mode_id;
-              gboolean status;
-
-              /* UART порт. */
-              uart_device = g_key_file_get_string (config, ports[i], "uart-device", NULL);
-              for (uart_device_id = 0, j = 0; uart_devices[j] != NULL; j++)
-                {
-                  if (g_strcmp0 (uart_device, uart_devices[j]->name) == 0)
-                    {
-                      uart_device_id = uart_devices[j]->value;
-                      break;
-                    }
-                }
-              if (uart_device_id == 0)
-                {
-                  g_message ("unknown uart device '%s' for sensor port '%s'", uart_device, ports[i]);
-                  g_free (uart_device);
-                  goto exit;
-                }
-              g_free (uart_device);
-
-              /* Режим работы UART порта. */
-              uart_mode = g_key_file_get_string (config, ports[i], "uart-mode", NULL);
-              for (uart_mode_id = 0, j = 0; uart_modes[j] != NULL; j++)
-                {
-                  if (g_strcmp0 (uart_mode, uart_modes[j]->name) == 0)
-                    {
-                      uart_mode_id = uart_modes[j]->value;
-                      break;
-                    }
-                }
-              if (uart_mode_id == 0)
-                {
-                  g_message ("unknown uart mode '%s' for sensor port '%s'", uart_mode, ports[i]);
-                  g_free (uart_mode);
-                  goto exit;
-                }
-              g_free (uart_mode);
-
-              status = hyscan_sensor_control_set_uart_port_param (control, ports[i],
-                                                                  channel, time_offset,
-                                                                  HYSCAN_SENSOR_PROTOCOL_NMEA_0183,
-                                                                  uart_device_id, uart_mode_id);
-              if (!status)
-                {
-                  g_message ("can't set sensor port '%s' parameters", ports[i]);
-                  goto exit;
-                }
-            }
-
-          else if ((port_type == HYSCAN_SENSOR_PORT_UDP_IP) && (ip_addresses != NULL))
-            {
-              gchar *ip_address;
-              guint ip_address_id;
-              guint udp_port;
-              gboolean status;
-
-              /* IP адрес. */
-              ip_address = g_key_file_get_string (config, ports[i], "ip-address", NULL);
-              for (ip_address_id = 0, j = 0; ip_addresses[j] != NULL; j++)
-                {
-                  if (g_strcmp0 (ip_address, ip_addresses[j]->name) == 0)
-                    {
-                      ip_address_id = ip_addresses[j]->value;
-                      break;
-                    }
-                }
-              if (ip_address_id == 0)
-                {
-                  g_message ("unknown ip address '%s' for sensor port '%s'", ip_address, ports[i]);
-                  g_free (ip_address);
-                  goto exit;
-                }
-              g_free (ip_address);
-
-              /* UDP порт. */
-              udp_port = g_key_file_get_integer (config, ports[i], "udp-port", NULL);
-              if ((udp_port < 1024) || (udp_port > 65535))
-                {
-                  g_message ("udp port out of range for sensor port '%s'", ports[i]);
-                  goto exit;
-                }
-
-              status = hyscan_sensor_control_set_udp_ip_port_param (control, ports[i],
-                                                                    channel, time_offset,
-                                                                    HYSCAN_SENSOR_PROTOCOL_NMEA_0183,
-                                                                    ip_address_id, udp_port);
-              if (!status)
-                {
-                  g_message ("can't set sensor port '%s' parameters", ports[i]);
-                  goto exit;
-                }
-            }
-
-          else
-            {
-              continue;
-            }
-
-          /* Местоположение антенны датчика. */
-          position.x = g_key_file_get_double (config, ports[i], "position-x", NULL);
-          position.y = g_key_file_get_double (config, ports[i], "position-y", NULL);
-          position.z = g_key_file_get_double (config, ports[i], "position-z", NULL);
-          position.psi = g_key_file_get_double (config, ports[i], "position-psi", NULL);
-          position.gamma = g_key_file_get_double (config, ports[i], "position-gamma", NULL);
-          position.theta = g_key_file_get_double (config, ports[i], "position-theta", NULL);
-          position.psi *= (G_PI / 180.0);
-          position.gamma *= (G_PI / 180.0);
-          position.theta *= (G_PI / 180.0);
-          if (!hyscan_sensor_control_set_position (control, ports[i], &position))
-            {
-              g_message ("can't set position for sensor connected to port '%s'", ports[i]);
-              goto exit;
-            }
-
-          g_clear_pointer (&uart_devices, hyscan_data_schema_free_enum_values);
-          g_clear_pointer (&uart_modes, hyscan_data_schema_free_enum_values);
-          g_clear_pointer (&ip_addresses, hyscan_data_schema_free_enum_values);
+          g_message ("unknown key '%s' for sensor port '%s'", keys[i], name);
+          g_strfreev (keys);
+          return FALSE;
         }
     }
+  g_strfreev (keys);
 
-  status = TRUE;
+  /* Параметры порта. */
+  if (!config_get_integer (config, name, "channel", &channel) ||
+      !config_get_int64 (config, name, "time-offset", &port->time_offset))
+    {
+      return FALSE;
+    }
 
-exit:
-  g_strfreev (ports);
+  if (channel < 0)
+    {
+      g_message ("channel out of range for sensor port '%s'", name);
+      return FALSE;
+    }
 
-  return status;
+  port->enable = TRUE;
+  port->channel = (channel == 0) ? 1 : channel;
+
+  info = sensor_port_info_get (control, cache, name);
+  port->type = info->type;
+
+  if (port->type == HYSCAN_SENSOR_PORT_VIRTUAL)
+    {
+      /* Виртуальный порт - дополнительных параметров нет. */
+    }
+
+  else if ((port->type == HYSCAN_SENSOR_PORT_UART) && (info->uart_devices != NULL) && (info->uart_modes != NULL))
+    {
+      gchar *uart_device;
+      gchar *uart_mode;
+
+      /* UART порт. */
+      uart_device = g_key_file_get_string (config, name, "uart-device", NULL);
+      port->uart_device = enum_value_find (info->uart_devices, uart_device);
+      if (port->uart_device == 0)
+        {
+          g_message ("unknown uart device '%s' for sensor port '%s'", uart_device, name);
+          g_free (uart_device);
+          return FALSE;
+        }
+      g_free (uart_device);
+
+      /* Режим работы UART порта. */
+      uart_mode = g_key_file_get_string (config, name, "uart-mode", NULL);
+      port->uart_mode = enum_value_find (info->uart_modes, uart_mode);
+      if (port->uart_mode == 0)
+        {
+          g_message ("unknown uart mode '%s' for sensor port '%s'", uart_mode, name);
+          g_free (uart_mode);
+          return FALSE;
+        }
+      g_free (uart_mode);
+    }
+
+  else if ((port->type == HYSCAN_SENSOR_PORT_UDP_IP) && (info->ip_addresses != NULL))
+    {
+      gchar *ip_address;
+
+      /* IP адрес. */
+      ip_address = g_key_file_get_string (config, name, "ip-address", NULL);
+      port->ip_address = enum_value_find (info->ip_addresses, ip_address);
+      if (port->ip_address == 0)
+        {
+          g_message ("unknown ip address '%s' for sensor port '%s'", ip_address, name);
+          g_free (ip_address);
+          return FALSE;
+        }
+      g_free (ip_address);
+
+      /* UDP порт. */
+      if (!config_get_integer (config, name, "udp-port", &udp_port))
+        return FALSE;
+
+      if ((udp_port < 1024) || (udp_port > 65535))
+        {
+          g_message ("udp port out of range for sensor port '%s'", name);
+          return FALSE;
+        }
+      port->udp_port = udp_port;
+    }
+
+  /* Параметры порта этого типа не настраиваются. */
+  else
+    {
+      port->type = HYSCAN_SENSOR_PORT_INVALID;
+      return TRUE;
+    }
+
+  /* Местоположение антенны датчика. */
+  if (!config_get_double (config, name, "position-x", &position->x) ||
+      !config_get_double (config, name, "position-y", &position->y) ||
+      !config_get_double (config, name, "position-z", &position->z) ||
+      !config_get_double (config, name, "position-psi", &position->psi) ||
+      !config_get_double (config, name, "position-gamma", &position->gamma) ||
+      !config_get_double (config, name, "position-theta", &position->theta))
+    {
+      return FALSE;
+    }
+
+  position->psi *= (G_PI / 180.0);
+  position->gamma *= (G_PI / 180.0);
+  position->theta *= (G_PI / 180.0);
+
+  return TRUE;
+}
+
+void
+sensor_port_config_free (SensorPortConfig *port)
+{
+  g_free (port->name);
+  g_free (port);
+}
+
+GPtrArray *
+sensors_config_parse (HyScanSensorControl *control,
+                      GKeyFile            *config)
+{
+  SensorsCache *cache;
+  GPtrArray *ports;
+  guint i;
+
+  cache = sensors_cache_get (control);
+  ports = g_ptr_array_new_with_free_func ((GDestroyNotify) sensor_port_config_free);
+  if (cache->ports == NULL)
+    return ports;
+
+  for (i = 0; cache->ports[i] != NULL; i++)
+    {
+      SensorPortConfig *port = g_new0 (SensorPortConfig, 1);
+
+      port->name = g_strdup (cache->ports[i]);
+      g_ptr_array_add (ports, port);
+
+      /* Порт не используется. */
+      if (!g_key_file_has_group (config, port->name))
+        continue;
+
+      if (!sensor_port_config_parse (control, cache, config, port))
+        {
+          g_ptr_array_unref (ports);
+          return NULL;
+        }
+    }
+
+  return ports;
+}
+
+/* Функция сравнивает параметры порта. */
+static gboolean
+sensor_port_config_equal (SensorPortConfig *port1,
+                          SensorPortConfig *port2)
+{
+  return (g_strcmp0 (port1->name, port2->name) == 0) &&
+         (port1->enable == port2->enable) &&
+         (port1->type == port2->type) &&
+         (port1->channel == port2->channel) &&
+         (port1->time_offset == port2->time_offset) &&
+         (port1->uart_device == port2->uart_device) &&
+         (port1->uart_mode == port2->uart_mode) &&
+         (port1->ip_address == port2->ip_address) &&
+         (port1->udp_port == port2->udp_port) &&
+         (memcmp (&port1->position, &port2->position, sizeof (HyScanAntennaPosition)) == 0);
 }
 
 gboolean
-setup_sonar_antenna (HyScanSonarControl *control,
-                     HyScanSourceType    source,
-                     GKeyFile           *config)
+sensors_config_apply (HyScanSensorControl *control,
+                      GPtrArray           *ports,
+                      GPtrArray           *prev)
 {
-  HyScanAntennaPosition position;
-  const gchar *source_name;
+  guint i;
 
-  if (config == NULL)
-    return TRUE;
+  for (i = 0; i < ports->len; i++)
+    {
+      SensorPortConfig *port = g_ptr_array_index (ports, i);
+      gboolean status;
+
+      /* Параметры порта не изменились. */
+      if ((prev != NULL) && (i < prev->len) && sensor_port_config_equal (port, g_ptr_array_index (prev, i)))
+        continue;
+
+      /* Порт не используется. */
+      if (!port->enable)
+        {
+          hyscan_sensor_control_set_enable (control, port->name, FALSE);
+          continue;
+        }
+
+      /* Включение порта. */
+      if (!hyscan_sensor_control_set_enable (control, port->name, TRUE))
+        {
+          g_message ("can't enable sensor port '%s'", port->name);
+          return FALSE;
+        }
+
+      /* Параметры порта. */
+      if (port->type == HYSCAN_SENSOR_PORT_VIRTUAL)
+        {
+          status = hyscan_sensor_control_set_virtual_port_param (control, port->name,
+                                                                 port->channel, port->time_offset);
+        }
+      else if (port->type == HYSCAN_SENSOR_PORT_UART)
+        {
+          status = hyscan_sensor_control_set_uart_port_param (control, port->name,
+                                                              port->channel, port->time_offset,
+                                                              HYSCAN_SENSOR_PROTOCOL_NMEA_0183,
+                                                              port->uart_device, port->uart_mode);
+        }
+      else if (port->type == HYSCAN_SENSOR_PORT_UDP_IP)
+        {
+          status = hyscan_sensor_control_set_udp_ip_port_param (control, port->name,
+                                                                port->channel, port->time_offset,
+                                                                HYSCAN_SENSOR_PROTOCOL_NMEA_0183,
+                                                                port->ip_address, port->udp_port);
+        }
+      else
+        {
+          continue;
+        }
+
+      if (!status)
+        {
+          g_message ("can't set sensor port '%s' parameters", port->name);
+          return FALSE;
+        }
+
+      /* Местоположение антенны датчика. */
+      if (!hyscan_sensor_control_set_position (control, port->name, &port->position))
+        {
+          g_message ("can't set position for sensor connected to port '%s'", port->name);
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+/* Функция считывает местоположение антенны источника данных. */
+static gboolean
+sonar_antenna_config_parse (GKeyFile           *config,
+                            HyScanSourceType    source,
+                            SonarAntennaConfig *antenna)
+{
+  HyScanAntennaPosition *position = &antenna->position;
+  const gchar *source_name;
 
   /* Местоположение приёмных гидроакустических антенн. */
   source_name = hyscan_channel_get_name_by_types (source, FALSE, 1);
-  position.x = g_key_file_get_double (config, source_name, "position-x", NULL);
-  position.y = g_key_file_get_double (config, source_name, "position-y", NULL);
-  position.z = g_key_file_get_double (config, source_name, "position-z", NULL);
-  position.psi = g_key_file_get_double (config, source_name, "position-psi", NULL);
-  position.gamma = g_key_file_get_double (config, source_name, "position-gamma", NULL);
-  position.theta = g_key_file_get_double (config, source_name, "position-theta", NULL);
-  if (!hyscan_sonar_control_set_position (control, source, &position))
-    {
-      g_message ("can't set position for %s", source_name);
+  antenna->source = source;
+
+  return config_get_double (config, source_name, "position-x", &position->x) &&
+         config_get_double (config, source_name, "position-y", &position->y) &&
+         config_get_double (config, source_name, "position-z", &position->z) &&
+         config_get_double (config, source_name, "position-psi", &position->psi) &&
+         config_get_double (config, source_name, "position-gamma", &position->gamma) &&
+         config_get_double (config, source_name, "position-theta", &position->theta);
+}
+
+/* Функция ищет местоположение антенны источника данных в профиле. */
+static SonarAntennaConfig *
+sonar_profile_find_antenna (SonarProfile     *profile,
+                            HyScanSourceType  source)
+{
+  guint i;
+
+  for (i = 0; i < profile->antennas->len; i++)
+    {
+      SonarAntennaConfig *antenna = &g_array_index (profile->antennas, SonarAntennaConfig, i);
+
+      if (antenna->source == source)
+        return antenna;
+    }
+
+  return NULL;
+}
+
+/* Функция сериализует профиль и рассчитывает его контрольную сумму. */
+static void
+sonar_profile_compile (SonarProfile *profile)
+{
+  GVariantBuilder ports;
+  GVariantBuilder antennas;
+  GVariant *data;
+  GBytes *bytes;
+  guint i;
+
+  g_variant_builder_init (&ports, G_VARIANT_TYPE ("a" PORT_FORMAT));
+  for (i = 0; i < profile->ports->len; i++)
+    {
+      SensorPortConfig *port = g_ptr_array_index (profile->ports, i);
+      HyScanAntennaPosition *pos = &port->position;
+
+      g_variant_builder_add (&ports, PORT_FORMAT,
+                             port->name, port->enable, port->type, port->channel, port->time_offset,
+                             port->uart_device, port->uart_mode, port->ip_address, port->udp_port,
+                             pos->x, pos->y, pos->z, pos->psi, pos->gamma, pos->theta);
+    }
+
+  g_variant_builder_init (&antennas, G_VARIANT_TYPE ("a" ANTENNA_FORMAT));
+  for (i = 0; i < profile->antennas->len; i++)
+    {
+      SonarAntennaConfig *antenna = &g_array_index (profile->antennas, SonarAntennaConfig, i);
+      HyScanAntennaPosition *pos = &antenna->position;
+
+      g_variant_builder_add (&antennas, ANTENNA_FORMAT,
+                             antenna->source,
+                             pos->x, pos->y, pos->z, pos->psi, pos->gamma, pos->theta);
+    }
+
+  data = g_variant_ref_sink (g_variant_new (PROFILE_FORMAT, &ports, &antennas));
+  bytes = g_variant_get_data_as_bytes (data);
+  profile->hash = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, bytes);
+  g_bytes_unref (bytes);
+  g_variant_unref (data);
+}
+
+SonarProfile *
+sonar_profile_new (HyScanSonarControl     *control,
+                   GKeyFile               *config,
+                   const HyScanSourceType *sources,
+                   guint                   n_sources)
+{
+  SonarProfile *profile;
+  guint i;
+
+  profile = g_new0 (SonarProfile, 1);
+  profile->antennas = g_array_sized_new (FALSE, TRUE, sizeof (SonarAntennaConfig), n_sources);
+  g_array_set_size (profile->antennas, n_sources);
+
+  profile->ports = sensors_config_parse (HYSCAN_SENSOR_CONTROL (control), config);
+  if (profile->ports == NULL)
+    goto fail;
+
+  for (i = 0; i < n_sources; i++)
+    {
+      SonarAntennaConfig *antenna = &g_array_index (profile->antennas, SonarAntennaConfig, i);
+
+      if (!sonar_antenna_config_parse (config, sources[i], antenna))
+        goto fail;
+    }
+
+  sonar_profile_compile (profile);
+
+  return profile;
+
+fail:
+  sonar_profile_free (profile);
+
+  return NULL;
+}
+
+const gchar *
+sonar_profile_get_hash (SonarProfile *profile)
+{
+  return profile->hash;
+}
+
+gboolean
+sonar_profile_apply_sensors (HyScanSonarControl *control,
+                             SonarProfile       *profile,
+                             SonarProfile       *prev)
+{
+  return sensors_config_apply (HYSCAN_SENSOR_CONTROL (control), profile->ports,
+                               (prev != NULL) ? prev->ports : NULL);
+}
+
+gboolean
+sonar_profile_apply_antenna (HyScanSonarControl *control,
+                             SonarProfile       *profile,
+                             SonarProfile       *prev,
+                             HyScanSourceType    source)
+{
+  SonarAntennaConfig *antenna;
+  SonarAntennaConfig *prev_antenna;
+
+  antenna = sonar_profile_find_antenna (profile, source);
+  if (antenna == NULL)
+    return TRUE;
+
+  if (prev != NULL)
+    {
+      prev_antenna = sonar_profile_find_antenna (prev, source);
+      if ((prev_antenna != NULL) &&
+          (memcmp (&antenna->position, &prev_antenna->position, sizeof (HyScanAntennaPosition)) == 0))
+        {
+          return TRUE;
+        }
+    }
+
+  if (!hyscan_sonar_control_set_position (control, source, &antenna->position))
+    {
+      g_message ("can't set position for %s", hyscan_channel_get_name_by_types (source, FALSE, 1));
       return FALSE;
     }
 
   return TRUE;
 }
+
+void
+sonar_profile_free (SonarProfile *profile)
+{
+  g_clear_pointer (&profile->ports, g_ptr_array_unref);
+  g_clear_pointer (&profile->antennas, g_array_unref);
+  g_free (profile->hash);
+  g_free (profile);
+}
@@ -3,13 +3,65 @@
 
 #include <hyscan-sonar-control.h>
 
-/* Функция настраивает местоположение антенн датчиков и активирует приём данных. */
-gboolean       setup_sensors           (HyScanSensorControl           *control,
-                                        GKeyFile                      *config);
+/* Параметры порта для подключения датчика. */
+typedef struct
+{
+  gchar                       *name;           /* Название порта. */
+  gboolean                     enable;         /* Признак использования порта. */
+  HyScanSensorPortType         type;           /* Тип порта. */
+  guint                        channel;        /* Номер канала данных. */
+  gint64                       time_offset;    /* Коррекция времени, мкс. */
+  guint                        uart_device;    /* Идентификатор UART устройства. */
+  guint                        uart_mode;      /* Идентификатор режима работы UART порта. */
+  guint                        ip_address;     /* Идентификатор IP адреса. */
+  guint                        udp_port;       /* Номер UDP порта. */
+  HyScanAntennaPosition        position;       /* Местоположение антенны датчика. */
+} SensorPortConfig;
+
+/* Скомпилированный профиль конфигурации гидролокатора. */
+typedef struct _SonarProfile SonarProfile;
 
-/* Функция настраивает местоположение антенн гидролокатора. */
-gboolean       setup_sonar_antenna     (HyScanSonarControl            *control,
-                                        HyScanSourceType               source,
+/* Функция проверяет конфигурацию и формирует параметры всех портов датчиков.
+ * Обращений к гидролокатору для изменения параметров не производится.
+ * Списки UART устройств, режимов и IP адресов запрашиваются один раз
+ * и кэшируются для гидролокатора. В случае ошибки возвращает NULL. */
+GPtrArray     *sensors_config_parse    (HyScanSensorControl           *control,
                                         GKeyFile                      *config);
 
+/* Функция применяет параметры портов, сформированные sensors_config_parse.
+ * Если указаны предыдущие параметры prev, настраиваются только изменившиеся порты. */
+gboolean       sensors_config_apply    (HyScanSensorControl           *control,
+                                        GPtrArray                     *ports,
+                                        GPtrArray                     *prev);
+
+/* Функция освобождает параметры порта. */
+void           sensor_port_config_free (SensorPortConfig              *port);
+
+/* Функция компилирует конфигурацию портов датчиков и антенн гидролокатора
+ * для указанных источников данных в профиль. В случае ошибки возвращает NULL. */
+SonarProfile  *sonar_profile_new       (HyScanSonarControl            *control,
+                                        GKeyFile                      *config,
+                                        const HyScanSourceType        *sources,
+                                        guint                          n_sources);
+
+/* Функция возвращает контрольную сумму профиля. */
+const gchar   *sonar_profile_get_hash  (SonarProfile                  *profile);
+
+/* Функция настраивает порты датчиков по профилю. Если указан предыдущий
+ * профиль prev, настраиваются только изменившиеся порты. */
+gboolean       sonar_profile_apply_sensors (HyScanSonarControl        *control,
+                                        SonarProfile                  *profile,
+                                        SonarProfile                  *prev);
+
+/* Функция настраивает местоположение антенны источника данных по профилю.
+ * Если указан предыдущий профиль prev и местоположение не изменилось,
+ * обращения к гидролокатору не производится. */
+gboolean       sonar_profile_apply_antenna (HyScanSonarControl        *control,
+                                        SonarProfile                  *profile,
+                                        SonarProfile                  *prev,
+                                        HyScanSourceType               source);
+
+/* Функция освобождает профиль. */
+void           sonar_profile_free      (SonarProfile                  *profile);
+
 #endif /* __SENSORS_H__ */
@@ -0,0 +1,184 @@
+#include "tone-map.h"
+#include "amp-histogram.h"
+
+#include <hyscan-acoustic-data.h>
+
+#define TONE_MAP_N_BINS                65536           /* Число интервалов гистограммы амплитуд. */
+#define TONE_MAP_MAX_AMPLITUDE         1.0             /* Верхняя граница гистограммы. */
+#define TONE_MAP_N_LINES               256             /* Число строк выборки каждого борта. */
+#define TONE_MAP_N_POINTS              1024            /* Число точек кривой выравнивания. */
+#define TONE_MAP_CLIP                  4.0             /* Ограничение контраста. */
+#define TONE_MAP_WHITE                 0.999           /* Доля амплитуд ниже уровня белого. */
+
+static const HyScanSourceType tone_map_sources[] = { HYSCAN_SOURCE_SIDE_SCAN_STARBOARD, HYSCAN_SOURCE_SIDE_SCAN_PORT };
+
+struct _ToneMap
+{
+  HyScanDB                    *db;
+  HyScanCache                 *cache;
+  gchar                       *project_name;
+  gchar                       *track_name;
+  gboolean                     raw;
+
+  GThread                     *thread;
+  gint                         stop;
+  gint                         ready;          /* Признак готовности гистограммы. */
+
+  AmpHistogram                *histogram;      /* Гистограмма, после готовности не изменяется. */
+  gdouble                      white;
+};
+
+/* Поток построения гистограммы. Строки выборки равномерно распределены
+ * по галсу. Описание ключа кэша содержит диапазоны строк бортов, поэтому
+ * гистограмма дописанного галса строится заново. */
+static gpointer
+tone_map_thread (ToneMap *tone_map)
+{
+  HyScanAcousticData *data[G_N_ELEMENTS (tone_map_sources)];
+  guint32 first_index[G_N_ELEMENTS (tone_map_sources)];
+  guint32 last_index[G_N_ELEMENTS (tone_map_sources)];
+  GString *detail;
+  gchar *key;
+  guint64 *bins;
+  guint32 size;
+  guint s;
+
+  detail = g_string_new (NULL);
+  for (s = 0; s < G_N_ELEMENTS (tone_map_sources); s++)
+    {
+      data[s] = hyscan_acoustic_data_new (tone_map->db, tone_map->project_name, tone_map->track_name,
+                                          tone_map_sources[s], tone_map->raw);
+      if ((data[s] != NULL) && !hyscan_acoustic_data_get_range (data[s], &first_index[s], &last_index[s]))
+        g_clear_object (&data[s]);
+
+      if (data[s] != NULL)
+        g_string_append_printf (detail, "%u-%u.", first_index[s], last_index[s]);
+    }
+
+  key = g_strdup_printf ("side-scan.tone-map.%s.%s.%d", tone_map->project_name, tone_map->track_name, tone_map->raw);
+  bins = g_new (guint64, TONE_MAP_N_BINS);
+  size = TONE_MAP_N_BINS * sizeof (guint64);
+
+  if (!hyscan_cache_get (tone_map->cache, key, detail->str, bins, &size) ||
+      (size != TONE_MAP_N_BINS * sizeof (guint64)) ||
+      !amp_histogram_set_bins (tone_map->histogram, bins, TONE_MAP_N_BINS))
+    {
+      for (s = 0; s < G_N_ELEMENTS (tone_map_sources); s++)
+        {
+          guint32 step, index;
+
+          if (data[s] == NULL)
+            continue;
+
+          step = MAX (1, (last_index[s] - first_index[s] + 1) / TONE_MAP_N_LINES);
+          for (index = first_index[s];
+               (index <= last_index[s]) && !g_atomic_int_get (&tone_map->stop);
+               index += step)
+            {
+              const gfloat *values;
+              guint32 n_values;
+              gint64 time;
+
+              values = hyscan_acoustic_data_get_values (data[s], index, &n_values, &time);
+              if (values != NULL)
+                amp_histogram_add (tone_map->histogram, values, n_values);
+            }
+        }
+
+      if (!g_atomic_int_get (&tone_map->stop) && (amp_histogram_get_total (tone_map->histogram) > 0))
+        {
+          hyscan_cache_set (tone_map->cache, key, detail->str,
+                            amp_histogram_get_bins (tone_map->histogram, NULL),
+                            TONE_MAP_N_BINS * sizeof (guint64));
+        }
+    }
+
+  for (s = 0; s < G_N_ELEMENTS (tone_map_sources); s++)
+    g_clear_object (&data[s]);
+
+  if (!g_atomic_int_get (&tone_map->stop) && (amp_histogram_get_total (tone_map->histogram) > 0))
+    {
+      tone_map->white = amp_histogram_quantile (tone_map->histogram, TONE_MAP_WHITE);
+      g_atomic_int_set (&tone_map->ready, TRUE);
+    }
+
+  g_string_free (detail, TRUE);
+  g_free (key);
+  g_free (bins);
+
+  return NULL;
+}
+
+ToneMap *
+tone_map_new (HyScanDB    *db,
+              HyScanCache *cache,
+              const gchar *project_name,
+              const gchar *track_name,
+              gboolean     raw)
+{
+  ToneMap *tone_map;
+
+  tone_map = g_new0 (ToneMap, 1);
+  tone_map->db = g_object_ref (db);
+  tone_map->cache = g_object_ref (cache);
+  tone_map->project_name = g_strdup (project_name);
+  tone_map->track_name = g_strdup (track_name);
+  tone_map->raw = raw;
+  tone_map->histogram = amp_histogram_new (TONE_MAP_N_BINS, TONE_MAP_MAX_AMPLITUDE);
+  tone_map->thread = g_thread_new ("tone-map", (GThreadFunc) tone_map_thread, tone_map);
+
+  return tone_map;
+}
+
+gdouble
+tone_map_get_white (ToneMap *tone_map)
+{
+  if (!g_atomic_int_get (&tone_map->ready))
+    return 0.0;
+
+  return tone_map->white;
+}
+
+gboolean
+tone_map_build (ToneMap       *tone_map,
+                const Palette *palette,
+                gdouble        white,
+                guint32       *colors,
+                guint          n_colors)
+{
+  gdouble curve[TONE_MAP_N_POINTS];
+  guint i;
+
+  if (!g_atomic_int_get (&tone_map->ready) || (n_colors < 2) || (white <= 0.0))
+    return FALSE;
+
+  amp_histogram_equalize (tone_map->histogram, white, TONE_MAP_CLIP, curve, TONE_MAP_N_POINTS);
+
+  /* Цвет палитры выбирается по значению кривой выравнивания,
+   * интерполированной между соседними точками. */
+  for (i = 0; i < n_colors; i++)
+    {
+      gdouble position = (gdouble) i * (TONE_MAP_N_POINTS - 1) / (n_colors - 1);
+      guint point = MIN ((guint) position, TONE_MAP_N_POINTS - 2);
+      gdouble part = position - point;
+      gdouble value = curve[point] * (1.0 - part) + curve[point + 1] * part;
+
+      colors[i] = palette->colors[(guint) (CLAMP (value, 0.0, 1.0) * (palette->n_colors - 1) + 0.5)];
+    }
+
+  return TRUE;
+}
+
+void
+tone_map_free (ToneMap *tone_map)
+{
+  g_atomic_int_set (&tone_map->stop, TRUE);
+  g_thread_join (tone_map->thread);
+
+  amp_histogram_free (tone_map->histogram);
+  g_object_unref (tone_map->db);
+  g_object_unref (tone_map->cache);
+  g_free (tone_map->project_name);
+  g_free (tone_map->track_name);
+  g_free (tone_map);
+}
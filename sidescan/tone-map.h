@@ -0,0 +1,41 @@
+#ifndef __TONE_MAP_H__
+#define __TONE_MAP_H__
+
+#include <hyscan-db.h>
+#include <hyscan-cache.h>
+#include "palette.h"
+
+/* Сжатие динамического диапазона изображения галса. По выборке строк
+ * галса строится гистограмма амплитуд бортов, по ней вычисляется кривая
+ * выравнивания с ограничением контраста, которая объединяется с базовой
+ * палитрой в палитру высокого разрешения. Слабые сигналы в зонах тени
+ * получают больше цветов палитры без дополнительных вычислений при
+ * отображении. Гистограмма строится в отдельном потоке и хранится
+ * в кэше вместе с тайлами, повторное открытие галса её не пересчитывает. */
+typedef struct _ToneMap ToneMap;
+
+/* Функция создаёт объект сжатия диапазона для галса и запускает
+ * построение гистограммы. */
+ToneMap       *tone_map_new            (HyScanDB                      *db,
+                                        HyScanCache                   *cache,
+                                        const gchar                   *project_name,
+                                        const gchar                   *track_name,
+                                        gboolean                       raw);
+
+/* Функция возвращает амплитуду, ниже которой находится 99.9% амплитуд
+ * галса, или 0, если гистограмма ещё не построена. */
+gdouble        tone_map_get_white      (ToneMap                       *tone_map);
+
+/* Функция формирует палитру colors из n_colors цветов для отображения
+ * амплитуд от 0 до white на основе палитры palette. Возвращает FALSE,
+ * если гистограмма ещё не построена. */
+gboolean       tone_map_build          (ToneMap                       *tone_map,
+                                        const Palette                 *palette,
+                                        gdouble                        white,
+                                        guint32                       *colors,
+                                        guint                          n_colors);
+
+/* Функция останавливает построение гистограммы и освобождает объект. */
+void           tone_map_free           (ToneMap                       *tone_map);
+
+#endif /* __TONE_MAP_H__ */
@@ -0,0 +1,938 @@
+#include "track-archive.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#define TRACK_ARCHIVE_MAGIC            0x53535441      /* Сигнатура архива "SSTA". */
+#define TRACK_ARCHIVE_VERSION          1               /* Версия формата архива. */
+#define TRACK_ARCHIVE_BLOCK_SIZE       (256 * 1024)    /* Размер блока файла, байт. */
+#define TRACK_ARCHIVE_MAX_PACKED       (TRACK_ARCHIVE_BLOCK_SIZE + TRACK_ARCHIVE_BLOCK_SIZE / 8 + 64)
+#define TRACK_ARCHIVE_TRAILER_SIZE     12              /* Смещение таблицы блоков и сигнатура. */
+#define TRACK_ARCHIVE_SUFFIX           ".ssa"
+
+/* Способ хранения блока. */
+enum
+{
+  TRACK_ARCHIVE_STORED,                        /* Без сжатия. */
+  TRACK_ARCHIVE_DEFLATE,                       /* Сжатие deflate. */
+  TRACK_ARCHIVE_DELTA_DEFLATE                  /* Разностное кодирование 16-битных отсчётов и сжатие deflate. */
+};
+
+/* Блок файла в архиве. */
+typedef struct
+{
+  guint64                      offset;         /* Смещение сжатого блока в архиве. */
+  guint32                      size;           /* Размер сжатого блока. */
+  guint32                      method;         /* Способ хранения блока. */
+} TrackArchiveBlock;
+
+/* Файл галса в архиве. */
+typedef struct
+{
+  gchar                       *name;           /* Путь относительно каталога галса. */
+  guint64                      size;           /* Размер файла. */
+  GArray                      *blocks;         /* Блоки файла TrackArchiveBlock. */
+} TrackArchiveFile;
+
+struct _TrackArchive
+{
+  GFileInputStream            *input;
+  guint32                      block_size;
+  GPtrArray                   *files;          /* Файлы TrackArchiveFile. */
+
+  GConverter                  *decompressor;
+  guchar                      *packed;         /* Сжатый блок. */
+  guchar                      *block;          /* Последний распакованный блок. */
+  gint                         block_file;     /* Файл и номер последнего распакованного блока. */
+  guint                        block_n;
+};
+
+static void
+track_archive_file_free (TrackArchiveFile *file)
+{
+  g_free (file->name);
+  g_array_unref (file->blocks);
+  g_free (file);
+}
+
+/* Функция заменяет 16-битные отсчёты разностями соседних отсчётов. */
+static void
+track_archive_delta_encode (guchar *data,
+                            gsize   size)
+{
+  gsize i;
+
+  for (i = (size & ~(gsize) 1); i >= 4; i -= 2)
+    {
+      guint16 cur = data[i - 2] | (data[i - 1] << 8);
+      guint16 prev = data[i - 4] | (data[i - 3] << 8);
+      guint16 delta = cur - prev;
+
+      data[i - 2] = delta & 0xff;
+      data[i - 1] = delta >> 8;
+    }
+}
+
+/* Функция восстанавливает 16-битные отсчёты по разностям. */
+static void
+track_archive_delta_decode (guchar *data,
+                            gsize   size)
+{
+  gsize i;
+
+  for (i = 2; i + 1 < size; i += 2)
+    {
+      guint16 delta = data[i] | (data[i + 1] << 8);
+      guint16 prev = data[i - 2] | (data[i - 1] << 8);
+      guint16 cur = prev + delta;
+
+      data[i] = cur & 0xff;
+      data[i + 1] = cur >> 8;
+    }
+}
+
+/* Функция сжимает или распаковывает блок целиком. Возвращает размер
+ * результата или 0, если результат не поместился в буфер. */
+static gsize
+track_archive_convert (GConverter    *converter,
+                       const guchar  *input,
+                       gsize          input_size,
+                       guchar        *output,
+                       gsize          output_size)
+{
+  GConverterResult result = G_CONVERTER_CONVERTED;
+  gsize total_read = 0;
+  gsize total_written = 0;
+
+  g_converter_reset (converter);
+
+  while (result != G_CONVERTER_FINISHED)
+    {
+      gsize bytes_read, bytes_written;
+
+      if (total_written == output_size)
+        return 0;
+
+      result = g_converter_convert (converter,
+                                    input + total_read, input_size - total_read,
+                                    output + total_written, output_size - total_written,
+                                    G_CONVERTER_INPUT_AT_END,
+                                    &bytes_read, &bytes_written, NULL);
+      if ((result == G_CONVERTER_ERROR) || ((bytes_read == 0) && (bytes_written == 0)))
+        return 0;
+
+      total_read += bytes_read;
+      total_written += bytes_written;
+    }
+
+  return total_written;
+}
+
+/* Функция составляет список файлов каталога галса и его подкаталогов. */
+static void
+track_archive_list (GPtrArray   *names,
+                    const gchar *root,
+                    const gchar *relative)
+{
+  const gchar *name;
+  gchar *path;
+  GDir *dir;
+
+  path = (relative != NULL) ? g_build_filename (root, relative, NULL) : g_strdup (root);
+  dir = g_dir_open (path, 0, NULL);
+  if (dir == NULL)
+    {
+      g_free (path);
+      return;
+    }
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      gchar *file = g_build_filename (path, name, NULL);
+      gchar *file_relative = (relative != NULL) ? g_strconcat (relative, "/", name, NULL) : g_strdup (name);
+
+      if (g_file_test (file, G_FILE_TEST_IS_DIR))
+        {
+          track_archive_list (names, root, file_relative);
+          g_free (file_relative);
+        }
+      else if (g_file_test (file, G_FILE_TEST_IS_REGULAR))
+        {
+          g_ptr_array_add (names, file_relative);
+        }
+      else
+        {
+          g_free (file_relative);
+        }
+
+      g_free (file);
+    }
+
+  g_dir_close (dir);
+  g_free (path);
+}
+
+/* Функция удаляет каталог вместе с содержимым. */
+static void
+track_archive_remove_dir (const gchar *path)
+{
+  const gchar *name;
+  GDir *dir;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          gchar *file = g_build_filename (path, name, NULL);
+
+          if (g_file_test (file, G_FILE_TEST_IS_DIR) && !g_file_test (file, G_FILE_TEST_IS_SYMLINK))
+            track_archive_remove_dir (file);
+          else
+            g_remove (file);
+
+          g_free (file);
+        }
+
+      g_dir_close (dir);
+    }
+
+  g_rmdir (path);
+}
+
+/* Функция проверяет, что путь файла в архиве указывает внутрь каталога
+ * галса: путь относительный, без буквы диска и компонентов "." и "..". */
+static gboolean
+track_archive_check_name (const gchar *name)
+{
+  gchar **parts;
+  gboolean status = TRUE;
+  guint i;
+
+  if ((name[0] == '\0') || g_path_is_absolute (name) || (name[0] == '/') || (name[0] == '\\') ||
+      (g_ascii_isalpha (name[0]) && (name[1] == ':')))
+    {
+      return FALSE;
+    }
+
+  parts = g_strsplit_set (name, "/\\", -1);
+  for (i = 0; status && (parts[i] != NULL); i++)
+    {
+      if ((parts[i][0] == '\0') || (g_strcmp0 (parts[i], ".") == 0) || (g_strcmp0 (parts[i], "..") == 0))
+        status = FALSE;
+    }
+  g_strfreev (parts);
+
+  return status;
+}
+
+static gint
+track_archive_compare_names (gconstpointer a,
+                             gconstpointer b)
+{
+  return g_strcmp0 (*(const gchar **) a, *(const gchar **) b);
+}
+
+/* Функция возвращает путь к каталогу галса в локальной базе данных. */
+static gchar *
+track_archive_track_path (const gchar *db_uri,
+                          const gchar *project_name,
+                          const gchar *track_name)
+{
+  if ((db_uri == NULL) || !g_str_has_prefix (db_uri, "file://"))
+    {
+      g_message ("track archive requires local db (file://)");
+      return NULL;
+    }
+
+  return g_build_filename (db_uri + strlen ("file://"), project_name, track_name, NULL);
+}
+
+/* Функция сжимает файл галса и записывает его блоки в архив. */
+static gboolean
+track_archive_write_file (GDataOutputStream *output,
+                          guint64           *offset,
+                          GConverter        *compressor,
+                          const gchar       *path,
+                          TrackArchiveFile  *file,
+                          GError           **error)
+{
+  GFileInputStream *input;
+  GFile *source;
+  guchar *data, *delta, *packed, *delta_packed;
+  gboolean status = TRUE;
+
+  source = g_file_new_for_path (path);
+  input = g_file_read (source, NULL, error);
+  g_object_unref (source);
+  if (input == NULL)
+    return FALSE;
+
+  data = g_malloc (TRACK_ARCHIVE_BLOCK_SIZE);
+  delta = g_malloc (TRACK_ARCHIVE_BLOCK_SIZE);
+  packed = g_malloc (TRACK_ARCHIVE_MAX_PACKED);
+  delta_packed = g_malloc (TRACK_ARCHIVE_MAX_PACKED);
+
+  while (status)
+    {
+      TrackArchiveBlock block;
+      const guchar *block_data;
+      gsize size, packed_size, delta_size;
+
+      status = g_input_stream_read_all (G_INPUT_STREAM (input), data, TRACK_ARCHIVE_BLOCK_SIZE, &size, NULL, error);
+      if (!status || (size == 0))
+        break;
+
+      /* Из двух вариантов сжатия выбирается лучший, несжимаемые
+       * блоки хранятся как есть. */
+      memcpy (delta, data, size);
+      track_archive_delta_encode (delta, size);
+      packed_size = track_archive_convert (compressor, data, size, packed, size);
+      delta_size = track_archive_convert (compressor, delta, size, delta_packed, size);
+
+      if ((delta_size > 0) && ((packed_size == 0) || (delta_size < packed_size)))
+        {
+          block.method = TRACK_ARCHIVE_DELTA_DEFLATE;
+          block.size = delta_size;
+          block_data = delta_packed;
+        }
+      else if (packed_size > 0)
+        {
+          block.method = TRACK_ARCHIVE_DEFLATE;
+          block.size = packed_size;
+          block_data = packed;
+        }
+      else
+        {
+          block.method = TRACK_ARCHIVE_STORED;
+          block.size = size;
+          block_data = data;
+        }
+
+      block.offset = *offset;
+      status = g_output_stream_write_all (G_OUTPUT_STREAM (output), block_data, block.size, NULL, NULL, error);
+
+      *offset += block.size;
+      file->size += size;
+      g_array_append_val (file->blocks, block);
+    }
+
+  g_free (data);
+  g_free (delta);
+  g_free (packed);
+  g_free (delta_packed);
+  g_object_unref (input);
+
+  return status;
+}
+
+/* Функция записывает таблицу блоков и завершение архива. */
+static gboolean
+track_archive_write_index (GDataOutputStream *output,
+                           guint64            offset,
+                           GPtrArray         *files,
+                           GError           **error)
+{
+  guint i, j;
+
+  if (!g_data_output_stream_put_uint32 (output, files->len, NULL, error))
+    return FALSE;
+
+  for (i = 0; i < files->len; i++)
+    {
+      TrackArchiveFile *file = files->pdata[i];
+      guint32 name_length = strlen (file->name);
+
+      if (!g_data_output_stream_put_uint32 (output, name_length, NULL, error) ||
+          !g_output_stream_write_all (G_OUTPUT_STREAM (output), file->name, name_length, NULL, NULL, error) ||
+          !g_data_output_stream_put_uint64 (output, file->size, NULL, error) ||
+          !g_data_output_stream_put_uint32 (output, file->blocks->len, NULL, error))
+        {
+          return FALSE;
+        }
+
+      for (j = 0; j < file->blocks->len; j++)
+        {
+          TrackArchiveBlock *block = &g_array_index (file->blocks, TrackArchiveBlock, j);
+
+          if (!g_data_output_stream_put_uint64 (output, block->offset, NULL, error) ||
+              !g_data_output_stream_put_uint32 (output, block->size, NULL, error) ||
+              !g_data_output_stream_put_uint32 (output, block->method, NULL, error))
+            {
+              return FALSE;
+            }
+        }
+    }
+
+  return g_data_output_stream_put_uint64 (output, offset, NULL, error) &&
+         g_data_output_stream_put_uint32 (output, TRACK_ARCHIVE_MAGIC, NULL, error);
+}
+
+/* Функция сравнивает содержимое архива с файлами галса. */
+static gboolean
+track_archive_verify (const gchar *archive_path,
+                      const gchar *track_path)
+{
+  TrackArchive *archive;
+  gboolean status = TRUE;
+  guchar *data, *original;
+  guint i;
+
+  archive = track_archive_open (archive_path);
+  if (archive == NULL)
+    return FALSE;
+
+  data = g_malloc (TRACK_ARCHIVE_BLOCK_SIZE);
+  original = g_malloc (TRACK_ARCHIVE_BLOCK_SIZE);
+
+  for (i = 0; status && (i < track_archive_get_n_files (archive)); i++)
+    {
+      GFileInputStream *input;
+      GFile *file;
+      const gchar *name;
+      gchar *path;
+      guint64 size, offset;
+
+      name = track_archive_get_file (archive, i, &size);
+      path = g_build_filename (track_path, name, NULL);
+      file = g_file_new_for_path (path);
+      input = g_file_read (file, NULL, NULL);
+      g_object_unref (file);
+      g_free (path);
+
+      if (input == NULL)
+        {
+          status = FALSE;
+          break;
+        }
+
+      for (offset = 0; status && (offset < size); offset += TRACK_ARCHIVE_BLOCK_SIZE)
+        {
+          gsize length = MIN (size - offset, TRACK_ARCHIVE_BLOCK_SIZE);
+          gsize n_read;
+
+          status = track_archive_read (archive, i, offset, data, length) &&
+                   g_input_stream_read_all (G_INPUT_STREAM (input), original, length, &n_read, NULL, NULL) &&
+                   (n_read == length) &&
+                   (memcmp (data, original, length) == 0);
+        }
+
+      g_object_unref (input);
+    }
+
+  g_free (data);
+  g_free (original);
+  track_archive_close (archive);
+
+  return status;
+}
+
+gboolean
+track_archive_pack (HyScanDB    *db,
+                    const gchar *db_uri,
+                    const gchar *project_name,
+                    const gchar *track_name)
+{
+  GPtrArray *names = NULL;
+  GPtrArray *files = NULL;
+  GConverter *compressor = NULL;
+  GFile *archive_file = NULL;
+  GFileOutputStream *file_output = NULL;
+  GDataOutputStream *output = NULL;
+  GError *error = NULL;
+  gchar *track_path;
+  gchar *archive_path = NULL;
+  guint64 offset = 0;
+  guint64 total = 0;
+  gboolean status = FALSE;
+  gint32 project_id;
+  guint i;
+
+  track_path = track_archive_track_path (db_uri, project_name, track_name);
+  if (track_path == NULL)
+    return FALSE;
+
+  if (!g_file_test (track_path, G_FILE_TEST_IS_DIR))
+    {
+      g_message ("can't find track '%s'", track_name);
+      g_free (track_path);
+      return FALSE;
+    }
+
+  names = g_ptr_array_new_with_free_func (g_free);
+  track_archive_list (names, track_path, NULL);
+  g_ptr_array_sort (names, track_archive_compare_names);
+
+  archive_path = g_strconcat (track_path, TRACK_ARCHIVE_SUFFIX, NULL);
+  archive_file = g_file_new_for_path (archive_path);
+  file_output = g_file_replace (archive_file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error);
+  if (file_output == NULL)
+    goto exit;
+
+  output = g_data_output_stream_new (G_OUTPUT_STREAM (file_output));
+  if (!g_data_output_stream_put_uint32 (output, TRACK_ARCHIVE_MAGIC, NULL, &error) ||
+      !g_data_output_stream_put_uint32 (output, TRACK_ARCHIVE_VERSION, NULL, &error) ||
+      !g_data_output_stream_put_uint32 (output, TRACK_ARCHIVE_BLOCK_SIZE, NULL, &error))
+    {
+      goto exit;
+    }
+  offset = 3 * sizeof (guint32);
+
+  /* Быстрое сжатие: распаковка deflate не зависит от уровня сжатия. */
+  compressor = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW, 1));
+  files = g_ptr_array_new_with_free_func ((GDestroyNotify) track_archive_file_free);
+
+  for (i = 0; i < names->len; i++)
+    {
+      TrackArchiveFile *file = g_new0 (TrackArchiveFile, 1);
+      gchar *path = g_build_filename (track_path, names->pdata[i], NULL);
+
+      file->name = g_strdup (names->pdata[i]);
+      file->blocks = g_array_new (FALSE, FALSE, sizeof (TrackArchiveBlock));
+      g_ptr_array_add (files, file);
+
+      status = track_archive_write_file (output, &offset, compressor, path, file, &error);
+      total += file->size;
+      g_free (path);
+
+      if (!status)
+        goto exit;
+    }
+
+  status = track_archive_write_index (output, offset, files, &error) &&
+           g_output_stream_close (G_OUTPUT_STREAM (output), NULL, &error);
+  if (!status)
+    goto exit;
+
+  /* Галс удаляется только после проверки всего архива. */
+  if (!track_archive_verify (archive_path, track_path))
+    {
+      g_message ("track archive '%s' verification failed", archive_path);
+      status = FALSE;
+      goto exit;
+    }
+
+  project_id = hyscan_db_project_open (db, project_name);
+  status = (project_id >= 0) && hyscan_db_track_remove (db, project_id, track_name);
+  if (project_id >= 0)
+    hyscan_db_close (db, project_id);
+
+  if (!status)
+    g_message ("can't remove track '%s'", track_name);
+  else
+    g_print ("track '%s' archived: %" G_GUINT64_FORMAT " -> %" G_GUINT64_FORMAT " bytes\n",
+             track_name, total, offset);
+
+exit:
+  if (error != NULL)
+    {
+      g_message ("can't archive track '%s': %s", track_name, error->message);
+      g_error_free (error);
+      status = FALSE;
+    }
+
+  g_clear_object (&output);
+  g_clear_object (&file_output);
+  if (!status && (archive_file != NULL))
+    g_remove (archive_path);
+
+  g_clear_object (&archive_file);
+  g_clear_object (&compressor);
+  g_clear_pointer (&files, g_ptr_array_unref);
+  g_ptr_array_unref (names);
+  g_free (archive_path);
+  g_free (track_path);
+
+  return status;
+}
+
+gboolean
+track_archive_unpack (const gchar *db_uri,
+                      const gchar *project_name,
+                      const gchar *track_name)
+{
+  TrackArchive *archive;
+  gchar *track_path;
+  gchar *archive_path;
+  gchar *tmp_path;
+  guchar *data;
+  gboolean status = TRUE;
+  guint i;
+
+  track_path = track_archive_track_path (db_uri, project_name, track_name);
+  if (track_path == NULL)
+    return FALSE;
+
+  if (g_file_test (track_path, G_FILE_TEST_EXISTS))
+    {
+      g_message ("track '%s' already exists", track_name);
+      g_free (track_path);
+      return FALSE;
+    }
+
+  archive_path = g_strconcat (track_path, TRACK_ARCHIVE_SUFFIX, NULL);
+  archive = track_archive_open (archive_path);
+  if (archive == NULL)
+    {
+      g_free (archive_path);
+      g_free (track_path);
+      return FALSE;
+    }
+
+  /* Галс восстанавливается во временном каталоге и появляется
+   * в базе данных только целиком. Оставшийся после аварийного
+   * завершения временный каталог не трогаем. */
+  tmp_path = g_strconcat (track_path, ".tmp", NULL);
+  if (g_file_test (tmp_path, G_FILE_TEST_EXISTS))
+    {
+      g_message ("can't restore track '%s': '%s' already exists", track_name, tmp_path);
+      track_archive_close (archive);
+      g_free (tmp_path);
+      g_free (archive_path);
+      g_free (track_path);
+      return FALSE;
+    }
+
+  data = g_malloc (TRACK_ARCHIVE_BLOCK_SIZE);
+
+  for (i = 0; status && (i < track_archive_get_n_files (archive)); i++)
+    {
+      GFileOutputStream *output;
+      GFile *file;
+      const gchar *name;
+      gchar *path, *dir;
+      guint64 size, offset;
+
+      name = track_archive_get_file (archive, i, &size);
+      path = g_build_filename (tmp_path, name, NULL);
+      dir = g_path_get_dirname (path);
+      g_mkdir_with_parents (dir, 0755);
+
+      file = g_file_new_for_path (path);
+      output = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, NULL);
+      status = (output != NULL);
+
+      for (offset = 0; status && (offset < size); offset += TRACK_ARCHIVE_BLOCK_SIZE)
+        {
+          gsize length = MIN (size - offset, TRACK_ARCHIVE_BLOCK_SIZE);
+
+          status = track_archive_read (archive, i, offset, data, length) &&
+                   g_output_stream_write_all (G_OUTPUT_STREAM (output), data, length, NULL, NULL, NULL);
+        }
+
+      if (output != NULL)
+        {
+          status = g_output_stream_close (G_OUTPUT_STREAM (output), NULL, NULL) && status;
+          g_object_unref (output);
+        }
+
+      if (!status)
+        g_message ("can't restore file '%s'", path);
+
+      g_object_unref (file);
+      g_free (path);
+      g_free (dir);
+    }
+
+  track_archive_close (archive);
+  g_free (data);
+
+  if (status && (g_rename (tmp_path, track_path) != 0))
+    {
+      g_message ("can't rename '%s' to '%s'", tmp_path, track_path);
+      status = FALSE;
+    }
+
+  if (status)
+    {
+      g_remove (archive_path);
+      g_print ("track '%s' restored\n", track_name);
+    }
+  else
+    {
+      track_archive_remove_dir (tmp_path);
+    }
+
+  g_free (tmp_path);
+  g_free (archive_path);
+  g_free (track_path);
+
+  return status;
+}
+
+/* Функции чтения чисел таблицы блоков. Если предыдущее чтение
+ * завершилось ошибкой, чтение не выполняется и возвращается 0. */
+static guint32
+track_archive_read_uint32 (GDataInputStream *input,
+                           GError          **error)
+{
+  return (*error == NULL) ? g_data_input_stream_read_uint32 (input, NULL, error) : 0;
+}
+
+static guint64
+track_archive_read_uint64 (GDataInputStream *input,
+                           GError          **error)
+{
+  return (*error == NULL) ? g_data_input_stream_read_uint64 (input, NULL, error) : 0;
+}
+
+/* Функция читает таблицу блоков архива. */
+static gboolean
+track_archive_read_index (TrackArchive *archive,
+                          GError      **error)
+{
+  GDataInputStream *input;
+  guint64 offset;
+  guint32 n_files;
+  guint32 i, j;
+  gboolean status = FALSE;
+
+  if (!g_seekable_seek (G_SEEKABLE (archive->input), -TRACK_ARCHIVE_TRAILER_SIZE, G_SEEK_END, NULL, error))
+    return FALSE;
+
+  input = g_data_input_stream_new (G_INPUT_STREAM (archive->input));
+  g_filter_input_stream_set_close_base_stream (G_FILTER_INPUT_STREAM (input), FALSE);
+
+  offset = g_data_input_stream_read_uint64 (input, NULL, error);
+  if ((*error != NULL) || (g_data_input_stream_read_uint32 (input, NULL, error) != TRACK_ARCHIVE_MAGIC))
+    goto exit;
+
+  /* Таблица читается отдельным потоком после перехода к её началу. */
+  g_object_unref (input);
+  if (!g_seekable_seek (G_SEEKABLE (archive->input), offset, G_SEEK_SET, NULL, error))
+    return FALSE;
+
+  input = g_data_input_stream_new (G_INPUT_STREAM (archive->input));
+  g_filter_input_stream_set_close_base_stream (G_FILTER_INPUT_STREAM (input), FALSE);
+
+  n_files = g_data_input_stream_read_uint32 (input, NULL, error);
+  for (i = 0; (*error == NULL) && (i < n_files); i++)
+    {
+      TrackArchiveFile *file;
+      guint32 name_length;
+      guint32 n_blocks;
+
+      name_length = g_data_input_stream_read_uint32 (input, NULL, error);
+      if ((*error != NULL) || (name_length > 4096))
+        goto exit;
+
+      file = g_new0 (TrackArchiveFile, 1);
+      file->name = g_malloc0 (name_length + 1);
+      file->blocks = g_array_new (FALSE, FALSE, sizeof (TrackArchiveBlock));
+      g_ptr_array_add (archive->files, file);
+
+      if (!g_input_stream_read_all (G_INPUT_STREAM (input), file->name, name_length, NULL, NULL, error))
+        goto exit;
+
+      if ((strlen (file->name) != name_length) || !track_archive_check_name (file->name))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "invalid file name '%s'", file->name);
+          goto exit;
+        }
+
+      file->size = track_archive_read_uint64 (input, error);
+      n_blocks = track_archive_read_uint32 (input, error);
+      if ((*error != NULL) || (n_blocks != (file->size + archive->block_size - 1) / archive->block_size))
+        goto exit;
+
+      for (j = 0; (*error == NULL) && (j < n_blocks); j++)
+        {
+          TrackArchiveBlock block;
+
+          block.offset = track_archive_read_uint64 (input, error);
+          block.size = track_archive_read_uint32 (input, error);
+          block.method = track_archive_read_uint32 (input, error);
+
+          if ((*error != NULL) || (block.size > TRACK_ARCHIVE_MAX_PACKED) || (block.method > TRACK_ARCHIVE_DELTA_DEFLATE))
+            goto exit;
+
+          g_array_append_val (file->blocks, block);
+        }
+    }
+
+  status = (*error == NULL);
+
+exit:
+  g_object_unref (input);
+
+  return status;
+}
+
+TrackArchive *
+track_archive_open (const gchar *path)
+{
+  TrackArchive *archive;
+  GDataInputStream *header;
+  GError *error = NULL;
+  GFile *file;
+
+  archive = g_new0 (TrackArchive, 1);
+  archive->files = g_ptr_array_new_with_free_func ((GDestroyNotify) track_archive_file_free);
+  archive->block_file = -1;
+
+  file = g_file_new_for_path (path);
+  archive->input = g_file_read (file, NULL, &error);
+  g_object_unref (file);
+  if (archive->input == NULL)
+    goto fail;
+
+  header = g_data_input_stream_new (G_INPUT_STREAM (archive->input));
+  g_filter_input_stream_set_close_base_stream (G_FILTER_INPUT_STREAM (header), FALSE);
+
+  if ((g_data_input_stream_read_uint32 (header, NULL, &error) != TRACK_ARCHIVE_MAGIC) ||
+      (g_data_input_stream_read_uint32 (header, NULL, &error) != TRACK_ARCHIVE_VERSION))
+    {
+      g_object_unref (header);
+      goto fail;
+    }
+
+  archive->block_size = g_data_input_stream_read_uint32 (header, NULL, &error);
+  g_object_unref (header);
+  if (archive->block_size != TRACK_ARCHIVE_BLOCK_SIZE)
+    goto fail;
+
+  if (!track_archive_read_index (archive, &error))
+    goto fail;
+
+  archive->decompressor = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW));
+  archive->packed = g_malloc (TRACK_ARCHIVE_MAX_PACKED);
+  archive->block = g_malloc (TRACK_ARCHIVE_BLOCK_SIZE);
+
+  return archive;
+
+fail:
+  if (error != NULL)
+    {
+      g_message ("can't open track archive '%s': %s", path, error->message);
+      g_error_free (error);
+    }
+  else
+    {
+      g_message ("'%s' is not a track archive", path);
+    }
+
+  g_clear_object (&archive->input);
+  g_ptr_array_unref (archive->files);
+  g_free (archive);
+
+  return NULL;
+}
+
+guint
+track_archive_get_n_files (TrackArchive *archive)
+{
+  return archive->files->len;
+}
+
+const gchar *
+track_archive_get_file (TrackArchive *archive,
+                        guint         n,
+                        guint64      *size)
+{
+  TrackArchiveFile *file;
+
+  if (n >= archive->files->len)
+    return NULL;
+
+  file = archive->files->pdata[n];
+  if (size != NULL)
+    *size = file->size;
+
+  return file->name;
+}
+
+/* Функция распаковывает блок файла, если он не был распакован последним. */
+static gboolean
+track_archive_load_block (TrackArchive     *archive,
+                          guint             n,
+                          TrackArchiveFile *file,
+                          guint             block_n)
+{
+  TrackArchiveBlock *block = &g_array_index (file->blocks, TrackArchiveBlock, block_n);
+  gsize expected = MIN (file->size - (guint64) block_n * archive->block_size, archive->block_size);
+  gsize size;
+
+  if ((archive->block_file == (gint) n) && (archive->block_n == block_n))
+    return TRUE;
+
+  archive->block_file = -1;
+
+  if (!g_seekable_seek (G_SEEKABLE (archive->input), block->offset, G_SEEK_SET, NULL, NULL) ||
+      !g_input_stream_read_all (G_INPUT_STREAM (archive->input), archive->packed, block->size, &size, NULL, NULL) ||
+      (size != block->size))
+    {
+      return FALSE;
+    }
+
+  if (block->method == TRACK_ARCHIVE_STORED)
+    {
+      if (size != expected)
+        return FALSE;
+
+      memcpy (archive->block, archive->packed, size);
+    }
+  else
+    {
+      size = track_archive_convert (archive->decompressor, archive->packed, block->size,
+                                    archive->block, archive->block_size);
+      if (size != expected)
+        return FALSE;
+
+      if (block->method == TRACK_ARCHIVE_DELTA_DEFLATE)
+        track_archive_delta_decode (archive->block, size);
+    }
+
+  archive->block_file = n;
+  archive->block_n = block_n;
+
+  return TRUE;
+}
+
+gboolean
+track_archive_read (TrackArchive *archive,
+                    guint         n,
+                    guint64       offset,
+                    gpointer      buffer,
+                    gsize         size)
+{
+  TrackArchiveFile *file;
+  guchar *output = buffer;
+
+  if (n >= archive->files->len)
+    return FALSE;
+
+  file = archive->files->pdata[n];
+  if ((offset > file->size) || (size > file->size - offset))
+    return FALSE;
+
+  /* Номер блока определяется по смещению, распаковываются только
+   * блоки, содержащие запрошенный участок. */
+  while (size > 0)
+    {
+      guint block_n = offset / archive->block_size;
+      gsize block_offset = offset % archive->block_size;
+      gsize length = MIN (size, archive->block_size - block_offset);
+
+      if (!track_archive_load_block (archive, n, file, block_n))
+        return FALSE;
+
+      memcpy (output, archive->block + block_offset, length);
+      output += length;
+      offset += length;
+      size -= length;
+    }
+
+  return TRUE;
+}
+
+void
+track_archive_close (TrackArchive *archive)
+{
+  g_clear_object (&archive->decompressor);
+  g_object_unref (archive->input);
+  g_ptr_array_unref (archive->files);
+  g_free (archive->packed);
+  g_free (archive->block);
+  g_free (archive);
+}
@@ -0,0 +1,48 @@
+#ifndef __TRACK_ARCHIVE_H__
+#define __TRACK_ARCHIVE_H__
+
+#include <hyscan-db.h>
+
+/* Архив галса локальной файловой базы данных. Файлы галса разбиваются
+ * на блоки фиксированного размера, каждый блок сжимается независимо.
+ * Для блоков, содержащих 16-битные отсчёты, перед сжатием применяется
+ * разностное кодирование, если оно уменьшает размер блока. Таблица
+ * блоков хранится в конце архива, поэтому чтение любого участка файла
+ * требует распаковки только блоков, содержащих этот участок. */
+typedef struct _TrackArchive TrackArchive;
+
+/* Функция упаковывает галс в архив "<галс>.ssa" в каталоге проекта.
+ * После проверки архива галс удаляется из базы данных. */
+gboolean       track_archive_pack      (HyScanDB                      *db,
+                                        const gchar                   *db_uri,
+                                        const gchar                   *project_name,
+                                        const gchar                   *track_name);
+
+/* Функция восстанавливает галс из архива в каталоге проекта
+ * и удаляет архив. */
+gboolean       track_archive_unpack    (const gchar                   *db_uri,
+                                        const gchar                   *project_name,
+                                        const gchar                   *track_name);
+
+/* Функция открывает архив галса. */
+TrackArchive  *track_archive_open      (const gchar                   *path);
+
+/* Функция возвращает число файлов в архиве. */
+guint          track_archive_get_n_files (TrackArchive                *archive);
+
+/* Функция возвращает путь файла относительно каталога галса и его размер. */
+const gchar   *track_archive_get_file  (TrackArchive                  *archive,
+                                        guint                          n,
+                                        guint64                       *size);
+
+/* Функция читает size байт файла n начиная со смещения offset. */
+gboolean       track_archive_read      (TrackArchive                  *archive,
+                                        guint                          n,
+                                        guint64                        offset,
+                                        gpointer                       buffer,
+                                        gsize                          size);
+
+/* Функция закрывает архив галса. */
+void           track_archive_close     (TrackArchive                  *archive);
+
+#endif /* __TRACK_ARCHIVE_H__ */
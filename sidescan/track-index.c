@@ -0,0 +1,485 @@
+#include "track-index.h"
+
+#include <hyscan-core-types.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#define TRACK_INDEX_FILE_MAGIC         0x53535449      /* Сигнатура файла индекса "SSTI". */
+#define TRACK_INDEX_FILE_VERSION       1               /* Версия формата файла индекса. */
+#define TRACK_INDEX_GAP_FACTOR         1.5             /* Разрыв, считающийся пропуском строк, в периодах. */
+#define TRACK_INDEX_STOP_CHECK         1024            /* Число записей между проверками завершения работы. */
+#define TRACK_INDEX_PAUSE              20000           /* Пауза между галсами, мкс. */
+
+static const HyScanSourceType track_index_sources[] = { HYSCAN_SOURCE_SIDE_SCAN_STARBOARD, HYSCAN_SOURCE_SIDE_SCAN_PORT };
+
+/* Файл индекса галса. */
+typedef struct
+{
+  guint32                      magic;
+  guint32                      version;
+  TrackIndexInfo               info;
+} TrackIndexFile;
+
+/* Строка данных борта. */
+typedef struct
+{
+  guint32                      index;
+  gint64                       time;
+} TrackIndexLine;
+
+struct _TrackIndex
+{
+  HyScanDB                    *db;
+  gchar                       *project_name;
+  gchar                       *path;           /* Каталог файлов индекса. */
+  guint                        nav_channel;
+
+  GThread                     *thread;
+  GMutex                       lock;
+  GCond                        cond;
+  gboolean                     scan;           /* Запрос обхода галсов. */
+  gchar                       *skip_track;     /* Записываемый галс. */
+  gint                         stop;
+
+  GHashTable                  *infos;          /* Сведения о галсах TrackIndexInfo по названиям. */
+  GHashTable                  *changed;        /* Названия галсов с изменившимися сведениями. */
+};
+
+static gint
+track_index_compare_periods (gconstpointer a,
+                             gconstpointer b)
+{
+  gint64 pa = *(const gint64 *) a;
+  gint64 pb = *(const gint64 *) b;
+
+  return (pa > pb) - (pa < pb);
+}
+
+/* Функция возвращает путь к файлу индекса галса. */
+static gchar *
+track_index_file_path (TrackIndex  *index,
+                       const gchar *track_name,
+                       const gchar *suffix)
+{
+  gchar *name = g_strconcat (track_name, suffix, NULL);
+  gchar *path = g_build_filename (index->path, name, NULL);
+
+  g_free (name);
+
+  return path;
+}
+
+/* Функция читает сохранённые сведения о галсе. */
+static gboolean
+track_index_read_info (TrackIndex     *index,
+                       const gchar    *track_name,
+                       TrackIndexInfo *info)
+{
+  TrackIndexFile file;
+  gchar *path;
+  gchar *data;
+  gsize size;
+
+  path = track_index_file_path (index, track_name, ".idx");
+  if (!g_file_get_contents (path, &data, &size, NULL))
+    {
+      g_free (path);
+      return FALSE;
+    }
+
+  g_free (path);
+
+  if (size == sizeof (file))
+    memcpy (&file, data, sizeof (file));
+  g_free (data);
+
+  if ((size != sizeof (file)) ||
+      (file.magic != TRACK_INDEX_FILE_MAGIC) ||
+      (file.version != TRACK_INDEX_FILE_VERSION))
+    {
+      return FALSE;
+    }
+
+  *info = file.info;
+
+  return TRUE;
+}
+
+/* Функция запоминает сведения о галсе и отмечает их изменение. */
+static void
+track_index_set_info (TrackIndex           *index,
+                      const gchar          *track_name,
+                      const TrackIndexInfo *info)
+{
+  TrackIndexInfo *copy = g_new (TrackIndexInfo, 1);
+
+  *copy = *info;
+
+  g_mutex_lock (&index->lock);
+  g_hash_table_insert (index->infos, g_strdup (track_name), copy);
+  g_hash_table_add (index->changed, g_strdup (track_name));
+  g_mutex_unlock (&index->lock);
+}
+
+/* Функция читает метки времени строк борта, определяет период
+ * зондирования, разрывы и неполные записи. Возвращает FALSE,
+ * если работа индексатора завершается. */
+static gboolean
+track_index_board (TrackIndex      *index,
+                   gint32           channel_id,
+                   guint32          first_index,
+                   guint32          last_index,
+                   TrackIndexBoard *board)
+{
+  GArray *lines;
+  GArray *periods;
+  guint32 prev_size = 0;
+  guint32 i;
+
+  lines = g_array_new (FALSE, FALSE, sizeof (TrackIndexLine));
+  periods = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  board->first_index = first_index;
+  board->last_index = last_index;
+
+  for (i = first_index; i <= last_index; i++)
+    {
+      TrackIndexLine line;
+      guint32 size = 0;
+
+      if (((i - first_index) % TRACK_INDEX_STOP_CHECK == 0) && g_atomic_int_get (&index->stop))
+        break;
+
+      /* Отсутствующие и пустые записи, а также последняя запись короче
+       * предыдущей остаются после прерванной записи галса. */
+      if (!hyscan_db_channel_get_data (index->db, channel_id, i, NULL, &size, &line.time) ||
+          (size == 0) ||
+          ((i == last_index) && (size < prev_size)))
+        {
+          board->n_truncated += 1;
+          continue;
+        }
+
+      prev_size = size;
+      line.index = i;
+      g_array_append_val (lines, line);
+    }
+
+  board->n_lines = lines->len;
+  if (lines->len > 0)
+    {
+      board->first_time = g_array_index (lines, TrackIndexLine, 0).time;
+      board->last_time = g_array_index (lines, TrackIndexLine, lines->len - 1).time;
+    }
+
+  /* Период зондирования - медиана интервалов между строками. */
+  for (i = 1; i < lines->len; i++)
+    {
+      gint64 period = g_array_index (lines, TrackIndexLine, i).time - g_array_index (lines, TrackIndexLine, i - 1).time;
+
+      if (period > 0)
+        g_array_append_val (periods, period);
+    }
+
+  if (periods->len > 0)
+    {
+      g_array_sort (periods, track_index_compare_periods);
+      board->period = g_array_index (periods, gint64, periods->len / 2);
+    }
+
+  for (i = 1; (board->period > 0) && (i < lines->len); i++)
+    {
+      TrackIndexLine *line = &g_array_index (lines, TrackIndexLine, i);
+      gint64 interval = line->time - (line - 1)->time;
+
+      if (interval <= TRACK_INDEX_GAP_FACTOR * board->period)
+        continue;
+
+      if (board->n_gaps < TRACK_INDEX_MAX_GAPS)
+        {
+          TrackIndexGap *gap = &board->gaps[board->n_gaps];
+
+          gap->index = line->index;
+          gap->time = line->time;
+          gap->n_dropped = (interval + board->period / 2) / board->period - 1;
+        }
+
+      board->n_gaps += 1;
+      board->n_dropped += (interval + board->period / 2) / board->period - 1;
+    }
+
+  g_array_unref (lines);
+  g_array_unref (periods);
+
+  return !g_atomic_int_get (&index->stop);
+}
+
+/* Функция индексирует галс, если в нём появились новые данные. */
+static gboolean
+track_index_build (TrackIndex  *index,
+                   gint32       project_id,
+                   const gchar *track_name)
+{
+  TrackIndexFile file;
+  TrackIndexInfo old;
+  gint32 channels[TRACK_INDEX_N_BOARDS];
+  guint32 first_index[TRACK_INDEX_N_BOARDS];
+  guint32 last_index[TRACK_INDEX_N_BOARDS];
+  gboolean has_old;
+  gboolean up_to_date;
+  gboolean status = TRUE;
+  gint32 track_id;
+  gchar *path;
+  guint i;
+
+  track_id = hyscan_db_track_open (index->db, project_id, track_name);
+  if (track_id < 0)
+    return FALSE;
+
+  /* Сохранённые ранее сведения загружаются при первом обходе. */
+  has_old = track_index_get_info (index, track_name, &old);
+  if (!has_old && track_index_read_info (index, track_name, &old))
+    {
+      track_index_set_info (index, track_name, &old);
+      has_old = TRUE;
+    }
+  up_to_date = has_old;
+
+  for (i = 0; i < TRACK_INDEX_N_BOARDS; i++)
+    {
+      const gchar *channel_name = hyscan_channel_get_name_by_types (track_index_sources[i], TRUE, 1);
+
+      channels[i] = hyscan_db_channel_open (index->db, track_id, channel_name);
+      if ((channels[i] >= 0) &&
+          !hyscan_db_channel_get_data_range (index->db, channels[i], &first_index[i], &last_index[i]))
+        {
+          hyscan_db_close (index->db, channels[i]);
+          channels[i] = -1;
+        }
+
+      if (channels[i] < 0)
+        up_to_date = up_to_date && (old.boards[i].n_lines == 0);
+      else
+        up_to_date = up_to_date &&
+                     (old.boards[i].first_index == first_index[i]) &&
+                     (old.boards[i].last_index == last_index[i]);
+    }
+
+  memset (&file, 0, sizeof (file));
+  file.magic = TRACK_INDEX_FILE_MAGIC;
+  file.version = TRACK_INDEX_FILE_VERSION;
+
+  for (i = 0; i < TRACK_INDEX_N_BOARDS; i++)
+    {
+      if (channels[i] < 0)
+        continue;
+
+      if (!up_to_date && status)
+        status = track_index_board (index, channels[i], first_index[i], last_index[i], &file.info.boards[i]);
+
+      hyscan_db_close (index->db, channels[i]);
+    }
+
+  hyscan_db_close (index->db, track_id);
+
+  if (up_to_date || !status)
+    return FALSE;
+
+  track_index_set_info (index, track_name, &file.info);
+
+  /* Навигационные данные. */
+  if (index->nav_channel > 0)
+    {
+      NavIndex *nav = nav_index_new (index->db, index->project_name, track_name, index->nav_channel);
+
+      nav_index_update (nav, 0);
+      path = track_index_file_path (index, track_name, ".nav");
+      nav_index_save (nav, path);
+      nav_index_free (nav);
+      g_free (path);
+    }
+
+  /* Файл сведений о галсе записывается последним: по нему
+   * определяется, что галс проиндексирован. */
+  path = track_index_file_path (index, track_name, ".idx");
+  status = g_file_set_contents (path, (const gchar *) &file, sizeof (file), NULL);
+  if (!status)
+    g_message ("can't save index of track '%s'", track_name);
+  g_free (path);
+
+  return status;
+}
+
+/* Функция обходит все галсы проекта. */
+static void
+track_index_walk (TrackIndex  *index,
+                  const gchar *skip_track)
+{
+  gint32 project_id;
+  gchar **tracks;
+  guint i;
+
+  project_id = hyscan_db_project_open (index->db, index->project_name);
+  if (project_id < 0)
+    return;
+
+  tracks = hyscan_db_track_list (index->db, project_id);
+  for (i = 0; (tracks != NULL) && (tracks[i] != NULL); i++)
+    {
+      if (g_atomic_int_get (&index->stop))
+        break;
+
+      if (g_strcmp0 (tracks[i], skip_track) == 0)
+        continue;
+
+      if (track_index_build (index, project_id, tracks[i]))
+        g_usleep (TRACK_INDEX_PAUSE);
+    }
+
+  g_strfreev (tracks);
+  hyscan_db_close (index->db, project_id);
+}
+
+/* Поток индексатора. */
+static gpointer
+track_index_thread (TrackIndex *index)
+{
+  g_mutex_lock (&index->lock);
+
+  while (!g_atomic_int_get (&index->stop))
+    {
+      gchar *skip_track;
+
+      if (!index->scan)
+        {
+          g_cond_wait (&index->cond, &index->lock);
+          continue;
+        }
+
+      index->scan = FALSE;
+      skip_track = g_strdup (index->skip_track);
+      g_mutex_unlock (&index->lock);
+
+      track_index_walk (index, skip_track);
+      g_free (skip_track);
+
+      g_mutex_lock (&index->lock);
+    }
+
+  g_mutex_unlock (&index->lock);
+
+  return NULL;
+}
+
+TrackIndex *
+track_index_new (HyScanDB    *db,
+                 const gchar *db_uri,
+                 const gchar *project_name,
+                 guint        nav_channel)
+{
+  TrackIndex *index;
+  gchar *key, *hash;
+
+  index = g_new0 (TrackIndex, 1);
+  index->db = g_object_ref (db);
+  index->project_name = g_strdup (project_name);
+  index->nav_channel = nav_channel;
+
+  /* Каталог индекса определяется базой данных и проектом. */
+  key = g_strdup_printf ("%s/%s", db_uri, project_name);
+  hash = g_compute_checksum_for_string (G_CHECKSUM_SHA256, key, -1);
+  index->path = g_build_filename (g_get_user_cache_dir (), "side-scan", "index", hash, NULL);
+  g_mkdir_with_parents (index->path, 0755);
+  g_free (hash);
+  g_free (key);
+
+  index->infos = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  index->changed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  g_mutex_init (&index->lock);
+  g_cond_init (&index->cond);
+  index->scan = TRUE;
+  index->thread = g_thread_new ("track-index", (GThreadFunc) track_index_thread, index);
+
+  return index;
+}
+
+void
+track_index_scan (TrackIndex  *index,
+                  const gchar *skip_track)
+{
+  g_mutex_lock (&index->lock);
+  g_free (index->skip_track);
+  index->skip_track = g_strdup (skip_track);
+  index->scan = TRUE;
+  g_cond_signal (&index->cond);
+  g_mutex_unlock (&index->lock);
+}
+
+GHashTable *
+track_index_take_changed (TrackIndex *index)
+{
+  GHashTable *changed = NULL;
+
+  g_mutex_lock (&index->lock);
+  if (g_hash_table_size (index->changed) > 0)
+    {
+      changed = index->changed;
+      index->changed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    }
+  g_mutex_unlock (&index->lock);
+
+  return changed;
+}
+
+gboolean
+track_index_get_info (TrackIndex     *index,
+                      const gchar    *track_name,
+                      TrackIndexInfo *info)
+{
+  TrackIndexInfo *known;
+
+  g_mutex_lock (&index->lock);
+  known = g_hash_table_lookup (index->infos, track_name);
+  if (known != NULL)
+    *info = *known;
+  g_mutex_unlock (&index->lock);
+
+  return (known != NULL);
+}
+
+gboolean
+track_index_load_nav (TrackIndex  *index,
+                      const gchar *track_name,
+                      NavIndex    *nav)
+{
+  gchar *path;
+  gboolean status;
+
+  path = track_index_file_path (index, track_name, ".nav");
+  status = nav_index_load (nav, path);
+  g_free (path);
+
+  return status;
+}
+
+void
+track_index_free (TrackIndex *index)
+{
+  g_mutex_lock (&index->lock);
+  g_atomic_int_set (&index->stop, TRUE);
+  g_cond_signal (&index->cond);
+  g_mutex_unlock (&index->lock);
+
+  g_thread_join (index->thread);
+
+  g_mutex_clear (&index->lock);
+  g_cond_clear (&index->cond);
+  g_hash_table_unref (index->infos);
+  g_hash_table_unref (index->changed);
+  g_object_unref (index->db);
+  g_free (index->project_name);
+  g_free (index->skip_track);
+  g_free (index->path);
+  g_free (index);
+}
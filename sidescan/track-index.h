@@ -0,0 +1,76 @@
+#ifndef __TRACK_INDEX_H__
+#define __TRACK_INDEX_H__
+
+#include "nav-index.h"
+
+#define TRACK_INDEX_N_BOARDS           2               /* Число бортов. */
+#define TRACK_INDEX_MAX_GAPS           64              /* Максимальное число сохраняемых разрывов борта. */
+
+/* Разрыв в данных борта. */
+typedef struct
+{
+  guint32                      index;          /* Индекс строки после разрыва. */
+  guint32                      n_dropped;      /* Число пропущенных строк. */
+  gint64                       time;           /* Время строки после разрыва, мкс. */
+} TrackIndexGap;
+
+/* Сведения о данных борта. */
+typedef struct
+{
+  guint32                      first_index;    /* Диапазон индексов строк. */
+  guint32                      last_index;
+  gint64                       first_time;     /* Время первой и последней строки, мкс. */
+  gint64                       last_time;
+  gint64                       period;         /* Период зондирования, мкс. */
+  guint32                      n_lines;        /* Число строк. */
+  guint32                      n_gaps;         /* Число разрывов. */
+  guint32                      n_dropped;      /* Число пропущенных строк. */
+  guint32                      n_truncated;    /* Число неполных записей. */
+  TrackIndexGap                gaps[TRACK_INDEX_MAX_GAPS];
+} TrackIndexBoard;
+
+/* Сведения о галсе. */
+typedef struct
+{
+  TrackIndexBoard              boards[TRACK_INDEX_N_BOARDS];
+} TrackIndexInfo;
+
+/* Фоновый индексатор галсов проекта. Отдельный поток один раз обходит
+ * все галсы проекта, проверяет данные бортов на разрывы и неполные записи
+ * после прерванной записи и разбирает навигационные данные. Результаты
+ * сохраняются в каталоге кэша пользователя и загружаются потоком
+ * индексатора без повторного чтения данных. Сведения о галсах хранятся
+ * в памяти, поэтому их получение не обращается к файлам. Галс
+ * индексируется повторно, только если в нём появились новые данные. */
+typedef struct _TrackIndex TrackIndex;
+
+/* Функция создаёт индексатор галсов проекта и запускает обход галсов. */
+TrackIndex    *track_index_new         (HyScanDB                      *db,
+                                        const gchar                   *db_uri,
+                                        const gchar                   *project_name,
+                                        guint                          nav_channel);
+
+/* Функция запрашивает повторный обход галсов проекта. */
+void           track_index_scan        (TrackIndex                    *index,
+                                        const gchar                   *skip_track);
+
+/* Функция возвращает множество названий галсов, сведения о которых
+ * появились или изменились с момента последнего вызова, или NULL, если
+ * таких галсов нет. Множество освобождается g_hash_table_unref. */
+GHashTable    *track_index_take_changed (TrackIndex                   *index);
+
+/* Функция возвращает сведения о галсе. Возвращает FALSE,
+ * если галс ещё не проиндексирован. */
+gboolean       track_index_get_info    (TrackIndex                    *index,
+                                        const gchar                   *track_name,
+                                        TrackIndexInfo                *info);
+
+/* Функция загружает сохранённые навигационные отметки галса. */
+gboolean       track_index_load_nav    (TrackIndex                    *index,
+                                        const gchar                   *track_name,
+                                        NavIndex                      *nav);
+
+/* Функция останавливает индексатор и освобождает его. */
+void           track_index_free        (TrackIndex                    *index);
+
+#endif /* __TRACK_INDEX_H__ */
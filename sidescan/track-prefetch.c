@@ -0,0 +1,262 @@
+#include "track-prefetch.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+#ifdef G_OS_UNIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define TRACK_PREFETCH_SCREENS         4               /* Число экранов упреждающего чтения. */
+#define TRACK_PREFETCH_MIN_STEP        0.01            /* Минимальное смещение области для нового запроса. */
+
+/* Файл канала, отображённый в память. */
+typedef struct
+{
+  gpointer                     data;
+  gsize                        size;
+  gsize                        offset;         /* Смещение файла в данных канала. */
+} TrackPrefetchFile;
+
+/* Файлы данных или индексов канала. Данные канала в файловой базе данных
+ * разбиты на части "<канал>.<номер части>.d" и "<канал>.<номер части>.i",
+ * которые записываются последовательно и вместе образуют данные канала. */
+typedef struct
+{
+  GArray                      *files;          /* Части в порядке записи TrackPrefetchFile. */
+  gsize                        size;           /* Суммарный размер частей. */
+} TrackPrefetchChannel;
+
+struct _TrackPrefetch
+{
+  GPtrArray                   *channels;       /* Каналы TrackPrefetchChannel. */
+  gdouble                      from;           /* Предыдущая область просмотра. */
+  gdouble                      to;
+};
+
+static void
+track_prefetch_channel_free (TrackPrefetchChannel *channel)
+{
+#ifdef G_OS_UNIX
+  guint i;
+
+  for (i = 0; i < channel->files->len; i++)
+    {
+      TrackPrefetchFile *file = &g_array_index (channel->files, TrackPrefetchFile, i);
+
+      munmap (file->data, file->size);
+    }
+#endif
+
+  g_array_unref (channel->files);
+  g_free (channel);
+}
+
+#ifdef G_OS_UNIX
+
+/* Функция отображает файл в память и сообщает ядру о последовательном чтении. */
+static void
+track_prefetch_map (TrackPrefetchChannel *channel,
+                    const gchar          *path)
+{
+  TrackPrefetchFile file;
+  struct stat st;
+  int fd;
+
+  fd = open (path, O_RDONLY);
+  if (fd < 0)
+    return;
+
+  if ((fstat (fd, &st) != 0) || !S_ISREG (st.st_mode) || (st.st_size == 0))
+    {
+      close (fd);
+      return;
+    }
+
+  posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  file.size = st.st_size;
+  file.data = mmap (NULL, file.size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+
+  if (file.data == MAP_FAILED)
+    return;
+
+  madvise (file.data, file.size, MADV_SEQUENTIAL);
+
+  file.offset = channel->size;
+  channel->size += file.size;
+  g_array_append_val (channel->files, file);
+}
+
+static gint
+track_prefetch_compare_names (gconstpointer a,
+                              gconstpointer b)
+{
+  return g_strcmp0 (*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+/* Функция отображает в память части канала с расширением suffix. Номера
+ * частей в названиях файлов дополнены нулями, поэтому порядок записи
+ * совпадает с порядком названий. */
+static void
+track_prefetch_add_channel (TrackPrefetch *prefetch,
+                            const gchar   *path,
+                            GPtrArray     *names,
+                            const gchar   *channel_name,
+                            const gchar   *suffix)
+{
+  TrackPrefetchChannel *channel;
+  gchar *prefix;
+  guint i;
+
+  channel = g_new0 (TrackPrefetchChannel, 1);
+  channel->files = g_array_new (FALSE, FALSE, sizeof (TrackPrefetchFile));
+
+  prefix = g_strconcat (channel_name, ".", NULL);
+  for (i = 0; i < names->len; i++)
+    {
+      const gchar *name = names->pdata[i];
+
+      if (g_str_has_prefix (name, prefix) && g_str_has_suffix (name, suffix))
+        {
+          gchar *file = g_build_filename (path, name, NULL);
+
+          track_prefetch_map (channel, file);
+          g_free (file);
+        }
+    }
+  g_free (prefix);
+
+  if (channel->files->len > 0)
+    g_ptr_array_add (prefetch->channels, channel);
+  else
+    track_prefetch_channel_free (channel);
+}
+
+#endif
+
+TrackPrefetch *
+track_prefetch_new (const gchar         *db_uri,
+                    const gchar         *project_name,
+                    const gchar         *track_name,
+                    const gchar * const *channels)
+{
+  TrackPrefetch *prefetch = NULL;
+
+#ifdef G_OS_UNIX
+  const gchar *name;
+  GPtrArray *names;
+  gchar *path;
+  GDir *dir;
+  guint i;
+
+  if (!g_str_has_prefix (db_uri, "file://"))
+    return NULL;
+
+  path = g_build_filename (db_uri + strlen ("file://"), project_name, track_name, NULL);
+  dir = g_dir_open (path, 0, NULL);
+  if (dir == NULL)
+    {
+      g_free (path);
+      return NULL;
+    }
+
+  names = g_ptr_array_new_with_free_func (g_free);
+  while ((name = g_dir_read_name (dir)) != NULL)
+    g_ptr_array_add (names, g_strdup (name));
+  g_ptr_array_sort (names, track_prefetch_compare_names);
+  g_dir_close (dir);
+
+  prefetch = g_new0 (TrackPrefetch, 1);
+  prefetch->channels = g_ptr_array_new_with_free_func ((GDestroyNotify) track_prefetch_channel_free);
+  prefetch->from = -1.0;
+  prefetch->to = -1.0;
+
+  for (i = 0; channels[i] != NULL; i++)
+    {
+      track_prefetch_add_channel (prefetch, path, names, channels[i], ".d");
+      track_prefetch_add_channel (prefetch, path, names, channels[i], ".i");
+    }
+
+  g_ptr_array_unref (names);
+  g_free (path);
+#endif
+
+  return prefetch;
+}
+
+void
+track_prefetch_view (TrackPrefetch *prefetch,
+                     gdouble        from,
+                     gdouble        to)
+{
+#ifdef G_OS_UNIX
+  gdouble ahead_from, ahead_to;
+  gdouble screen;
+  gsize page;
+  guint i, j;
+
+  from = CLAMP (from, 0.0, 1.0);
+  to = CLAMP (to, from, 1.0);
+
+  if ((ABS (from - prefetch->from) < TRACK_PREFETCH_MIN_STEP) &&
+      (ABS (to - prefetch->to) < TRACK_PREFETCH_MIN_STEP))
+    {
+      return;
+    }
+
+  /* Область упреждающего чтения в направлении прокрутки. */
+  screen = MAX (to - from, TRACK_PREFETCH_MIN_STEP);
+  if (from >= prefetch->from)
+    {
+      ahead_from = from;
+      ahead_to = MIN (1.0, to + TRACK_PREFETCH_SCREENS * screen);
+    }
+  else
+    {
+      ahead_from = MAX (0.0, from - TRACK_PREFETCH_SCREENS * screen);
+      ahead_to = to;
+    }
+
+  prefetch->from = from;
+  prefetch->to = to;
+
+  /* Строки в канале расположены в порядке записи, поэтому область просмотра
+   * пропорционально переносится на данные канала, а затем на части,
+   * в которые попадает эта область. */
+  page = sysconf (_SC_PAGESIZE);
+  for (i = 0; i < prefetch->channels->len; i++)
+    {
+      TrackPrefetchChannel *channel = g_ptr_array_index (prefetch->channels, i);
+      gsize channel_start = ahead_from * channel->size;
+      gsize channel_end = ahead_to * channel->size;
+
+      for (j = 0; j < channel->files->len; j++)
+        {
+          TrackPrefetchFile *file = &g_array_index (channel->files, TrackPrefetchFile, j);
+          gsize start, end;
+
+          if ((channel_end < file->offset) || (channel_start >= file->offset + file->size))
+            continue;
+
+          start = (channel_start > file->offset) ? channel_start - file->offset : 0;
+          start = start / page * page;
+          end = MIN (file->size, channel_end - file->offset + page);
+
+          if (end > start)
+            madvise ((guint8 *) file->data + start, end - start, MADV_WILLNEED);
+        }
+    }
+#endif
+}
+
+void
+track_prefetch_free (TrackPrefetch *prefetch)
+{
+  g_ptr_array_unref (prefetch->channels);
+  g_free (prefetch);
+}
@@ -0,0 +1,31 @@
+#ifndef __TRACK_PREFETCH_H__
+#define __TRACK_PREFETCH_H__
+
+#include <glib.h>
+
+/* Упреждающее чтение данных галса из локальной файловой базы данных.
+ * Файлы отображаемых каналов галса отображаются в память только для
+ * чтения, ядру сообщается о последовательном доступе, а при прокрутке
+ * запрашивается загрузка данных впереди области просмотра. Данные
+ * читаются библиотекой базы данных из уже заполненного страничного кэша. */
+typedef struct _TrackPrefetch TrackPrefetch;
+
+/* Функция создаёт объект упреждающего чтения для каналов channels галса,
+ * список названий каналов завершается NULL. Возвращает NULL, если база
+ * данных не является локальной (file://) или галса нет. */
+TrackPrefetch *track_prefetch_new      (const gchar                   *db_uri,
+                                        const gchar                   *project_name,
+                                        const gchar                   *track_name,
+                                        const gchar * const           *channels);
+
+/* Функция сообщает об области просмотра галса. Границы from и to задаются
+ * долями длины галса от 0 до 1. Загружаются данные области просмотра
+ * и нескольких следующих за ней экранов в направлении прокрутки. */
+void           track_prefetch_view     (TrackPrefetch                 *prefetch,
+                                        gdouble                        from,
+                                        gdouble                        to);
+
+/* Функция освобождает объект упреждающего чтения. */
+void           track_prefetch_free     (TrackPrefetch                 *prefetch);
+
+#endif /* __TRACK_PREFETCH_H__ */